@@ -0,0 +1,201 @@
+#include "engine.h"
+#include "../jit/jit.h"
+#include "../parser/driver.hh"
+#include <optional>
+
+namespace flang {
+
+// sends what the thread prints to the capture of an engine while alive, if
+// it has one
+class EngineOutput {
+public:
+  EngineOutput(CapturedOutput *output) {
+    if (output != nullptr)
+      scope.emplace(*output);
+  }
+
+private:
+  std::optional<OutputScope> scope;
+};
+
+Engine::Engine() : Engine(Options()) {}
+
+Engine::Engine(Options const &options)
+    : settings(options), interpreter(std::make_unique<Interpreter>()) {
+  apply_options();
+}
+
+Engine::Engine(Options const &options, SemanticAnalyzer semantic_analyzer,
+               unique_ptr<Interpreter> interpreter)
+    : settings(options), semantic_analyzer(std::move(semantic_analyzer)),
+      interpreter(std::move(interpreter)) {
+  apply_options();
+}
+
+void Engine::apply_options() {
+  semantic_analyzer.set_type_inference(settings.infer_types);
+  interpreter->set_memoization(settings.memoize_pure);
+  interpreter->set_threads(settings.threads);
+  interpreter->set_memory_limit(settings.memory_limit);
+  interpreter->set_time_limit(settings.time_limit);
+  interpreter->set_depth_limit(settings.depth_limit);
+
+  bool use_jit = settings.jit_threshold != 0 && jit::Jit::available();
+  interpreter->set_jit_threshold(use_jit ? settings.jit_threshold : 0);
+  semantic_analyzer.set_jit(use_jit);
+}
+
+unique_ptr<Engine> Engine::fork() const {
+  // the constructor is private
+  return unique_ptr<Engine>(
+      new Engine(settings, semantic_analyzer.fork(), interpreter->fork()));
+}
+
+void Engine::load_module(std::string const &file) {
+  EngineOutput output_scope(output);
+  auto ast = parse_file(file);
+
+  try {
+    analyze(ast);
+    evaluate(ast);
+  } catch (...) {
+    clear_stack(ast);
+    throw;
+  }
+}
+
+shared_ptr<ASTNode> Engine::eval(std::string_view source) {
+  EngineOutput output_scope(output);
+  auto ast = parse(source);
+
+  try {
+    analyze(ast);
+    return evaluate(ast);
+  } catch (...) {
+    clear_stack(ast);
+    throw;
+  }
+}
+
+shared_ptr<ASTNode> Engine::call(std::string const &function,
+                                 vector<shared_ptr<ASTNode>> args) {
+  EngineOutput output_scope(output);
+  return interpreter->call(function, std::move(args));
+}
+
+void Engine::define(std::string const &name, NativeFunction function) {
+  semantic_analyzer.declare_native(name);
+  interpreter->define_native(name, std::move(function));
+}
+
+void Engine::capture(CapturedOutput *output) {
+  if (output != nullptr)
+    CapturedOutput::install();
+
+  this->output = output;
+}
+
+std::string Engine::to_string(shared_ptr<ASTNode> const &value) {
+  CapturedOutput printed;
+  {
+    OutputScope output_scope(printed);
+    interpreter->eval_result(value);
+  }
+
+  if (!printed.out.empty() && printed.out.back() == '\n')
+    printed.out.pop_back();
+
+  return printed.out;
+}
+
+shared_ptr<ASTNode> Engine::parse_file(std::string const &file) const {
+  EngineOutput output_scope(output);
+  Driver driver;
+  driver.trace_parsing = settings.trace_parsing;
+  driver.trace_scanning = settings.trace_scanning;
+
+  if (driver.parse(file) != 0) {
+    if (!driver.error.empty())
+      throw FileError(driver.error);
+    throw ParseError();
+  }
+
+  return driver.ast;
+}
+
+shared_ptr<ASTNode> Engine::parse(std::string_view source) const {
+  EngineOutput output_scope(output);
+  Driver driver;
+  driver.trace_parsing = settings.trace_parsing;
+  driver.trace_scanning = settings.trace_scanning;
+
+  if (driver.parse_source(std::string(source)) != 0)
+    throw ParseError();
+
+  return driver.ast;
+}
+
+void Engine::analyze(shared_ptr<ASTNode> &ast) {
+  EngineOutput output_scope(output);
+  semantic_analyzer.analyze(ast);
+}
+
+shared_ptr<ASTNode> Engine::evaluate(shared_ptr<ASTNode> const &ast) {
+  EngineOutput output_scope(output);
+  return interpreter->evaluate(ast);
+}
+
+void Engine::run(shared_ptr<ASTNode> const &ast) {
+  EngineOutput output_scope(output);
+  interpreter->interpret(ast);
+}
+
+void Engine::clear_stack(shared_ptr<ASTNode> &ast) {
+  semantic_analyzer.clear_stack(ast);
+}
+
+void Engine::set_options(Options const &options) {
+  settings = options;
+  apply_options();
+}
+
+void Engine::set_type_inference(bool enabled) {
+  settings.infer_types = enabled;
+  semantic_analyzer.set_type_inference(enabled);
+}
+
+void Engine::report_types(std::ostream &out) const {
+  semantic_analyzer.report_types(out);
+}
+
+void Engine::report_optimizations(std::ostream &out) const {
+  semantic_analyzer.report_optimizations(out);
+}
+
+size_t Engine::peak_memory() const { return interpreter->peak_memory(); }
+
+shared_ptr<ASTNode> int_value(long long value) {
+  return make_shared<ASTNode>(
+      LEAF, make_shared<Token>(INT, std::to_string(value), Span({0, 0})));
+}
+
+shared_ptr<ASTNode> real_value(double value) {
+  return make_shared<ASTNode>(
+      LEAF, make_shared<Token>(REAL, std::to_string(value), Span({0, 0})));
+}
+
+shared_ptr<ASTNode> bool_value(bool value) {
+  return make_shared<ASTNode>(
+      LEAF, make_shared<Token>(BOOL, value ? "true" : "false", Span({0, 0})));
+}
+
+shared_ptr<ASTNode> null_value() {
+  return make_shared<ASTNode>(LEAF,
+                              make_shared<Token>(NUL, "null", Span({0, 0})));
+}
+
+shared_ptr<ASTNode> list_value(vector<shared_ptr<ASTNode>> const &items) {
+  return make_shared<ListNode>(items);
+}
+
+} // namespace flang
@@ -0,0 +1,130 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "../interpreter/interpeter.h"
+#include "../semantic/semantic_analyzer.h"
+#include "../utils/output.h"
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace flang {
+
+using interp::Interpreter;
+
+// the parser has reported what it failed on to cerr
+class ParseError : public std::runtime_error {
+public:
+  ParseError() : std::runtime_error("Parsing failed") {}
+};
+
+// a file to parse cannot be opened, what() tells which and why
+class FileError : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+// flang for a program embedding it. the functions and bindings of the code
+// run on an engine are visible to the code run after. an engine is used by
+// one thread at a time, fork makes one for another. errors are thrown:
+// ParseError, FileError, and RuntimeError and its subclasses from the analysis
+// and the run. memory limits and peaks count only with obj/memory_hooks.o
+// linked into the program, see MemoryAccount
+class Engine {
+public:
+  struct Options {
+    bool trace_parsing = false;
+    bool trace_scanning = false;
+
+    // annotate the code with inferred types. sound only while the code
+    // analyzed is a whole program, code run later may rebind its names
+    bool infer_types = false;
+
+    bool memoize_pure = false;           // cache every pure function
+    unsigned threads = 1;                // of pmap, pfilter and preduce
+    size_t memory_limit = 0;             // bytes, 0 means none
+    unsigned jit_threshold = 0;          // 0 without the jit
+    std::chrono::milliseconds time_limit{0}; // of every run, 0 means none
+    size_t depth_limit = 0;              // of nested calls, 0 means none
+  };
+
+  typedef Interpreter::NativeFunction NativeFunction;
+
+  Engine();
+  explicit Engine(Options const &options);
+
+  Engine(Engine const &) = delete;
+  Engine &operator=(Engine const &) = delete;
+
+  // an engine with the options, bindings and native functions of this one
+  unique_ptr<Engine> fork() const;
+
+  // runs a file for the functions and bindings it defines
+  void load_module(std::string const &file);
+
+  // runs source text, returns the value of its last expression, nullptr if
+  // it has none. what the failing code bound is dropped again
+  shared_ptr<ASTNode> eval(std::string_view source);
+
+  // calls a function bound by the code run so far, a builtin or a native
+  // function with evaluated arguments
+  shared_ptr<ASTNode> call(std::string const &function,
+                           vector<shared_ptr<ASTNode>> args = {});
+
+  // binds name to a function of the host program. like the library
+  // functions, a function of the program bound to the same name hides it.
+  // with threads above 1 pmap and friends may call it on their workers
+  void define(std::string const &name, NativeFunction function);
+
+  // sends what the code run on this engine prints on the calling thread to
+  // output instead of the standard streams, nullptr sends it there again.
+  // the first capture puts buffers in front of the standard streams, see
+  // CapturedOutput::install
+  void capture(CapturedOutput *output);
+
+  // a value printed the way the result of a program is
+  std::string to_string(shared_ptr<ASTNode> const &value);
+
+  // the steps of eval, for a client that runs them one by one
+  shared_ptr<ASTNode> parse_file(std::string const &file) const;
+  shared_ptr<ASTNode> parse(std::string_view source) const;
+  void analyze(shared_ptr<ASTNode> &ast);
+  shared_ptr<ASTNode> evaluate(shared_ptr<ASTNode> const &ast);
+  void run(shared_ptr<ASTNode> const &ast); // and print the value
+  void clear_stack(shared_ptr<ASTNode> &ast); // after ast failed
+
+  // for the code run from now on. the jit and the thread pool are made anew,
+  // an option left at its default turns its feature off again
+  void set_options(Options const &options);
+  void set_type_inference(bool enabled);
+  void report_types(std::ostream &out) const;
+  void report_optimizations(std::ostream &out) const;
+  size_t peak_memory() const;
+  Options const &options() const { return settings; }
+
+private:
+  Options settings;
+  SemanticAnalyzer semantic_analyzer;
+  unique_ptr<Interpreter> interpreter;
+  CapturedOutput *output = nullptr;
+
+  Engine(Options const &options, SemanticAnalyzer semantic_analyzer,
+         unique_ptr<Interpreter> interpreter);
+
+  void apply_options();
+};
+
+// values for native functions and call
+shared_ptr<ASTNode> int_value(long long value);
+shared_ptr<ASTNode> real_value(double value);
+shared_ptr<ASTNode> bool_value(bool value);
+shared_ptr<ASTNode> null_value();
+shared_ptr<ASTNode> list_value(vector<shared_ptr<ASTNode>> const &items);
+
+} // namespace flang
+
+#endif
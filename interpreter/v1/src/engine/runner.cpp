@@ -0,0 +1,255 @@
+#include "runner.h"
+#include "../utils/thread_pool.h"
+#include "../utils/utils.h"
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace flang {
+
+void run_program(shared_ptr<ASTNode> &ast, Engine &engine,
+                 Reports const &reports, bool graphs) {
+  std::cout << "Parsing successful" << '\n';
+  if (graphs)
+    generate_graph_svg(ast, "after_parsing.svg");
+  engine.analyze(ast);
+  std::cout << "Semantic analysis successful" << '\n';
+  if (reports.types)
+    engine.report_types(std::cout);
+  if (reports.optimizations)
+    engine.report_optimizations(std::cout);
+  if (graphs)
+    generate_graph_svg(ast);
+  std::cout << "Graphviz file generated" << '\n';
+  engine.run(ast);
+  std::cout << '\n';
+  std::cout << "Done" << '\n';
+}
+
+// a file of run_files
+struct Input {
+  std::string file;
+  shared_ptr<ASTNode> ast;
+  bool failed = false; // to parse or, isolated, to run
+  std::exception_ptr error; // thrown while parsing
+  CapturedOutput output;
+  size_t peak = 0;
+};
+
+int run_files(std::vector<std::string> const &files, unsigned jobs,
+              bool isolated, Reports const &reports, Engine &engine,
+              size_t &peak) {
+  std::vector<unique_ptr<Input>> inputs;
+  for (auto const &file : files) {
+    inputs.push_back(std::make_unique<Input>());
+    inputs.back()->file = file;
+  }
+
+  CapturedOutput::install();
+  ThreadPool pool(jobs);
+
+  pool.run(inputs.size(), [&](unsigned, size_t i) {
+    Input &input = *inputs[i];
+    OutputScope output_scope(input.output);
+
+    try {
+      input.ast = engine.parse_file(input.file);
+      if (!isolated)
+        return;
+
+      Engine isolated_engine(engine.options());
+
+      // every file writes the same svg files, only the last one's are kept
+      run_program(input.ast, isolated_engine, reports,
+                  i + 1 == inputs.size());
+      input.peak = isolated_engine.peak_memory();
+    } catch (ParseError &) {
+      input.failed = true;
+    } catch (FileError &e) {
+      std::cerr << e.what() << '\n';
+      input.failed = true;
+    } catch (std::exception &e) {
+      if (!isolated) {
+        input.error = std::current_exception();
+        return;
+      }
+      std::cout << e.what() << '\n';
+      input.failed = true;
+    } catch (...) {
+      input.error = std::current_exception();
+    }
+  });
+
+  int res = 0;
+  for (auto &input : inputs) {
+    input->output.print();
+    if (input->error)
+      std::rethrow_exception(input->error);
+
+    if (input->failed) {
+      res = 1;
+      continue;
+    }
+
+    if (isolated)
+      peak = std::max(peak, input->peak);
+    else
+      run_program(input->ast, engine, reports);
+  }
+
+  return res;
+}
+
+std::string json_string(std::string const &text) {
+  std::string res = "\"";
+
+  for (unsigned char c : text) {
+    switch (c) {
+    case '"':
+      res += "\\\"";
+      break;
+    case '\\':
+      res += "\\\\";
+      break;
+    case '\n':
+      res += "\\n";
+      break;
+    case '\t':
+      res += "\\t";
+      break;
+    default:
+      if (c < 0x20) {
+        char escaped[8];
+        snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        res += escaped;
+      } else
+        res += c;
+    }
+  }
+
+  return res + '"';
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point &start) {
+  auto now = std::chrono::steady_clock::now();
+  double res = std::chrono::duration<double>(now - start).count();
+  start = now;
+  return res;
+}
+
+void run_script(Script &script, Engine::Options const &options) {
+  OutputScope output_scope(script.output);
+  auto start = std::chrono::steady_clock::now();
+  double *phase = &script.parse;
+
+  try {
+    Engine engine(options);
+    shared_ptr<ASTNode> ast;
+
+    try {
+      ast = engine.parse_file(script.file);
+    } catch (ParseError &) {
+      script.parse = seconds_since(start);
+      script.status = "parse error";
+      return;
+    }
+    script.parse = seconds_since(start);
+    phase = &script.analyze;
+
+    engine.analyze(ast);
+    script.analyze = seconds_since(start);
+    phase = &script.run;
+
+    try {
+      engine.run(ast);
+    } catch (...) {
+      script.peak = engine.peak_memory();
+      throw;
+    }
+    script.run = seconds_since(start);
+    script.peak = engine.peak_memory();
+  } catch (TimeLimitExceededError &e) {
+    *phase += seconds_since(start);
+    script.status = "timeout";
+    script.error = e.what();
+  } catch (std::exception &e) {
+    *phase += seconds_since(start);
+    script.status = "error";
+    script.error = e.what();
+  }
+}
+
+int run_batch(std::string const &manifest, unsigned jobs,
+              Engine::Options const &options) {
+  std::ifstream in(manifest);
+  if (!in) {
+    std::cerr << "cannot open " << manifest << ": " << strerror(errno) << '\n';
+    return 1;
+  }
+
+  std::filesystem::path base = std::filesystem::path(manifest).parent_path();
+  std::vector<unique_ptr<Script>> scripts;
+  std::string line;
+
+  while (std::getline(in, line)) {
+    size_t begin = line.find_first_not_of(" \t\r");
+    if (begin == std::string::npos || line[begin] == '#')
+      continue;
+
+    size_t end = line.find_last_not_of(" \t\r");
+    std::filesystem::path path = line.substr(begin, end - begin + 1);
+    if (path.is_relative())
+      path = base / path;
+
+    scripts.push_back(std::make_unique<Script>());
+    scripts.back()->file = path.string();
+  }
+
+  CapturedOutput::install();
+  ThreadPool pool(jobs);
+
+  auto start = std::chrono::steady_clock::now();
+  pool.run(scripts.size(), [&](unsigned, size_t i) {
+    run_script(*scripts[i], options);
+  });
+  double seconds = seconds_since(start);
+
+  size_t ok = 0, timeouts = 0;
+  std::ostringstream report;
+  report << "{\n  \"scripts\": [";
+
+  for (size_t i = 0; i < scripts.size(); i++) {
+    auto const &script = *scripts[i];
+    ok += script.status == "ok";
+    timeouts += script.status == "timeout";
+
+    report << (i == 0 ? "\n" : ",\n") << "    {\"file\": "
+           << json_string(script.file)
+           << ", \"status\": " << json_string(script.status)
+           << ", \"exit\": " << (script.status == "ok" ? 0 : 1)
+           << ", \"parse_seconds\": " << script.parse
+           << ", \"analyze_seconds\": " << script.analyze
+           << ", \"run_seconds\": " << script.run
+           << ", \"peak_memory\": " << script.peak
+           << ", \"stdout\": " << json_string(script.output.out)
+           << ", \"stderr\": " << json_string(script.output.err)
+           << ", \"error\": " << json_string(script.error) << "}";
+  }
+
+  report << (scripts.empty() ? "" : "\n  ") << "],\n"
+         << "  \"total\": " << scripts.size() << ",\n"
+         << "  \"ok\": " << ok << ",\n"
+         << "  \"failed\": " << scripts.size() - ok << ",\n"
+         << "  \"timeouts\": " << timeouts << ",\n"
+         << "  \"jobs\": " << pool.size() << ",\n"
+         << "  \"seconds\": " << seconds << "\n}\n";
+  std::cout << report.str() << std::flush;
+
+  return ok == scripts.size() ? 0 : 1;
+}
+
+} // namespace flang
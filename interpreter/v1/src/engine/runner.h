@@ -0,0 +1,57 @@
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include "engine.h"
+#include <string>
+#include <vector>
+
+namespace flang {
+
+// what is printed about a program after its analysis
+struct Reports {
+  bool types = false;         // --types
+  bool optimizations = false; // --opt-report
+};
+
+// analyzes and runs a parsed file, the way flang_repl does with a file given
+// to it. graphs writes the svg files of the ast
+void run_program(shared_ptr<ASTNode> &ast, Engine &engine,
+                 Reports const &reports, bool graphs = true);
+
+// parses all files at once on jobs threads, then analyzes and runs them here
+// in order on the engine, as separate arguments would be. with isolated
+// every file gets an engine of its own and is run on the pool as well, and
+// peak is raised to the largest peak memory of theirs. what a file prints is
+// kept until the files before it are done. returns 1 if a file failed
+int run_files(std::vector<std::string> const &files, unsigned jobs,
+              bool isolated, Reports const &reports, Engine &engine,
+              size_t &peak);
+
+// a script of a batch
+struct Script {
+  std::string file;
+  std::string status = "ok"; // or "parse error", "error" and "timeout"
+  std::string error;
+  CapturedOutput output;
+  double parse = 0, analyze = 0, run = 0; // seconds
+  size_t peak = 0;
+};
+
+// runs script.file on an engine of its own and fills in the rest of script.
+// what it prints is captured, errors are kept in status and error
+void run_script(Script &script, Engine::Options const &options);
+
+// runs every script listed in the manifest, one path per line relative to
+// it, on jobs threads. blank lines and lines starting with # are skipped.
+// each script gets an engine of its own, what it prints is captured, and a
+// json report of all of them is printed once they are done. returns 1 unless
+// every script ran
+int run_batch(std::string const &manifest, unsigned jobs,
+              Engine::Options const &options);
+
+// text as a json string, quotes included
+std::string json_string(std::string const &text);
+
+} // namespace flang
+
+#endif
@@ -1,21 +1,36 @@
 #ifndef INTERPRETER_H
 #define INTERPRETER_H
 
+#include "../jit/jit.h"
 #include "../parser/ast.h"
+#include "../utils/memo.h"
+#include "../utils/memory.h"
 #include "../utils/pf_funcs.h"
+#include "../utils/region.h"
+#include "../utils/thread_pool.h"
 #include "../utils/utils.h"
 #include <algorithm>
+#include <chrono>
+#include <functional>
 #include <iostream>
 #include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
 
 using namespace flang;
 
 namespace interp {
 
+class Scheduler;
+class Future;
+struct Generation;
+
 struct Scope {
-  map<string, shared_ptr<ASTNode>> variables;
+  // frames are never captured, their bindings live in the region
+  map<string, shared_ptr<ASTNode>, less<string>,
+      RegionAllocator<pair<const string, shared_ptr<ASTNode>>>>
+      variables;
   shared_ptr<ASTNode> return_value;
   ASTNodeType scope_type;
   bool break_flag;
@@ -27,19 +42,86 @@ struct Scope {
   shared_ptr<ASTNode> &operator[](string const &key);
 };
 
+// a counted loop being run. value is the leaf last bound to its counter,
+// while the counter still holds it count is its value
+struct Counter {
+  CountedLoop const *loop;
+  shared_ptr<ASTNode> value;
+  long long count = 0;
+  shared_ptr<ASTNode> bound; // the leaf last read for the bound
+  long long limit = 0;
+};
+
 class Interpreter {
 public:
   Interpreter();
   ~Interpreter();
   shared_ptr<ASTNode> interpret(shared_ptr<ASTNode> const &node);
 
+  // runs a program like interpret, but returns the value of its last
+  // expression instead of printing it
+  shared_ptr<ASTNode> evaluate(shared_ptr<ASTNode> const &program);
+
+  // calls the function bound to name, a builtin or a library function with
+  // evaluated arguments
+  shared_ptr<ASTNode> call(string const &name,
+                           vector<shared_ptr<ASTNode>> values);
+
+  // prints a value the way the result of a program is printed
+  void eval_result(shared_ptr<ASTNode> const &node, bool is_recursive = false);
+
+  // an interpreter for another thread, with the bindings visible here in its
+  // global scope. it assigns only its own copies of them. the memory and
+  // time limits and the native functions carry over, the jit and the thread
+  // pool do not. with shared_memory what it allocates counts towards the
+  // memory limit and the peak of this one
+  unique_ptr<Interpreter> fork(bool shared_memory = false) const;
+
+  void set_memory_limit(size_t limit);
+  size_t peak_memory() const;
+
+  // stop a program running longer than this, counted from its start. 0 means
+  // no limit
+  void set_time_limit(std::chrono::milliseconds limit);
+
+  // stop a call nested deeper than this, counting the scopes of the calls
+  // and loops around it. 0 means no limit but the size of the stack
+  void set_depth_limit(size_t limit);
+
+  // compile functions to native code after threshold calls. 0 turns the jit
+  // off
+  void set_jit_threshold(unsigned threshold);
+
+  // cache the results of every pure function, not only of those passed to
+  // memo
+  void set_memoization(bool enabled);
+
+  // run pmap, pfilter and preduce on this many threads, and the tasks of
+  // spawn on as many. 1 runs them on the calling thread
+  void set_threads(unsigned threads);
+
+  // a function of the program embedding the interpreter, called with the
+  // evaluated arguments
+  typedef std::function<shared_ptr<ASTNode>(vector<shared_ptr<ASTNode>> &)>
+      NativeFunction;
+
+  // binds name to a native function. like the library functions, a function
+  // of the program bound to the same name hides it
+  void define_native(string const &name, NativeFunction function);
+
 private:
+  friend class Scheduler;
+
   const vector<string> PF_FUNCS = {
       "plus",    "minus",  "times",   "divide",    "equal",  "nonequal",
       "less",    "lesseq", "greater", "greatereq", "and",    "or",
       "not",     "xor",    "eval",    "isint",     "isreal", "isbool",
       "isnull",  "isatom", "islist",  "head",      "tail",   "cons",
-      "isempty", "foldl",  "println", "require"};
+      "isempty", "println", "require", "memo",    "range",
+      "vec",          "vecrange",   "veclist",   "vecget",    "vecplus",
+      "vecminus",     "vectimes",   "vecdivide", "vecless",   "veclesseq",
+      "vecgreater",   "vecgreatereq", "vecequal", "vecsum",   "vecdot",
+      "vecmin",       "vecmax",     "vecscan"};
 
   const map<string, shared_ptr<ASTNode> (*)(vector<shared_ptr<ASTNode>> &)>
       PF_FUNC_MAP = {{"plus", pf_plus},
@@ -67,11 +149,122 @@ private:
                      {"head", pf_head},
                      {"tail", pf_tail},
                      {"cons", pf_cons},
-                     {"isempty", pf_isempty}};
+                     {"isempty", pf_isempty},
+                     {"range", pf_range},
+                     {"memo", pf_memo},
+                     {"vec", pf_vec},
+                     {"vecrange", pf_vecrange},
+                     {"veclist", pf_veclist},
+                     {"vecget", pf_vecget},
+                     {"vecplus", pf_vecplus},
+                     {"vecminus", pf_vecminus},
+                     {"vectimes", pf_vectimes},
+                     {"vecdivide", pf_vecdivide},
+                     {"vecless", pf_vecless},
+                     {"veclesseq", pf_veclesseq},
+                     {"vecgreater", pf_vecgreater},
+                     {"vecgreatereq", pf_vecgreatereq},
+                     {"vecequal", pf_vecequal},
+                     {"vecsum", pf_vecsum},
+                     {"vecdot", pf_vecdot},
+                     {"vecmin", pf_vecmin},
+                     {"vecmax", pf_vecmax},
+                     {"vecscan", pf_vecscan}};
+
+  // library functions, a function bound to the same name hides them
+  const map<string, BuiltinFunction> LIB_FUNC_MAP = {
+      {"reverse", pf_reverse}, {"length", pf_length}, {"append", pf_append},
+      {"dict", pf_dict},       {"get", pf_get},       {"put", pf_put},
+      {"putinplace", pf_putinplace}};
+
+  // builtins taking lists, a stream passed to them is made a list first. the
+  // index of that argument, -1 for all of them
+  const map<string, int> LIST_ARGUMENTS = {{"length", 0}, {"reverse", 0},
+                                           {"append", -1}, {"vec", 0},
+                                           {"cons", 1}};
+
+  typedef shared_ptr<ASTNode> (Interpreter::*HigherOrderFunction)(
+      Span span, vector<shared_ptr<ASTNode>> &args);
+
+  const map<string, HigherOrderFunction> HIGHER_ORDER_MAP = {
+      {"foldl", &Interpreter::native_foldl},
+      {"foldr", &Interpreter::native_foldr},
+      {"map", &Interpreter::native_map},
+      {"filter", &Interpreter::native_filter},
+      {"pmap", &Interpreter::native_pmap},
+      {"pfilter", &Interpreter::native_pfilter},
+      {"preduce", &Interpreter::native_preduce},
+      {"spawn", &Interpreter::native_spawn},
+      {"chan", &Interpreter::native_chan},
+      {"send", &Interpreter::native_send},
+      {"recv", &Interpreter::native_recv},
+      {"future", &Interpreter::native_future},
+      {"force", &Interpreter::native_force},
+      {"streamcons", &Interpreter::native_streamcons},
+      {"iterate", &Interpreter::native_iterate},
+      {"take", &Interpreter::native_take},
+      {"drop", &Interpreter::native_drop},
+      {"streamlist", &Interpreter::native_streamlist},
+      {"_streamrest", &Interpreter::native_streamrest},
+      {"_pipeline", &Interpreter::native_pipeline}};
+
+  const map<string, BuiltinFunction> PF_INT_MAP = {
+      {"plus", pf_plus_int},       {"minus", pf_minus_int},
+      {"times", pf_times_int},     {"less", pf_less_int},
+      {"lesseq", pf_lesseq_int},   {"greater", pf_greater_int},
+      {"greatereq", pf_greatereq_int}};
+
+  const map<string, BuiltinFunction> PF_NUMBER_MAP = {
+      {"plus", pf_plus_number},           {"minus", pf_minus_number},
+      {"times", pf_times_number},         {"divide", pf_divide_number},
+      {"less", pf_less_number},           {"lesseq", pf_lesseq_number},
+      {"greater", pf_greater_number},     {"greatereq", pf_greatereq_number}};
 
   vector<Scope> stack;
 
+  // bumped whenever a name with cached call sites is bound or unbound
+  unordered_map<string, unsigned> binding_versions;
+
+  // accounts every allocation made while a program runs
+  MemoryTracker memory;
+
+  // frames and lists that do not escape their call
+  Region region;
+
+  unique_ptr<jit::Jit> jit; // null unless --jit
+
+  vector<Counter> counters; // of the counted loops running
+
+  bool memoize_pure = false;
+  MemoCache memo; // results of pure functions
+
+  unique_ptr<ThreadPool> pool; // null unless more than one thread
+  unsigned thread_count = 1;
+
+  // runs the tasks spawned here, made by the first spawn. it goes before
+  // the generations of its workers
+  vector<Generation> generations;
+  unique_ptr<Scheduler> scheduler;
+  unsigned next_worker = 0;
+
+  map<string, NativeFunction> natives;
+
+  size_t depth_limit = 0;
+
+  std::chrono::milliseconds time_limit{0};
+  std::chrono::steady_clock::time_point deadline;
+  unsigned time_checks = 0;
+
+  // reads the clock once every 1024 checks
+  void check_time(Span span) {
+    if (time_limit.count() != 0 && ++time_checks % 1024 == 0)
+      check_deadline(span);
+  }
+  void check_deadline(Span span) const;
+
   void interpret_program(shared_ptr<ASTNode> const &node);
+  shared_ptr<ASTNode>
+  run_top_level(std::function<shared_ptr<ASTNode>()> const &run);
 
   shared_ptr<ASTNode> interpret_setq(shared_ptr<SetqNode> const &node);
   shared_ptr<ASTNode> interpret_break(shared_ptr<ASTNode> const &node);
@@ -82,10 +275,95 @@ private:
   shared_ptr<ASTNode> interpret_return(shared_ptr<ReturnNode> const &node);
   shared_ptr<ASTNode> interpret_cond(shared_ptr<CondNode> const &node);
   shared_ptr<ASTNode> interpret_prog(shared_ptr<ProgNode> const &node);
+  shared_ptr<ASTNode> interpret_parallel(shared_ptr<ParallelNode> const &node);
   shared_ptr<ASTNode> interpret_leaf(shared_ptr<ASTNode> const &node);
   shared_ptr<ASTNode> interpret_funcdef(shared_ptr<FuncDefNode> const &node);
 
   shared_ptr<ASTNode> interpret_trampoline(shared_ptr<ASTNode> node);
+  // the paths of a call that are not taken once its site is cached. kept out
+  // of interpret_funccall, whose frame is on the stack for every nested call
+  [[gnu::noinline]] shared_ptr<ASTNode>
+  interpret_computed_call(shared_ptr<FuncCallNode> const &node);
+  [[gnu::noinline]] shared_ptr<ASTNode>
+  resolve_call(shared_ptr<FuncCallNode> const &node);
+  [[gnu::noinline]] shared_ptr<ASTNode>
+  quicken(shared_ptr<FuncCallNode> const &node,
+          vector<shared_ptr<ASTNode>> &v_args);
+  shared_ptr<ASTNode> run_closure(shared_ptr<ASTNode> funcdef,
+                                  string const &name);
+  [[gnu::noinline]] shared_ptr<ASTNode>
+  run_function(shared_ptr<ASTNode> const &funcdef, string const &name);
+  shared_ptr<ASTNode> run_body(shared_ptr<ASTNode> const &funcdef);
+  [[gnu::noinline]] void bind_locals(shared_ptr<ASTNode> const &body);
+  shared_ptr<ASTNode> interpret_native(shared_ptr<FuncDefNode> const &funcdef,
+                                       string const &name);
+
+  shared_ptr<ASTNode> call_library(string const &name, Span span,
+                                   vector<shared_ptr<ASTNode>> &values);
+  shared_ptr<ASTNode> apply(shared_ptr<ASTNode> const &function,
+                            vector<shared_ptr<ASTNode>> &values);
+  shared_ptr<ASTNode> native_foldl(Span span,
+                                   vector<shared_ptr<ASTNode>> &args);
+  shared_ptr<ASTNode> native_foldr(Span span,
+                                   vector<shared_ptr<ASTNode>> &args);
+  shared_ptr<ASTNode> native_map(Span span, vector<shared_ptr<ASTNode>> &args);
+  shared_ptr<ASTNode> native_filter(Span span,
+                                    vector<shared_ptr<ASTNode>> &args);
+
+  void parallel(shared_ptr<ASTNode> const &function, size_t count,
+                std::function<void(Interpreter &, shared_ptr<ASTNode> const &,
+                                   size_t)> const &task);
+  shared_ptr<ASTNode> native_pmap(Span span,
+                                  vector<shared_ptr<ASTNode>> &args);
+  shared_ptr<ASTNode> native_pfilter(Span span,
+                                     vector<shared_ptr<ASTNode>> &args);
+  shared_ptr<ASTNode> native_preduce(Span span,
+                                     vector<shared_ptr<ASTNode>> &args);
+  shared_ptr<ASTNode> native_spawn(Span span,
+                                   vector<shared_ptr<ASTNode>> &args);
+  shared_ptr<ASTNode> native_chan(Span span, vector<shared_ptr<ASTNode>> &args);
+  shared_ptr<ASTNode> native_send(Span span, vector<shared_ptr<ASTNode>> &args);
+  shared_ptr<ASTNode> native_recv(Span span, vector<shared_ptr<ASTNode>> &args);
+  shared_ptr<ASTNode> native_future(Span span,
+                                    vector<shared_ptr<ASTNode>> &args);
+  shared_ptr<ASTNode> native_force(Span span,
+                                   vector<shared_ptr<ASTNode>> &args);
+  void spawn_task(Span span, vector<shared_ptr<ASTNode>> &args,
+                  shared_ptr<Future> const &future);
+  shared_ptr<ASTNode> native_streamcons(Span span,
+                                        vector<shared_ptr<ASTNode>> &args);
+  shared_ptr<ASTNode> native_iterate(Span span,
+                                     vector<shared_ptr<ASTNode>> &args);
+  shared_ptr<ASTNode> native_take(Span span, vector<shared_ptr<ASTNode>> &args);
+  shared_ptr<ASTNode> native_drop(Span span, vector<shared_ptr<ASTNode>> &args);
+  shared_ptr<ASTNode> native_streamlist(Span span,
+                                        vector<shared_ptr<ASTNode>> &args);
+  shared_ptr<ASTNode> native_streamrest(Span span,
+                                        vector<shared_ptr<ASTNode>> &args);
+  shared_ptr<ASTNode> native_pipeline(Span span,
+                                      vector<shared_ptr<ASTNode>> &args);
+  shared_ptr<ASTNode> stream_rest(shared_ptr<StreamNode> const &cell);
+  shared_ptr<ASTNode> stream_map(shared_ptr<ASTNode> const &function,
+                                 shared_ptr<ASTNode> const &items);
+  shared_ptr<ASTNode> stream_filter(shared_ptr<ASTNode> const &function,
+                                    shared_ptr<ASTNode> items);
+  shared_ptr<ASTNode> stream_take(long long count,
+                                  shared_ptr<ASTNode> const &items);
+  shared_ptr<ASTNode> materialize(shared_ptr<ASTNode> const &items);
+  shared_ptr<ASTNode> stream_arguments(string const &name,
+                                       vector<shared_ptr<ASTNode>> &values);
+  bool equal_items(shared_ptr<ASTNode> items1, shared_ptr<ASTNode> items2);
+  unique_ptr<Interpreter> fork_options(bool shared_memory) const;
+
+  // a value to be used by another interpreter: the functions in it are
+  // cloned, plain values are shared as they are
+  static shared_ptr<ASTNode> isolate(shared_ptr<ASTNode> const &node);
+  bool counted_condition(Counter &counter, bool &holds);
+  bool step_counter(shared_ptr<SetqNode> const &node);
+
+  shared_ptr<ASTNode> find_variable(string const &name);
+  void invalidate(string const &name);
+  void pop_scope();
 
   shared_ptr<ASTNode>
   interpret_func_closure(shared_ptr<FuncDefNode> const &node);
@@ -94,8 +372,6 @@ private:
   void iterate_closure(shared_ptr<ASTNode> const &node,
                        vector<shared_ptr<ASTNode>> &setqs,
                        vector<string> const &defined);
-
-  void eval_result(shared_ptr<ASTNode> const &node, bool is_recursive = false);
 };
 
 } // namespace interp
@@ -1,4 +1,12 @@
 #include "interpeter.h"
+#include "../utils/stack.h"
+#include "scheduler.h"
+#include <atomic>
+#include <charconv>
+#include <climits>
+#include <exception>
+#include <mutex>
+#include <optional>
 
 using namespace interp;
 
@@ -16,6 +24,65 @@ Interpreter::Interpreter() {}
 
 Interpreter::~Interpreter() {}
 
+void Interpreter::set_memory_limit(size_t limit) { memory.set_limit(limit); }
+
+size_t Interpreter::peak_memory() const { return memory.peak(); }
+
+void Interpreter::set_time_limit(std::chrono::milliseconds limit) {
+  time_limit = limit;
+}
+
+void Interpreter::set_depth_limit(size_t limit) { depth_limit = limit; }
+
+void Interpreter::check_deadline(Span span) const {
+  if (std::chrono::steady_clock::now() > deadline)
+    throw TimeLimitExceededError(span, time_limit.count());
+}
+
+// calls with int arguments before a builtin site is quickened, and
+// deoptimizations after which the site stays generic
+const unsigned QUICKEN_AFTER = 8;
+const unsigned MAX_DEOPTS = 4;
+
+static bool is_int(shared_ptr<ASTNode> const &node) {
+  return node->node_type == ASTNodeType::LEAF &&
+         node->head->type == TokenType::INT;
+}
+
+// an INT leaf whose value fits an int, those are the ones the builtins keep
+// exact
+static bool int_value(shared_ptr<ASTNode> const &node, long long &value) {
+  if (!is_int(node))
+    return false;
+
+  auto const &text = node->head->value;
+  auto res = from_chars(text.data(), text.data() + text.size(), value);
+
+  return res.ec == errc() && res.ptr == text.data() + text.size() &&
+         value >= INT_MIN && value <= INT_MAX;
+}
+
+// bools are "true", "false", "1" or "0", for a condition proven to be a
+// bool the first character decides
+static bool is_true(shared_ptr<ASTNode> const &res) {
+  return res->head->value[0] == 't' || res->head->value[0] == '1';
+}
+
+void Interpreter::set_jit_threshold(unsigned threshold) {
+  jit = threshold != 0 ? make_unique<jit::Jit>(threshold) : nullptr;
+}
+
+void Interpreter::set_memoization(bool enabled) { memoize_pure = enabled; }
+
+void Interpreter::set_threads(unsigned threads) {
+  pool = threads > 1 ? make_unique<ThreadPool>(threads) : nullptr;
+  thread_count = max(threads, 1u);
+}
+
+void Interpreter::define_native(string const &name, NativeFunction function) {
+  natives[name] = std::move(function);
+}
+
 void Interpreter::eval_result(shared_ptr<ASTNode> const &node,
                               bool is_recursive) {
   if (node == nullptr)
@@ -86,265 +153,1614 @@ void Interpreter::eval_result(shared_ptr<ASTNode> const &node,
     break;
   }
 
-  case ASTNodeType::PROG: {
-    auto prog_node = static_pointer_cast<ProgNode>(node);
-    wcout << *prog_node.get();
-    break;
-  }
+  case ASTNodeType::PROG: {
+    auto prog_node = static_pointer_cast<ProgNode>(node);
+    wcout << *prog_node.get();
+    break;
+  }
+
+  case ASTNodeType::SETQ: {
+    auto setq_node = static_pointer_cast<SetqNode>(node);
+    wcout << *setq_node.get();
+    break;
+  }
+
+  case ASTNodeType::VECTOR: {
+    auto vector_node = static_pointer_cast<VectorNode>(node);
+    wcout << *vector_node.get();
+    break;
+  }
+
+  case ASTNodeType::DICT: {
+    wcout << "#{";
+    bool first = true;
+    static_pointer_cast<DictNode>(node)->for_each(
+        [&](shared_ptr<ASTNode> const &key, shared_ptr<ASTNode> const &value) {
+          if (!first)
+            wcout << ' ';
+          eval_result(key, true);
+          wcout << ' ';
+          eval_result(value, true);
+          first = false;
+        });
+    wcout << '}';
+    break;
+  }
+
+  default:
+    wcout << *node.get();
+    break;
+  }
+
+  if (!is_recursive) {
+    wcout << endl;
+  }
+}
+
+shared_ptr<ASTNode> Interpreter::interpret(shared_ptr<ASTNode> const &node) {
+  if (node == nullptr)
+    return make_shared<ASTNode>(
+        ASTNodeType::LEAF,
+        make_shared<Token>(TokenType::NUL, "null", Span({0, 0})));
+
+  switch (node->node_type) {
+  case ASTNodeType::PROGRAM:
+    interpret_program(node);
+    break;
+  case ASTNodeType::FUNCDEF:
+    return interpret_funcdef(static_pointer_cast<FuncDefNode>(node));
+  case ASTNodeType::FUNCCALL:
+    return interpret_funccall(static_pointer_cast<FuncCallNode>(node));
+  case ASTNodeType::LAMBDA:
+    return interpret_lambda(static_pointer_cast<LambdaNode>(node));
+  case ASTNodeType::LIST:
+    return interpret_list(static_pointer_cast<ListNode>(node));
+  case ASTNodeType::QUOTE_LIST:
+    return interpret_list(static_pointer_cast<ListNode>(node));
+  case ASTNodeType::RETURN:
+    return interpret_return(static_pointer_cast<ReturnNode>(node));
+  case ASTNodeType::BREAK:
+    return interpret_break(node);
+    break;
+  case ASTNodeType::COND:
+    return interpret_cond(static_pointer_cast<CondNode>(node));
+  case ASTNodeType::WHILE:
+    return interpret_while(static_pointer_cast<WhileNode>(node));
+    break;
+  case ASTNodeType::PROG:
+    return interpret_prog(static_pointer_cast<ProgNode>(node));
+  case ASTNodeType::SETQ:
+    return interpret_setq(static_pointer_cast<SetqNode>(node));
+    break;
+  case ASTNodeType::LEAF:
+    return interpret_leaf(node);
+  case ASTNodeType::PARALLEL:
+    return interpret_parallel(static_pointer_cast<ParallelNode>(node));
+  case ASTNodeType::VECTOR:
+  case ASTNodeType::CHANNEL:
+  case ASTNodeType::FUTURE:
+  case ASTNodeType::STREAM:
+  case ASTNodeType::DICT:
+    return node;
+  }
+
+  return make_shared<ASTNode>(
+      ASTNodeType::LEAF,
+      make_shared<Token>(TokenType::NUL, "null", Span({0, 0})));
+}
+
+void Interpreter::interpret_program(shared_ptr<ASTNode> const &node) {
+  MemoryScope memory_scope(memory);
+  RegionScope region_scope(region);
+
+  eval_result(evaluate(node));
+}
+
+shared_ptr<ASTNode> Interpreter::evaluate(shared_ptr<ASTNode> const &program) {
+  if (program->children.empty())
+    return nullptr;
+
+  return run_top_level([&] {
+    for (int i = 0; i < program->children.size() - 1; i++) {
+
+      interpret(program->children[i]);
+    }
+
+    return interpret(program->children.back());
+  });
+}
+
+shared_ptr<ASTNode> Interpreter::call(string const &name,
+                                      vector<shared_ptr<ASTNode>> values) {
+  auto function = make_shared<ASTNode>(
+      ASTNodeType::LEAF,
+      make_shared<Token>(TokenType::IDENTIFIER, name, Span({0, 0})));
+
+  return run_top_level([&] { return apply(function, values); });
+}
+
+// runs code from the global scope with the limits of a program
+shared_ptr<ASTNode> Interpreter::run_top_level(
+    std::function<shared_ptr<ASTNode>()> const &run) {
+  MemoryScope memory_scope(memory);
+  RegionScope region_scope(region);
+
+  if (time_limit.count() != 0)
+    deadline = std::chrono::steady_clock::now() + time_limit;
+
+  if (stack.empty()) {
+    stack.push_back(Scope(ASTNodeType::PROGRAM));
+  }
+
+  // an error leaves the frames of the calls it came from behind
+  size_t depth = stack.size();
+  size_t loops = counters.size();
+
+  try {
+    auto res = run();
+
+    // the program is done once its tasks are
+    if (scheduler != nullptr)
+      scheduler->wait();
+
+    return res;
+  } catch (...) {
+    if (scheduler != nullptr)
+      scheduler->cancel();
+
+    while (stack.size() > depth)
+      pop_scope();
+    counters.erase(counters.begin() + loops, counters.end());
+    throw;
+  }
+}
+
+shared_ptr<ASTNode>
+Interpreter::interpret_funcdef(shared_ptr<FuncDefNode> const &node) {
+  auto const &name = node->getName()->value;
+  stack.back()[name] = interpret_func_closure(node);
+  invalidate(name);
+
+  return stack.back()[name];
+}
+
+shared_ptr<ASTNode>
+Interpreter::interpret_trampoline(shared_ptr<ASTNode> node) {
+  while (node->node_type == ASTNodeType::LAMBDA) {
+    auto funccall = make_shared<FuncCallNode>(
+        make_shared<Token>(TokenType::NUL, "unknown", Span({0, 0})),
+        vector<shared_ptr<ASTNode>>{node});
+    node = interpret_funccall(funccall);
+  }
+
+  return node;
+}
+
+shared_ptr<ASTNode>
+Interpreter::interpret_funccall(shared_ptr<FuncCallNode> const &node) {
+  memory.check(node->head->span);
+  check_time(node->head->span);
+  if (Stack::exhausted())
+    throw StackOverflowError(node->head->span);
+  if (depth_limit != 0 && stack.size() > depth_limit)
+    throw DepthLimitExceededError(node->head->span, depth_limit);
+
+  if (node->children[0]->node_type != LEAF)
+    return interpret_computed_call(node);
+
+  auto const &children = node->children;
+  auto &cache = node->cache;
+
+  if (cache.kind == CallCache::EMPTY ||
+      (cache.kind == CallCache::CLOSURE &&
+       *cache.version != cache.resolved_version)) {
+    auto res = resolve_call(node);
+    if (res != nullptr)
+      return res;
+  }
+
+  // the rest of a call is inline, a deep recursion runs through this frame
+  // once per level
+  if (cache.kind == CallCache::BUILTIN) {
+    vector<shared_ptr<ASTNode>> v_args;
+    bool streams = false;
+    for (size_t i = 1; i < children.size(); i++) {
+      v_args.push_back(interpret(children[i]));
+      streams |= v_args.back()->node_type == ASTNodeType::STREAM;
+    }
+
+    if (streams) {
+      auto res = stream_arguments(children[0]->head->value, v_args);
+      if (res != nullptr)
+        return res;
+    }
+
+    if (cache.quickened != nullptr || cache.deopts < MAX_DEOPTS) {
+      auto res = quicken(node, v_args);
+      if (res != nullptr)
+        return res;
+    }
+
+    if (node->scoped) {
+      ScopedLists scoped_lists;
+      return interpret(cache.builtin(v_args));
+    }
+
+    return interpret(cache.builtin(v_args));
+  }
+
+  // evaluates the arguments in the new frame. both are copied, a call may
+  // replace the cached target
+  shared_ptr<ASTNode> funcdef = cache.target;
+  size_t arity = cache.arity;
+  auto const &params = funcdef->node_type == ASTNodeType::FUNCDEF
+                           ? funcdef->children[1]
+                           : funcdef->children[0];
+
+  stack.push_back(Scope(ASTNodeType::FUNCCALL));
+
+  for (size_t i = 0; i < arity; i++) {
+    auto const &param = params->children[i]->head->value;
+    stack.back()[param] = interpret(children[i + 1]);
+    invalidate(param);
+  }
+
+  return run_closure(funcdef, children[0]->head->value);
+}
+
+// calls a function whose head is an expression
+shared_ptr<ASTNode>
+Interpreter::interpret_computed_call(shared_ptr<FuncCallNode> const &node) {
+  auto head_node = interpret(node->children[0]);
+
+  stack.push_back(Scope(ASTNodeType::FUNCCALL));
+
+  switch (head_node->node_type) {
+  case ASTNodeType::FUNCDEF: {
+    auto const &name = head_node->children[0]->head;
+    interpret_funcdef(static_pointer_cast<FuncDefNode>(head_node));
+    vector<shared_ptr<ASTNode>> v_args = {
+        make_shared<ASTNode>(ASTNodeType::LEAF, name)};
+    for (auto const &arg : node->getArgs()) {
+      v_args.push_back(arg);
+    }
+    auto res = interpret_funccall(
+        make_shared<FuncCallNode>(v_args[0]->head, v_args));
+    pop_scope();
+    return res;
+  }
+
+  case ASTNodeType::LAMBDA: {
+    auto const &params = head_node->children[0];
+    auto const &body = head_node->children[1];
+    auto const &args = node->getArgs();
+
+    for (int i = 0; i < params->children.size(); i++) {
+      stack.back()[params->children[i]->head->value] = interpret(args[i]);
+      invalidate(params->children[i]->head->value);
+    }
+
+    auto res = interpret(body);
+
+    pop_scope();
+
+    return res;
+  }
+
+  case ASTNodeType::LEAF: {
+    auto const &name = head_node->head;
+    auto const &args = node->getArgs();
+
+    vector<shared_ptr<ASTNode>> v_args = {
+        make_shared<ASTNode>(ASTNodeType::LEAF, name)};
+
+    for (auto const &arg : args) {
+      v_args.push_back(arg);
+    }
+
+    auto res = interpret_funccall(
+        make_shared<FuncCallNode>(v_args[0]->head, v_args));
+
+    pop_scope();
+
+    return res;
+  }
+
+  default:
+    pop_scope();
+    throw runtime_error("not a function");
+  }
+}
+
+// fills the cache of a call site, or makes the call if it can not be cached
+// and returns its result. nullptr once the cache is filled
+shared_ptr<ASTNode>
+Interpreter::resolve_call(shared_ptr<FuncCallNode> const &node) {
+  auto const &name = node->getName()->value;
+  auto const &args = node->getArgs();
+  auto &cache = node->cache;
+
+  if (name == "_trampoline") {
+    return interpret_trampoline(interpret(args[0]));
+  }
+
+  if (find(PF_FUNCS.begin(), PF_FUNCS.end(), name) != PF_FUNCS.end()) {
+    // builtins can not be shadowed, the entry never goes stale
+    auto builtin = PF_FUNC_MAP.find(name);
+    if (builtin != PF_FUNC_MAP.end()) {
+      cache.kind = CallCache::BUILTIN;
+      cache.builtin = builtin->second;
+
+      auto unchecked = PF_NUMBER_MAP.find(name);
+      if (unchecked != PF_NUMBER_MAP.end() &&
+          all_of(args.begin(), args.end(), [](auto const &arg) {
+            return arg->proven(TYPE_NUMBER);
+          }))
+        cache.builtin = unchecked->second;
+      return nullptr;
+    }
+
+    vector<shared_ptr<ASTNode>> v_args;
+    for (auto const &arg : args) {
+      v_args.push_back(interpret(arg));
+    }
+    auto res = stream_arguments(name, v_args);
+    if (res != nullptr)
+      return res;
+
+    return interpret(PF_FUNC_MAP.at(name)(v_args));
+  }
+
+  shared_ptr<ASTNode> funcdef;
+
+  for (int i = stack.size() - 1; i >= 0; i--) {
+    if (stack[i].variables.find(name) != stack[i].variables.end()) {
+      funcdef = stack[i][name];
+      break;
+    }
+  }
+
+  if (funcdef == nullptr) {
+    vector<shared_ptr<ASTNode>> v_args;
+    for (auto const &arg : args) {
+      v_args.push_back(interpret(arg));
+    }
+
+    auto res = call_library(name, node->head->span, v_args);
+    if (res == nullptr)
+      throw runtime_error(name + " is not a function");
+
+    return res;
+  }
+
+  if (funcdef->node_type != ASTNodeType::FUNCDEF &&
+      funcdef->node_type != ASTNodeType::LAMBDA) {
+
+    if (funcdef->node_type == ASTNodeType::LEAF &&
+        funcdef->head->type == TokenType::IDENTIFIER) {
+      vector<shared_ptr<ASTNode>> v_args = {
+          make_shared<ASTNode>(ASTNodeType::LEAF, funcdef->head)};
+
+      for (auto const &arg : args) {
+        v_args.push_back(arg);
+      }
+
+      return interpret_funccall(
+          make_shared<FuncCallNode>(v_args[0]->head, v_args));
+    }
+
+    cout << "stack size: " << stack.size() << endl;
+    for (int i = stack.size() - 1; i >= 0; i--) {
+      cout << "scope " << i << ": ";
+      for (auto const &var : stack[i].variables) {
+        cout << var.first << ' ';
+      }
+      cout << endl;
+    }
+
+    throw runtime_error(name + " is not a function");
+  }
+
+  auto const &params = funcdef->node_type == ASTNodeType::FUNCDEF
+                           ? funcdef->children[1]
+                           : funcdef->children[0];
+
+  // valid until name is bound again somewhere on the stack
+  cache.kind = CallCache::CLOSURE;
+  cache.target = funcdef;
+  cache.arity = params->children.size();
+  cache.version = &binding_versions[name];
+  cache.resolved_version = *cache.version;
+
+  return nullptr;
+}
+
+// runs the int specialization of a builtin site and counts the calls
+// towards it. nullptr unless the specialization made the call
+shared_ptr<ASTNode>
+Interpreter::quicken(shared_ptr<FuncCallNode> const &node,
+                     vector<shared_ptr<ASTNode>> &v_args) {
+  auto &cache = node->cache;
+
+  if (cache.quickened != nullptr) {
+    auto res = cache.quickened(v_args);
+    if (res != nullptr)
+      return res;
+
+    // the site saw another type, back to the generic builtin
+    cache.quickened = nullptr;
+    cache.observed = 0;
+    cache.deopts++;
+  } else if (v_args.size() == 2 && is_int(v_args[0]) && is_int(v_args[1])) {
+    if (++cache.observed == QUICKEN_AFTER) {
+      auto quick = PF_INT_MAP.find(node->getName()->value);
+      if (quick != PF_INT_MAP.end())
+        cache.quickened = quick->second;
+      else
+        cache.deopts = MAX_DEOPTS; // nothing to specialize
+    }
+  } else {
+    cache.observed = 0;
+  }
+
+  return nullptr;
+}
+
+// runs a closure whose parameters are bound in the top scope, then pops it
+shared_ptr<ASTNode> Interpreter::run_closure(shared_ptr<ASTNode> funcdef,
+                                             string const &name) {
+  if (funcdef->node_type == ASTNodeType::FUNCDEF) {
+    auto const &function = static_cast<FuncDefNode const &>(*funcdef);
+    if (jit != nullptr ||
+        (function.effect == PURE && (memoize_pure || function.memoized)))
+      return run_function(funcdef, name);
+  }
+
+  return run_body(funcdef);
+}
+
+// run_closure of a function that is memoized or may run natively
+shared_ptr<ASTNode>
+Interpreter::run_function(shared_ptr<ASTNode> const &funcdef,
+                          string const &name) {
+  auto const &function = static_pointer_cast<FuncDefNode>(funcdef);
+  auto const &params = funcdef->children[1];
+
+  // a pure function called with the same values returns the same result
+  bool memoized =
+      function->effect == PURE && (memoize_pure || function->memoized);
+  vector<shared_ptr<ASTNode>> values;
+
+  if (memoized) {
+    for (auto const &param : params->children) {
+      values.push_back(stack.back()[param->head->value]);
+    }
+
+    auto res = memo.find(funcdef, values);
+
+    if (res != nullptr) {
+      pop_scope();
+      return res;
+    }
+  }
+
+  if (jit != nullptr) {
+    auto res = interpret_native(function, name);
+
+    if (res != nullptr) {
+      pop_scope();
+
+      if (memoized)
+        memo.insert(funcdef, values, res);
+      return res;
+    }
+  }
+
+  shared_ptr<ASTNode> res = run_body(funcdef);
+
+  if (memoized)
+    memo.insert(funcdef, values, res);
+
+  return res;
+}
+
+// runs the body of a closure, then pops the scope of the call
+shared_ptr<ASTNode>
+Interpreter::run_body(shared_ptr<ASTNode> const &funcdef) {
+  auto const &body = funcdef->node_type == ASTNodeType::FUNCDEF
+                         ? funcdef->children[2]
+                         : funcdef->children[1];
+
+  if (body->node_type == ASTNodeType::PROG)
+    bind_locals(body);
+
+  shared_ptr<ASTNode> res = interpret(body);
+
+  pop_scope();
+
+  return res;
+}
+
+// binds the names a prog body sets to null in the top scope
+void Interpreter::bind_locals(shared_ptr<ASTNode> const &body) {
+  for (auto &child : body->children) {
+    if (child->node_type == ASTNodeType::SETQ) {
+      auto const &local = child->children[0]->head->value;
+      invalidate(local);
+      stack.back()[local] = make_shared<ASTNode>(
+          ASTNodeType::LEAF,
+          make_shared<Token>(TokenType::NUL, "null", Span({0, 0})));
+    }
+  }
+}
+
+void Interpreter::invalidate(string const &name) {
+  if (binding_versions.empty())
+    return;
+
+  auto version = binding_versions.find(name);
+  if (version != binding_versions.end())
+    version->second++;
+}
+
+void Interpreter::pop_scope() {
+  if (!binding_versions.empty()) {
+    for (auto const &variable : stack.back().variables) {
+      invalidate(variable.first);
+    }
+  }
+
+  stack.pop_back();
+}
+
+// runs a function with its parameters bound in the top scope natively,
+// returns nullptr if the jit leaves the call to the interpreter
+shared_ptr<ASTNode>
+Interpreter::interpret_native(shared_ptr<FuncDefNode> const &funcdef,
+                              string const &name) {
+  vector<shared_ptr<ASTNode>> args;
+  for (auto const &param : funcdef->getParams()->children) {
+    args.push_back(stack.back()[param->head->value]);
+  }
+
+  auto const &own_name = funcdef->getName()->value;
+  bool self_bound = own_name == name || find_variable(own_name) == funcdef;
+
+  return jit->call(funcdef, args, self_bound);
+}
+
+// calls a library function with evaluated arguments, returns nullptr if
+// there is none of that name
+shared_ptr<ASTNode>
+Interpreter::call_library(string const &name, Span span,
+                          vector<shared_ptr<ASTNode>> &values) {
+  auto library = LIB_FUNC_MAP.find(name);
+  if (library != LIB_FUNC_MAP.end()) {
+    stream_arguments(name, values);
+    return interpret(library->second(values));
+  }
+
+  auto native = natives.find(name);
+  if (native != natives.end())
+    return interpret(native->second(values));
+
+  auto higher_order = HIGHER_ORDER_MAP.find(name);
+  if (higher_order != HIGHER_ORDER_MAP.end())
+    return (this->*higher_order->second)(span, values);
+
+  return nullptr;
+}
+
+// calls a function value with evaluated arguments, the way a call through a
+// name bound to it would
+shared_ptr<ASTNode> Interpreter::apply(shared_ptr<ASTNode> const &function,
+                                       vector<shared_ptr<ASTNode>> &values) {
+  if (function->node_type == ASTNodeType::FUNCDEF ||
+      function->node_type == ASTNodeType::LAMBDA) {
+    auto const &params = function->node_type == ASTNodeType::FUNCDEF
+                             ? function->children[1]
+                             : function->children[0];
+
+    if (params->children.size() != values.size())
+      throw WrongNumberOfArgumentsError(
+          function->head->span,
+          function->node_type == ASTNodeType::FUNCDEF
+              ? static_pointer_cast<FuncDefNode>(function)->getName()->value
+              : "lambda",
+          params->children.size(), values.size());
+
+    stack.push_back(Scope(ASTNodeType::FUNCCALL));
+
+    for (int i = 0; i < values.size(); i++) {
+      auto const &param = params->children[i]->head->value;
+      stack.back()[param] = values[i];
+      invalidate(param);
+    }
+
+    return run_closure(function, "");
+  }
+
+  if (function->node_type == ASTNodeType::LEAF &&
+      function->head->type == TokenType::IDENTIFIER) {
+    auto const &name = function->head->value;
+
+    auto builtin = PF_FUNC_MAP.find(name);
+    if (builtin != PF_FUNC_MAP.end()) {
+      auto res = stream_arguments(name, values);
+      if (res != nullptr)
+        return res;
+
+      return interpret(builtin->second(values));
+    }
+
+    auto bound = find_variable(name);
+    if (bound != nullptr && !(bound->node_type == ASTNodeType::LEAF &&
+                              bound->head->value == name))
+      return apply(bound, values);
+
+    auto res = call_library(name, function->head->span, values);
+    if (res != nullptr)
+      return res;
+  }
+
+  throw runtime_error(function->head->value + " is not a function");
+}
+
+static void check_arity(string const &name, Span span,
+                        vector<shared_ptr<ASTNode>> const &args,
+                        size_t expected) {
+  if (args.size() != expected)
+    throw WrongNumberOfArgumentsError(span, name, expected, args.size());
+}
+
+static vector<shared_ptr<ASTNode>> const &
+list_items(string const &name, shared_ptr<ASTNode> const &arg) {
+  if (arg->node_type != ASTNodeType::LIST &&
+      arg->node_type != ASTNodeType::QUOTE_LIST)
+    throw RuntimeError(arg->head->span,
+                       name + ": invalid argument type " + arg->head->value);
+
+  return arg->children;
+}
+
+// (foldl f init list), f is called with the value so far and an item
+shared_ptr<ASTNode>
+Interpreter::native_foldl(Span span, vector<shared_ptr<ASTNode>> &args) {
+  check_arity("foldl", span, args, 3);
+
+  auto value = args[1];
+  vector<shared_ptr<ASTNode>> values(2);
+
+  // the cells of a stream are let go of as they are folded, unless the
+  // program still holds the first one
+  auto rest = std::move(args[2]);
+  while (rest->node_type == ASTNodeType::STREAM) {
+    auto cell = static_pointer_cast<StreamNode>(rest);
+    values.assign({value, cell->first});
+    value = apply(args[0], values);
+    rest = stream_rest(cell);
+  }
+
+  for (auto const &item : list_items("foldl", rest)) {
+    values.assign({value, item});
+    value = apply(args[0], values);
+  }
+
+  return value;
+}
+
+// (foldr f init list), f is called with an item and the value so far, from
+// the last item on
+shared_ptr<ASTNode>
+Interpreter::native_foldr(Span span, vector<shared_ptr<ASTNode>> &args) {
+  check_arity("foldr", span, args, 3);
+  args[2] = materialize(args[2]);
+  auto const &items = list_items("foldr", args[2]);
+
+  auto value = args[1];
+  vector<shared_ptr<ASTNode>> values(2);
+
+  for (auto item = items.rbegin(); item != items.rend(); ++item) {
+    values.assign({*item, value});
+    value = apply(args[0], values);
+  }
+
+  return value;
+}
+
+shared_ptr<ASTNode> Interpreter::native_map(Span span,
+                                            vector<shared_ptr<ASTNode>> &args) {
+  check_arity("map", span, args, 2);
+  if (args[1]->node_type == ASTNodeType::STREAM)
+    return stream_map(args[0], args[1]);
+
+  auto const &items = list_items("map", args[1]);
+
+  vector<shared_ptr<ASTNode>> res, values(1);
+  res.reserve(items.size());
+
+  for (auto const &item : items) {
+    values.assign({item});
+    res.push_back(apply(args[0], values));
+  }
+
+  return make_list(res);
+}
+
+// keeps the items f returns true for, with the truth of cond
+shared_ptr<ASTNode>
+Interpreter::native_filter(Span span, vector<shared_ptr<ASTNode>> &args) {
+  check_arity("filter", span, args, 2);
+  if (args[1]->node_type == ASTNodeType::STREAM)
+    return stream_filter(args[0], args[1]);
+
+  auto const &items = list_items("filter", args[1]);
+
+  vector<shared_ptr<ASTNode>> res, values(1);
+  res.reserve(items.size());
+
+  for (auto const &item : items) {
+    values.assign({item});
+    auto keep = apply(args[0], values);
+
+    if (keep->node_type == ASTNodeType::LEAF &&
+        (keep->head->value == "true" || keep->head->value == "1"))
+      res.push_back(item);
+  }
+
+  return make_list(res);
+}
+
+// (_pipeline '(stages...) args... items) is a chain of map and filter calls,
+// under a foldl, a foldr or neither, that semantic/list_fusion.h fused.
+// stages and their arguments go from the outer call in, items is the list
+// of the innermost one. every item runs through all the stages before the
+// next one, from the last one on under a foldr
+shared_ptr<ASTNode>
+Interpreter::native_pipeline(Span span, vector<shared_ptr<ASTNode>> &args) {
+  auto const &stages = args[0]->children;
+  auto const &outer = stages[0]->head->value;
+  bool fold = outer == "foldl" || outer == "foldr";
+
+  // the functions of the map and filter stages from the inner one out
+  vector<shared_ptr<ASTNode>> functions;
+  vector<char> maps;
+  for (size_t i = args.size() - 2; i >= (fold ? 3 : 1); i--) {
+    functions.push_back(args[i]);
+    maps.push_back(stages[stages.size() - functions.size()]->head->value ==
+                   "map");
+  }
+
+  // a stream stays lazy, the calls are made one by one
+  auto &items = args.back();
+  if (items->node_type != ASTNodeType::LIST &&
+      items->node_type != ASTNodeType::QUOTE_LIST) {
+    auto res = items;
+    vector<shared_ptr<ASTNode>> values;
+
+    for (size_t i = 0; i < functions.size(); i++) {
+      values.assign({functions[i], res});
+      res = maps[i] ? native_map(span, values) : native_filter(span, values);
+    }
+
+    if (!fold)
+      return res;
+
+    values.assign({args[1], args[2], res});
+    return outer == "foldl" ? native_foldl(span, values)
+                            : native_foldr(span, values);
+  }
+
+  auto const &children = items->children;
+  bool from_last = outer == "foldr";
+  auto value = fold ? args[2] : nullptr;
+  vector<shared_ptr<ASTNode>> res, values(1);
+
+  for (size_t j = 0; j < children.size(); j++) {
+    auto item = children[from_last ? children.size() - 1 - j : j];
+    bool kept = true;
+
+    for (size_t i = 0; kept && i < functions.size(); i++) {
+      values.assign({item});
+      auto result = apply(functions[i], values);
+
+      if (maps[i])
+        item = result;
+      else
+        kept = result->node_type == ASTNodeType::LEAF &&
+               (result->head->value == "true" || result->head->value == "1");
+    }
+
+    if (!kept)
+      continue;
+
+    if (!fold) {
+      res.push_back(item);
+      continue;
+    }
+
+    if (from_last)
+      values.assign({item, value});
+    else
+      values.assign({value, item});
+    value = apply(args[1], values);
+  }
+
+  return fold ? value : make_list(res);
+}
+
+shared_ptr<ASTNode> Interpreter::isolate(shared_ptr<ASTNode> const &node) {
+  switch (node->node_type) {
+  case ASTNodeType::LEAF:
+  case ASTNodeType::VECTOR:
+  case ASTNodeType::CHANNEL:
+  case ASTNodeType::FUTURE:
+    return node;
+
+  case ASTNodeType::STREAM: {
+    // a forced rest is copied when it is reached, the rest of the chain
+    // may never be
+    auto cell = static_pointer_cast<StreamNode>(node);
+    if (cell->kind == StreamNode::RANGE)
+      return node;
+
+    std::lock_guard<std::mutex> guard(cell->lock);
+
+    if (cell->rest != nullptr)
+      return make_shared<StreamNode>(node->head->span, StreamNode::COPY,
+                                     isolate(cell->first), nullptr, node);
+
+    return make_shared<StreamNode>(
+        node->head->span, cell->kind, isolate(cell->first),
+        cell->function != nullptr ? isolate(cell->function) : nullptr,
+        cell->source != nullptr ? isolate(cell->source) : nullptr,
+        cell->count);
+  }
+
+  case ASTNodeType::DICT: {
+    // put_in_place on either one must not show in the other
+    auto dict = static_pointer_cast<DictNode>(node);
+    auto res = static_pointer_cast<DictNode>(dict->copy());
+
+    dict->for_each(
+        [&](shared_ptr<ASTNode> const &key, shared_ptr<ASTNode> const &value) {
+          auto copy = isolate(value);
+          if (copy != value)
+            res->put_in_place(key, copy);
+        });
+    return res;
+  }
+
+  case ASTNodeType::LIST:
+  case ASTNodeType::QUOTE_LIST: {
+    auto res = node;
+
+    for (size_t i = 0; i < node->children.size(); i++) {
+      auto child = isolate(node->children[i]);
+      if (child == node->children[i])
+        continue;
+
+      if (res == node) {
+        res = node->copy();
+        res->node_type = node->node_type;
+      }
+      res->children[i] = child;
+    }
+
+    return res;
+  }
+
+  default:
+    return clone(node);
+  }
+}
+
+// an interpreter with the limits and native functions of this one, without
+// bindings. with shared_memory it is charged to the memory account of this
+// one
+unique_ptr<Interpreter> Interpreter::fork_options(bool shared_memory) const {
+  auto res = make_unique<Interpreter>();
+  if (shared_memory)
+    res->memory.share(memory);
+  else
+    res->memory.set_limit(memory.get_limit());
+  res->memoize_pure = memoize_pure;
+  res->time_limit = time_limit;
+  res->depth_limit = depth_limit;
+  res->deadline = deadline;
+  res->natives = natives;
+
+  return res;
+}
+
+unique_ptr<Interpreter> Interpreter::fork(bool shared_memory) const {
+  auto res = fork_options(shared_memory);
+  MemoryScope memory_scope(res->memory);
+  RegionScope region_scope(res->region);
+
+  res->stack.push_back(Scope(ASTNodeType::PROGRAM));
+
+  for (auto const &scope : stack) {
+    for (auto const &variable : scope.variables) {
+      res->stack.back()[variable.first] = isolate(variable.second);
+    }
+  }
+
+  return res;
+}
+
+// runs task(interpreter, function, i) for every i below count. on the pool
+// every worker has an interpreter and a clone of function of its own, made
+// when it starts its first task, so the tasks only share the values they
+// read. the interpreters are charged to the memory account of this one, and
+// what they print goes to the capture of this thread, if it has one. without
+// a pool the tasks run here in order. an error stops the workers and is
+// thrown once all have returned
+void Interpreter::parallel(
+    shared_ptr<ASTNode> const &function, size_t count,
+    std::function<void(Interpreter &, shared_ptr<ASTNode> const &,
+                       size_t)> const &task) {
+  if (pool == nullptr) {
+    for (size_t i = 0; i < count; i++) {
+      task(*this, function, i);
+    }
+    return;
+  }
+
+  struct Worker {
+    unique_ptr<Interpreter> interpreter;
+    shared_ptr<ASTNode> function;
+  };
+
+  vector<Worker> workers(pool->size());
+  CapturedOutput *output = CapturedOutput::current();
+  std::mutex lock;
+  std::exception_ptr error;
+  std::atomic<bool> failed(false);
+
+  pool->run(count, [&](unsigned index, size_t i) {
+    if (failed.load(std::memory_order_relaxed))
+      return;
+
+    try {
+      auto &worker = workers[index];
+      if (worker.interpreter == nullptr) {
+        worker.interpreter = fork(true);
+        worker.function = isolate(function);
+      }
+
+      MemoryScope memory_scope(worker.interpreter->memory);
+      RegionScope region_scope(worker.interpreter->region);
+      std::optional<OutputScope> output_scope;
+      if (output != nullptr)
+        output_scope.emplace(*output);
+
+      task(*worker.interpreter, worker.function, i);
+    } catch (...) {
+      std::lock_guard<std::mutex> guard(lock);
+      if (error == nullptr)
+        error = std::current_exception();
+      failed = true;
+    }
+  });
+
+  if (error != nullptr)
+    std::rethrow_exception(error);
+}
+
+// the items of pmap, pfilter and preduce are split into at most this many
+// runs, one task each. the runs depend only on the number of items, so
+// preduce combines in the same order on any number of threads
+const size_t PARALLEL_RUNS = 256;
+
+static size_t run_start(size_t items, size_t runs, size_t run) {
+  return items * run / runs;
+}
+
+shared_ptr<ASTNode>
+Interpreter::native_pmap(Span span, vector<shared_ptr<ASTNode>> &args) {
+  check_arity("pmap", span, args, 2);
+  args[1] = materialize(args[1]);
+  auto const &items = list_items("pmap", args[1]);
+  size_t runs = min(items.size(), PARALLEL_RUNS);
+
+  vector<shared_ptr<ASTNode>> res(items.size());
+
+  parallel(args[0], runs,
+           [&](Interpreter &interpreter, shared_ptr<ASTNode> const &function,
+               size_t run) {
+             vector<shared_ptr<ASTNode>> values(1);
+             size_t end = run_start(items.size(), runs, run + 1);
+
+             for (size_t i = run_start(items.size(), runs, run); i < end;
+                  i++) {
+               values.assign({isolate(items[i])});
+               res[i] = interpreter.apply(function, values);
+             }
+           });
+
+  // functions made by the workers still point into their interpreters
+  if (pool != nullptr) {
+    for (auto &value : res) {
+      value = isolate(value);
+    }
+  }
+
+  return make_list(res);
+}
 
-  case ASTNodeType::SETQ: {
-    auto setq_node = static_pointer_cast<SetqNode>(node);
-    wcout << *setq_node.get();
-    break;
-  }
+shared_ptr<ASTNode>
+Interpreter::native_pfilter(Span span, vector<shared_ptr<ASTNode>> &args) {
+  check_arity("pfilter", span, args, 2);
+  args[1] = materialize(args[1]);
+  auto const &items = list_items("pfilter", args[1]);
+  size_t runs = min(items.size(), PARALLEL_RUNS);
+
+  vector<char> keep(items.size());
+
+  parallel(args[0], runs,
+           [&](Interpreter &interpreter, shared_ptr<ASTNode> const &function,
+               size_t run) {
+             vector<shared_ptr<ASTNode>> values(1);
+             size_t end = run_start(items.size(), runs, run + 1);
+
+             for (size_t i = run_start(items.size(), runs, run); i < end;
+                  i++) {
+               values.assign({isolate(items[i])});
+               auto res = interpreter.apply(function, values);
+
+               keep[i] =
+                   res->node_type == ASTNodeType::LEAF &&
+                   (res->head->value == "true" || res->head->value == "1");
+             }
+           });
 
-  default:
-    wcout << *node.get();
-    break;
+  vector<shared_ptr<ASTNode>> res;
+  for (size_t i = 0; i < items.size(); i++) {
+    if (keep[i])
+      res.push_back(items[i]);
   }
 
-  if (!is_recursive) {
-    wcout << endl;
+  return make_list(res);
+}
+
+// (preduce f init list) for an associative f: every run is folded from its
+// first item on, then init and the runs are folded in order
+shared_ptr<ASTNode>
+Interpreter::native_preduce(Span span, vector<shared_ptr<ASTNode>> &args) {
+  check_arity("preduce", span, args, 3);
+  args[2] = materialize(args[2]);
+  auto const &items = list_items("preduce", args[2]);
+  size_t runs = min(items.size(), PARALLEL_RUNS);
+
+  vector<shared_ptr<ASTNode>> partial(runs);
+
+  parallel(args[0], runs,
+           [&](Interpreter &interpreter, shared_ptr<ASTNode> const &function,
+               size_t run) {
+             vector<shared_ptr<ASTNode>> values(2);
+             size_t i = run_start(items.size(), runs, run);
+             size_t end = run_start(items.size(), runs, run + 1);
+
+             auto value = isolate(items[i]);
+             for (i++; i < end; i++) {
+               values.assign({value, isolate(items[i])});
+               value = interpreter.apply(function, values);
+             }
+
+             partial[run] = value;
+           });
+
+  auto value = args[1];
+  vector<shared_ptr<ASTNode>> values(2);
+
+  for (auto const &run : partial) {
+    values.assign({value, pool != nullptr ? isolate(run) : run});
+    value = apply(args[0], values);
   }
+
+  return value;
 }
 
-shared_ptr<ASTNode> Interpreter::interpret(shared_ptr<ASTNode> const &node) {
-  if (node == nullptr)
-    return make_shared<ASTNode>(
-        ASTNodeType::LEAF,
-        make_shared<Token>(TokenType::NUL, "null", Span({0, 0})));
+static shared_ptr<Channel> channel_arg(string const &name,
+                                       shared_ptr<ASTNode> const &arg) {
+  if (arg->node_type != ASTNodeType::CHANNEL)
+    throw RuntimeError(arg->head->span,
+                       name + ": invalid argument type " + arg->head->value);
 
-  switch (node->node_type) {
-  case ASTNodeType::PROGRAM:
-    interpret_program(node);
-    break;
-  case ASTNodeType::FUNCDEF:
-    return interpret_funcdef(static_pointer_cast<FuncDefNode>(node));
-  case ASTNodeType::FUNCCALL:
-    return interpret_funccall(static_pointer_cast<FuncCallNode>(node));
-  case ASTNodeType::LAMBDA:
-    return interpret_lambda(static_pointer_cast<LambdaNode>(node));
-  case ASTNodeType::LIST:
-    return interpret_list(static_pointer_cast<ListNode>(node));
-  case ASTNodeType::QUOTE_LIST:
-    return interpret_list(static_pointer_cast<ListNode>(node));
-  case ASTNodeType::RETURN:
-    return interpret_return(static_pointer_cast<ReturnNode>(node));
-  case ASTNodeType::BREAK:
-    return interpret_break(node);
-    break;
-  case ASTNodeType::COND:
-    return interpret_cond(static_pointer_cast<CondNode>(node));
-  case ASTNodeType::WHILE:
-    return interpret_while(static_pointer_cast<WhileNode>(node));
-    break;
-  case ASTNodeType::PROG:
-    return interpret_prog(static_pointer_cast<ProgNode>(node));
-  case ASTNodeType::SETQ:
-    return interpret_setq(static_pointer_cast<SetqNode>(node));
-    break;
-  case ASTNodeType::LEAF:
-    return interpret_leaf(node);
+  return static_pointer_cast<ChannelNode>(arg)->channel;
+}
+
+// runs (f args...) on a task of its own, args holds f first. the task sees
+// the global bindings as they are now. spawned from a task it stays on the
+// worker and interpreter of that task, else it goes to the next worker,
+// with copies of the bindings made for it
+void Interpreter::spawn_task(Span span, vector<shared_ptr<ASTNode>> &args,
+                             shared_ptr<Future> const &future) {
+  auto task = make_unique<Task>();
+  Task *spawner = Scheduler::current();
+  unsigned worker;
+
+  if (spawner != nullptr) {
+    auto globals = make_shared<Globals>();
+    for (auto const &binding : stack.front().variables) {
+      (*globals)[binding.first] = binding.second;
+    }
+
+    task->interpreter = spawner->interpreter;
+    task->globals = globals;
+    task->function = args[0];
+    task->args.assign(args.begin() + 1, args.end());
+    worker = spawner->worker;
+  } else {
+    if (scheduler == nullptr) {
+      scheduler = make_unique<Scheduler>(thread_count);
+      generations.resize(scheduler->size());
+    }
+
+    worker = next_worker;
+    next_worker = (next_worker + 1) % scheduler->size();
+
+    auto &generation = generations[worker];
+    auto const &bindings = stack.front().variables;
+    bool current =
+        generation.interpreter != nullptr &&
+        std::equal(bindings.begin(), bindings.end(), generation.source.begin(),
+                   generation.source.end(), [](auto const &a, auto const &b) {
+                     return a.first == b.first && a.second == b.second;
+                   });
+
+    if (!current) {
+      generation = Generation();
+      generation.interpreter = fork_options(true);
+      generation.source.insert(bindings.begin(), bindings.end());
+
+      MemoryScope memory_scope(generation.interpreter->memory);
+      auto globals = make_shared<Globals>();
+      for (auto const &binding : bindings) {
+        auto copy = isolate(binding.second);
+        (*globals)[binding.first] = copy;
+        generation.copies[binding.second.get()] = copy;
+      }
+      generation.globals = globals;
+    }
+
+    // a global function is not cloned again for every task
+    auto copy = [&](shared_ptr<ASTNode> const &value) {
+      auto found = generation.copies.find(value.get());
+      return found != generation.copies.end() ? found->second
+                                              : isolate(value);
+    };
+
+    MemoryScope memory_scope(generation.interpreter->memory);
+    task->interpreter = generation.interpreter;
+    task->globals = generation.globals;
+    task->function = copy(args[0]);
+    for (size_t i = 1; i < args.size(); i++) {
+      task->args.push_back(copy(args[i]));
+    }
   }
 
+  task->output = CapturedOutput::current();
+  task->span = span;
+  task->future = future;
+  (spawner != nullptr ? spawner->scheduler : scheduler.get())
+      ->spawn(std::move(task), worker);
+}
+
+// (spawn f args...) runs f on a task and returns null at once
+shared_ptr<ASTNode>
+Interpreter::native_spawn(Span span, vector<shared_ptr<ASTNode>> &args) {
+  if (args.empty())
+    throw WrongNumberOfArgumentsError(span, "spawn", 1, 0);
+
+  spawn_task(span, args, nullptr);
+
   return make_shared<ASTNode>(
-      ASTNodeType::LEAF,
-      make_shared<Token>(TokenType::NUL, "null", Span({0, 0})));
+      ASTNodeType::LEAF, make_shared<Token>(TokenType::NUL, "null", span));
 }
 
-void Interpreter::interpret_program(shared_ptr<ASTNode> const &node) {
-  if (stack.empty()) {
-    stack.push_back(Scope(ASTNodeType::PROGRAM));
-  }
+// (future f args...) runs f on a task like spawn and returns a future of
+// its result. an error of the task is thrown by force, not by the program
+shared_ptr<ASTNode>
+Interpreter::native_future(Span span, vector<shared_ptr<ASTNode>> &args) {
+  if (args.empty())
+    throw WrongNumberOfArgumentsError(span, "future", 1, 0);
 
-  for (int i = 0; i < node->children.size() - 1; i++) {
+  auto future = make_shared<Future>();
+  spawn_task(span, args, future);
 
-    interpret(node->children[i]);
-  }
+  return make_shared<FutureNode>(span, future);
+}
 
-  eval_result(interpret(node->children.back()));
+// (force x) waits for the result of the future x, any other value is its
+// own result
+shared_ptr<ASTNode>
+Interpreter::native_force(Span span, vector<shared_ptr<ASTNode>> &args) {
+  check_arity("force", span, args, 1);
+  if (args[0]->node_type != ASTNodeType::FUTURE)
+    return args[0];
+
+  // the result may be forced on several interpreters
+  auto const &future = static_pointer_cast<FutureNode>(args[0])->future;
+  return isolate(future->get(scheduler.get(), span));
 }
 
+// (chan) makes a channel whose send waits for a recv, (chan n) one that
+// holds up to n values
 shared_ptr<ASTNode>
-Interpreter::interpret_funcdef(shared_ptr<FuncDefNode> const &node) {
-  auto const &name = node->getName()->value;
-  stack.back()[name] = interpret_func_closure(node);
+Interpreter::native_chan(Span span, vector<shared_ptr<ASTNode>> &args) {
+  if (args.size() > 1)
+    throw WrongNumberOfArgumentsError(span, "chan", 1, args.size());
 
-  return stack.back()[name];
+  long long capacity = 0;
+  if (!args.empty() && (!int_value(args[0], capacity) || capacity < 0))
+    throw RuntimeError(args[0]->head->span,
+                       "chan: invalid argument type " + args[0]->head->value);
+
+  return make_shared<ChannelNode>(span, make_shared<Channel>(capacity));
 }
 
+// (send ch value) waits for room in ch, or for a recv without capacity
 shared_ptr<ASTNode>
-Interpreter::interpret_trampoline(shared_ptr<ASTNode> node) {
-  while (node->node_type == ASTNodeType::LAMBDA) {
-    auto funccall = make_shared<FuncCallNode>(
-        make_shared<Token>(TokenType::NUL, "unknown", Span({0, 0})),
-        vector<shared_ptr<ASTNode>>{node});
-    node = interpret_funccall(funccall);
-  }
+Interpreter::native_send(Span span, vector<shared_ptr<ASTNode>> &args) {
+  check_arity("send", span, args, 2);
+  auto channel = channel_arg("send", args[0]);
 
-  return node;
+  // the receiver may run on another interpreter
+  channel->send(isolate(args[1]), scheduler.get(), span);
+
+  return make_shared<ASTNode>(
+      ASTNodeType::LEAF, make_shared<Token>(TokenType::NUL, "null", span));
 }
 
+// (recv ch) waits for a value sent on ch
 shared_ptr<ASTNode>
-Interpreter::interpret_funccall(shared_ptr<FuncCallNode> const &node) {
-  if (node->children[0]->node_type != LEAF) {
+Interpreter::native_recv(Span span, vector<shared_ptr<ASTNode>> &args) {
+  check_arity("recv", span, args, 1);
+  return channel_arg("recv", args[0])->recv(scheduler.get(), span);
+}
 
-    auto head_node = interpret(node->children[0]);
+// the rest of a stream, computed by the first call for the cell and kept.
+// the program may run while it is computed, so the cell is not locked then
+shared_ptr<ASTNode>
+Interpreter::stream_rest(shared_ptr<StreamNode> const &cell) {
+  if (cell->kind == StreamNode::RANGE)
+    return range_rest(*cell);
 
-    stack.push_back(Scope(ASTNodeType::FUNCCALL));
+  shared_ptr<ASTNode> function, source;
 
-    switch (head_node->node_type) {
-    case ASTNodeType::FUNCDEF: {
-      auto const &name = head_node->children[0]->head;
-      interpret_funcdef(static_pointer_cast<FuncDefNode>(head_node));
-      vector<shared_ptr<ASTNode>> v_args = {
-          make_shared<ASTNode>(ASTNodeType::LEAF, name)};
-      for (auto const &arg : node->getArgs()) {
-        v_args.push_back(arg);
-      }
-      auto res = interpret_funccall(
-          make_shared<FuncCallNode>(v_args[0]->head, v_args));
-      stack.pop_back();
-      return res;
-    }
+  {
+    std::lock_guard<std::mutex> guard(cell->lock);
+    if (cell->rest != nullptr)
+      return cell->rest;
 
-    case ASTNodeType::LAMBDA: {
-      auto const &params = head_node->children[0];
-      auto const &body = head_node->children[1];
-      auto const &args = node->getArgs();
+    function = cell->function;
+    source = cell->source;
+  }
 
-      for (int i = 0; i < params->children.size(); i++) {
-        stack.back()[params->children[i]->head->value] = interpret(args[i]);
-      }
+  auto span = cell->head->span;
+  vector<shared_ptr<ASTNode>> values;
+  shared_ptr<ASTNode> rest;
 
-      auto res = interpret(body);
+  switch (cell->kind) {
+  case StreamNode::RANGE:
+    break;
 
-      stack.pop_back();
+  case StreamNode::THUNK:
+    rest = apply(function, values);
+    if (rest->node_type != ASTNodeType::LIST &&
+        rest->node_type != ASTNodeType::QUOTE_LIST &&
+        rest->node_type != ASTNodeType::STREAM)
+      throw RuntimeError(span, "streamcons: invalid rest " + rest->head->value);
+    break;
 
-      return res;
-    }
+  case StreamNode::ITERATE:
+    values.assign({cell->first});
+    rest = make_shared<StreamNode>(span, StreamNode::ITERATE,
+                                   apply(function, values), function);
+    break;
 
-    case ASTNodeType::LEAF: {
-      auto const &name = head_node->head;
-      auto const &args = node->getArgs();
+  case StreamNode::MAP:
+    rest = stream_map(function,
+                      stream_rest(static_pointer_cast<StreamNode>(source)));
+    break;
 
-      vector<shared_ptr<ASTNode>> v_args = {
-          make_shared<ASTNode>(ASTNodeType::LEAF, name)};
+  case StreamNode::FILTER:
+    rest = stream_filter(function,
+                         stream_rest(static_pointer_cast<StreamNode>(source)));
+    break;
 
-      for (auto const &arg : args) {
-        v_args.push_back(arg);
-      }
+  case StreamNode::TAKE:
+    // the source is not forced past the last item taken
+    if (cell->count == 0)
+      rest = make_list({});
+    else
+      rest = stream_take(cell->count,
+                         stream_rest(static_pointer_cast<StreamNode>(source)));
+    break;
 
-      auto res = interpret_funccall(
-          make_shared<FuncCallNode>(v_args[0]->head, v_args));
+  case StreamNode::COPY:
+    rest = isolate(stream_rest(static_pointer_cast<StreamNode>(source)));
+    break;
+  }
 
-      stack.pop_back();
+  std::lock_guard<std::mutex> guard(cell->lock);
+  if (cell->rest == nullptr) {
+    cell->rest = rest;
+    cell->function = nullptr;
+    cell->source = nullptr;
+  }
 
-      return res;
-    }
+  return cell->rest;
+}
 
-    default:
-      stack.pop_back();
-      throw runtime_error("not a function");
-    }
+// (map f items) of a stream is a stream, the items left once it reaches a
+// list are mapped at once
+shared_ptr<ASTNode> Interpreter::stream_map(shared_ptr<ASTNode> const &function,
+                                            shared_ptr<ASTNode> const &items) {
+  vector<shared_ptr<ASTNode>> values{function, items};
+  if (items->node_type != ASTNodeType::STREAM)
+    return native_map(items->head->span, values);
+
+  values.assign({static_pointer_cast<StreamNode>(items)->first});
+  return make_shared<StreamNode>(items->head->span, StreamNode::MAP,
+                                 apply(function, values), function, items);
+}
 
-  } else {
+// (filter f items) of a stream, the cells up to the first item kept are
+// forced
+shared_ptr<ASTNode>
+Interpreter::stream_filter(shared_ptr<ASTNode> const &function,
+                           shared_ptr<ASTNode> items) {
+  vector<shared_ptr<ASTNode>> values(1);
 
-    auto const &name = node->getName()->value;
-    auto const &args = node->getArgs();
+  while (items->node_type == ASTNodeType::STREAM) {
+    auto cell = static_pointer_cast<StreamNode>(items);
+    values.assign({cell->first});
+    auto keep = apply(function, values);
 
-    if (name == "_trampoline") {
-      return interpret_trampoline(interpret(args[0]));
-    }
+    if (keep->node_type == ASTNodeType::LEAF &&
+        (keep->head->value == "true" || keep->head->value == "1"))
+      return make_shared<StreamNode>(cell->head->span, StreamNode::FILTER,
+                                     cell->first, function, cell);
 
-    if (find(PF_FUNCS.begin(), PF_FUNCS.end(), name) != PF_FUNCS.end()) {
-      vector<shared_ptr<ASTNode>> v_args;
-      for (auto const &arg : args) {
-        v_args.push_back(interpret(arg));
-      }
-      return interpret(PF_FUNC_MAP.at(name)(v_args));
-    }
+    items = stream_rest(cell);
+  }
 
-    shared_ptr<ASTNode> funcdef;
+  values.assign({function, items});
+  return native_filter(items->head->span, values);
+}
 
-    for (int i = stack.size() - 1; i >= 0; i--) {
-      if (stack[i].variables.find(name) != stack[i].variables.end()) {
-        funcdef = stack[i][name];
-        break;
+// the first count items, a stream of a stream and a list of a list
+shared_ptr<ASTNode> Interpreter::stream_take(long long count,
+                                             shared_ptr<ASTNode> const &items) {
+  if (count == 0)
+    return make_list({});
+
+  if (items->node_type == ASTNodeType::STREAM)
+    return make_shared<StreamNode>(
+        items->head->span, StreamNode::TAKE,
+        static_pointer_cast<StreamNode>(items)->first, nullptr, items,
+        count - 1);
+
+  auto const &children = list_items("take", items);
+  if (count >= children.size())
+    return items;
+
+  return make_list(vector<shared_ptr<ASTNode>>(children.begin(),
+                                               children.begin() + count));
+}
+
+// a list of the items of a stream, which has to end
+shared_ptr<ASTNode> Interpreter::materialize(shared_ptr<ASTNode> const &items) {
+  if (items->node_type != ASTNodeType::STREAM)
+    return items;
+
+  vector<shared_ptr<ASTNode>> res;
+  auto rest = items;
+
+  while (rest->node_type == ASTNodeType::STREAM) {
+    auto cell = static_pointer_cast<StreamNode>(rest);
+    res.push_back(cell->first);
+
+    // the ints left are counted out here, with no cell made for them
+    if (cell->kind == StreamNode::RANGE) {
+      auto const &text = cell->first->head->value;
+      long long value = 0;
+      from_chars(text.data(), text.data() + text.size(), value);
+      res.reserve(res.size() + cell->count);
+
+      for (long long i = 1; i <= cell->count; i++) {
+        res.push_back(make_shared<ASTNode>(
+            ASTNodeType::LEAF,
+            make_shared<Token>(TokenType::INT,
+                               to_string(value + i * cell->step),
+                               cell->head->span)));
       }
+      return make_list(res);
     }
 
-    if (funcdef == nullptr) {
-      throw runtime_error(name + " is not a function");
-    }
+    rest = stream_rest(cell);
+  }
+
+  for (auto const &item : list_items("streamlist", rest)) {
+    res.push_back(item);
+  }
+
+  return make_list(res);
+}
+
+// the streams passed to a builtin: the builtins taking lists get them as
+// lists, see LIST_ARGUMENTS, and equal and nonequal compare them item by item.
+// returns the result of the call if it is made here, nullptr if not
+shared_ptr<ASTNode>
+Interpreter::stream_arguments(string const &name,
+                              vector<shared_ptr<ASTNode>> &values) {
+  if ((name == "equal" || name == "nonequal") && values.size() == 2 &&
+      (values[0]->node_type == ASTNodeType::STREAM ||
+       values[1]->node_type == ASTNodeType::STREAM)) {
+    bool res = equal_items(values[0], values[1]) == (name == "equal");
+    return make_shared<ASTNode>(
+        ASTNodeType::LEAF,
+        make_shared<Token>(TokenType::BOOL, res ? "true" : "false",
+                           values[0]->head->span));
+  }
 
-    if (funcdef->node_type != ASTNodeType::FUNCDEF &&
-        funcdef->node_type != ASTNodeType::LAMBDA) {
+  auto lists = LIST_ARGUMENTS.find(name);
+  if (lists == LIST_ARGUMENTS.end())
+    return nullptr;
 
-      if (funcdef->node_type == ASTNodeType::LEAF &&
-          funcdef->head->type == TokenType::IDENTIFIER) {
-        vector<shared_ptr<ASTNode>> v_args = {
-            make_shared<ASTNode>(ASTNodeType::LEAF, funcdef->head)};
+  for (int i = 0; i < values.size(); i++) {
+    if (lists->second < 0 || lists->second == i)
+      values[i] = materialize(values[i]);
+  }
 
-        for (auto const &arg : args) {
-          v_args.push_back(arg);
-        }
+  return nullptr;
+}
 
-        return interpret_funccall(
-            make_shared<FuncCallNode>(v_args[0]->head, v_args));
-      }
+// equal of two values where a stream equals a list or stream of equal items.
+// a stream is forced only until the first items that differ, so only two
+// endless streams never compare
+bool Interpreter::equal_items(shared_ptr<ASTNode> items1,
+                              shared_ptr<ASTNode> items2) {
+  auto is_items = [](shared_ptr<ASTNode> const &node) {
+    return node->node_type == ASTNodeType::STREAM ||
+           node->node_type == ASTNodeType::LIST ||
+           node->node_type == ASTNodeType::QUOTE_LIST;
+  };
+
+  if (items1->node_type != ASTNodeType::STREAM &&
+      items2->node_type != ASTNodeType::STREAM) {
+    vector<shared_ptr<ASTNode>> args = {items1, items2};
+    return pf_equal(args)->head->value == "true";
+  }
 
-      cout << "stack size: " << stack.size() << endl;
-      for (int i = stack.size() - 1; i >= 0; i--) {
-        cout << "scope " << i << ": ";
-        for (auto const &var : stack[i].variables) {
-          cout << var.first << ' ';
-        }
-        cout << endl;
-      }
+  if (!is_items(items1) || !is_items(items2))
+    return false;
+
+  // lists are walked by index, streams by forcing their rest
+  size_t index1 = 0, index2 = 0;
+  auto at_end = [](shared_ptr<ASTNode> const &items, size_t index) {
+    return items->node_type != ASTNodeType::STREAM &&
+           index == items->children.size();
+  };
+  auto item = [](shared_ptr<ASTNode> const &items, size_t index) {
+    return items->node_type == ASTNodeType::STREAM
+               ? static_pointer_cast<StreamNode>(items)->first
+               : items->children[index];
+  };
+  auto next = [this](shared_ptr<ASTNode> &items, size_t &index) {
+    if (items->node_type == ASTNodeType::STREAM)
+      items = stream_rest(static_pointer_cast<StreamNode>(items));
+    else
+      index++;
+  };
+
+  while (!at_end(items1, index1) && !at_end(items2, index2)) {
+    if (!equal_items(item(items1, index1), item(items2, index2)))
+      return false;
+
+    next(items1, index1);
+    next(items2, index2);
+  }
 
-      throw runtime_error(name + " is not a function");
-    }
+  return at_end(items1, index1) && at_end(items2, index2);
+}
 
-    auto const &params = funcdef->node_type == ASTNodeType::FUNCDEF
-                             ? funcdef->children[1]
-                             : funcdef->children[0];
-    auto const &body = funcdef->node_type == ASTNodeType::FUNCDEF
-                           ? funcdef->children[2]
-                           : funcdef->children[1];
+// (streamcons x f) is a stream of x and then the list or stream (f) returns
+shared_ptr<ASTNode>
+Interpreter::native_streamcons(Span span, vector<shared_ptr<ASTNode>> &args) {
+  check_arity("streamcons", span, args, 2);
+  return make_shared<StreamNode>(span, StreamNode::THUNK, args[0], args[1]);
+}
 
-    stack.push_back(Scope(ASTNodeType::FUNCCALL));
+// (iterate f x) is the endless stream x, (f x), (f (f x))...
+shared_ptr<ASTNode>
+Interpreter::native_iterate(Span span, vector<shared_ptr<ASTNode>> &args) {
+  check_arity("iterate", span, args, 2);
+  return make_shared<StreamNode>(span, StreamNode::ITERATE, args[1], args[0]);
+}
 
-    for (int i = 0; i < params->children.size(); i++) {
-      stack.back()[params->children[i]->head->value] = interpret(args[i]);
-    }
+static long long count_arg(string const &name, shared_ptr<ASTNode> const &arg) {
+  long long count;
+  if (!int_value(arg, count) || count < 0)
+    throw RuntimeError(arg->head->span,
+                       name + ": invalid argument type " + arg->head->value);
 
-    if (body->node_type == ASTNodeType::PROG) {
-      for (auto &child : body->children) {
-        if (child->node_type == ASTNodeType::SETQ) {
-          stack.back()[child->children[0]->head->value] = make_shared<ASTNode>(
-              ASTNodeType::LEAF,
-              make_shared<Token>(TokenType::NUL, "null", Span({0, 0})));
-        }
-      }
-    }
+  return count;
+}
 
-    shared_ptr<ASTNode> res = interpret(body);
+// (take n items) of a stream is forced only as far as its items are
+shared_ptr<ASTNode>
+Interpreter::native_take(Span span, vector<shared_ptr<ASTNode>> &args) {
+  check_arity("take", span, args, 2);
+  auto count = count_arg("take", args[0]);
 
-    stack.pop_back();
+  if (args[1]->node_type != ASTNodeType::STREAM)
+    list_items("take", args[1]);
 
-    return res;
+  return stream_take(count, args[1]);
+}
+
+// (drop n items) forces the first n cells of a stream
+shared_ptr<ASTNode>
+Interpreter::native_drop(Span span, vector<shared_ptr<ASTNode>> &args) {
+  check_arity("drop", span, args, 2);
+  auto count = count_arg("drop", args[0]);
+
+  auto rest = std::move(args[1]);
+  for (; count > 0 && rest->node_type == ASTNodeType::STREAM; count--) {
+    rest = stream_rest(static_pointer_cast<StreamNode>(rest));
+  }
+
+  if (count == 0)
+    return rest;
+
+  auto const &children = list_items("drop", rest);
+  if (count >= children.size())
+    return make_list({});
+
+  return make_list(
+      vector<shared_ptr<ASTNode>>(children.begin() + count, children.end()));
+}
+
+shared_ptr<ASTNode>
+Interpreter::native_streamlist(Span span, vector<shared_ptr<ASTNode>> &args) {
+  check_arity("streamlist", span, args, 1);
+  return materialize(args[0]);
+}
+
+// what tail of a stream returns to be interpreted
+shared_ptr<ASTNode>
+Interpreter::native_streamrest(Span span, vector<shared_ptr<ASTNode>> &args) {
+  check_arity("_streamrest", span, args, 1);
+  return stream_rest(static_pointer_cast<StreamNode>(args[0]));
+}
+
+shared_ptr<ASTNode> Interpreter::find_variable(string const &name) {
+  for (int i = stack.size() - 1; i >= 0; i--) {
+    if (stack[i].variables.find(name) != stack[i].variables.end()) {
+      return stack[i][name];
+    }
   }
+
+  return nullptr;
 }
 
 shared_ptr<ASTNode>
 Interpreter::interpret_setq(shared_ptr<SetqNode> const &node) {
+  if (!counters.empty() && counters.back().loop->increment == node &&
+      step_counter(node))
+    return node;
+
   auto const &name = node->getName()->value;
   auto const &value = node->getValue();
 
   for (int i = stack.size() - 1; i >= 0; i--) {
     if (stack[i].variables.find(name) != stack[i].variables.end()) {
       stack[i][name] = interpret(value);
+      invalidate(name);
       return node;
     }
 
@@ -354,6 +1770,7 @@ Interpreter::interpret_setq(shared_ptr<SetqNode> const &node) {
   }
 
   stack.back()[name] = interpret(value);
+  invalidate(name);
 
   return node;
 }
@@ -368,33 +1785,131 @@ Interpreter::interpret_break(shared_ptr<ASTNode> const &node) {
 shared_ptr<ASTNode>
 Interpreter::interpret_while(shared_ptr<WhileNode> const &node) {
   stack.push_back(Scope(ASTNodeType::WHILE));
+  if (node->counted)
+    counters.push_back(Counter{node->counted.get()});
+
   while (true) {
-    auto cond_res = interpret(node->getCond());
+    memory.check(node->head->span);
+    check_time(node->head->span);
+
+    auto const &cond = node->getCond();
+    bool holds;
+
+    if (!node->counted || !counted_condition(counters.back(), holds)) {
+      auto cond_res = interpret(cond);
+      holds = cond->proven(TYPE_BOOL)
+                  ? is_true(cond_res)
+                  : cond_res->node_type == ASTNodeType::LEAF &&
+                        (cond_res->head->value != "false" &&
+                         cond_res->head->value != "0");
+    }
 
     if (stack.back().break_flag || stack.back().return_value) {
       break;
     }
 
-    if (cond_res->node_type == ASTNodeType::LEAF &&
-        (cond_res->head->value != "false" && cond_res->head->value != "0")) {
+    if (holds) {
       interpret(node->getBody());
     } else {
       break;
     }
   }
 
+  if (node->counted)
+    counters.pop_back();
+
   if (stack.back().return_value) {
     auto res = stack.back().return_value;
-    stack.pop_back();
+    pop_scope();
     stack.back().return_value = res;
     return res;
   }
 
-  stack.pop_back();
+  pop_scope();
 
   return node;
 }
 
+// compares the counter of a counted loop with its bound without calling
+// the builtin. the counter is only parsed again when something else bound
+// it, false if it or the bound is not an int
+bool Interpreter::counted_condition(Counter &counter, bool &holds) {
+  auto value = interpret_leaf(counter.loop->counter);
+  if (value != counter.value) {
+    if (!int_value(value, counter.count))
+      return false;
+    counter.value = value;
+  }
+
+  auto bound = interpret_leaf(counter.loop->bound);
+  if (bound != counter.bound) {
+    if (!int_value(bound, counter.limit))
+      return false;
+    counter.bound = bound;
+  }
+
+  switch (counter.loop->comparison) {
+  case CountedLoop::LESS:
+    holds = counter.count < counter.limit;
+    break;
+  case CountedLoop::LESSEQ:
+    holds = counter.count <= counter.limit;
+    break;
+  case CountedLoop::GREATER:
+    holds = counter.count > counter.limit;
+    break;
+  case CountedLoop::GREATEREQ:
+    holds = counter.count >= counter.limit;
+    break;
+  }
+
+  return true;
+}
+
+// runs the increment of the innermost counted loop on its native counter.
+// false if the counter does not hold the value the condition saw, or the
+// step leaves the ints, then the setq is interpreted as usual
+bool Interpreter::step_counter(shared_ptr<SetqNode> const &node) {
+  auto &counter = counters.back();
+  auto const &name = node->getName()->value;
+
+  if (counter.value == nullptr ||
+      interpret_leaf(counter.loop->counter) != counter.value)
+    return false;
+
+  long long next = counter.count + counter.loop->step;
+  if (next < INT_MIN || next > INT_MAX)
+    return false;
+
+  // the binding interpret_setq assigns, the builtin gives the result the
+  // span of its first argument
+  for (int i = stack.size() - 1; i >= 0; i--) {
+    auto variable = stack[i].variables.find(name);
+    if (variable != stack[i].variables.end()) {
+      if (variable->second != counter.value)
+        return false;
+
+      auto const &first = counter.loop->step_first
+                              ? node->getValue()->children[1]->head
+                              : counter.value->head;
+
+      counter.value = make_shared<ASTNode>(
+          ASTNodeType::LEAF,
+          make_shared<Token>(TokenType::INT, to_string(next), first->span));
+      counter.count = next;
+      variable->second = counter.value;
+      invalidate(name);
+      return true;
+    }
+
+    if (stack[i].inlined) {
+      break;
+    }
+  }
+
+  return false;
+}
+
 shared_ptr<ASTNode>
 Interpreter::interpret_lambda(shared_ptr<LambdaNode> const &node) {
   return interpret_lambda_closure(node);
@@ -402,14 +1917,20 @@ Interpreter::interpret_lambda(shared_ptr<LambdaNode> const &node) {
 
 shared_ptr<ASTNode>
 Interpreter::interpret_list(shared_ptr<ListNode> const &node) {
-  if (node->node_type == ASTNodeType::QUOTE_LIST)
+  if (node->node_type == ASTNodeType::QUOTE_LIST || node->is_constant)
     return node;
 
   vector<shared_ptr<ASTNode>> res;
   for (auto const &child : node->children) {
     res.push_back(interpret(child));
   }
-  return make_shared<ListNode>(res);
+
+  if (node->scoped) {
+    ScopedLists scoped_lists;
+    return make_list(res);
+  }
+
+  return make_list(res);
 }
 
 shared_ptr<ASTNode>
@@ -442,7 +1963,9 @@ Interpreter::interpret_lambda_closure(shared_ptr<LambdaNode> const &node) {
   iterate_closure(lambda->getBody(), setqs, defined);
 
   if (lambda->getBody()->node_type == ASTNodeType::PROG) {
-    auto body = static_pointer_cast<ProgNode>(lambda->getBody());
+    // the body is shared with the definition, copy it before inserting
+    auto body = static_pointer_cast<ProgNode>(lambda->getBody()->copy());
+    lambda->setBody(body);
     body->children.insert(body->children.begin() + 1, setqs.begin(),
                           setqs.end());
 
@@ -491,7 +2014,9 @@ Interpreter::interpret_func_closure(shared_ptr<FuncDefNode> const &node) {
   iterate_closure(funcdef->getBody(), setqs, defined);
 
   if (funcdef->getBody()->node_type == ASTNodeType::PROG) {
-    auto body = static_pointer_cast<ProgNode>(funcdef->getBody());
+    // the body is shared with the definition, copy it before inserting
+    auto body = static_pointer_cast<ProgNode>(funcdef->getBody()->copy());
+    funcdef->setBody(body);
     body->children.insert(body->children.begin() + 1, setqs.begin(),
                           setqs.end());
 
@@ -554,10 +2079,14 @@ void Interpreter::iterate_closure(shared_ptr<ASTNode> const &node,
 
 shared_ptr<ASTNode>
 Interpreter::interpret_cond(shared_ptr<CondNode> const &node) {
-  auto cond_res = interpret(node->getCond());
-
-  if (cond_res->node_type == ASTNodeType::LEAF &&
-      (cond_res->head->value == "true" || cond_res->head->value == "1")) {
+  auto const &cond = node->getCond();
+  auto cond_res = interpret(cond);
+
+  if (cond->proven(TYPE_BOOL)
+          ? is_true(cond_res)
+          : cond_res->node_type == ASTNodeType::LEAF &&
+                (cond_res->head->value == "true" ||
+                 cond_res->head->value == "1")) {
     return interpret(node->getBranchTrue());
   } else if (node->getBranchFalse() != nullptr) {
     return interpret(node->getBranchFalse());
@@ -571,6 +2100,7 @@ Interpreter::interpret_prog(shared_ptr<ProgNode> const &node) {
   stack.push_back(Scope(ASTNodeType::PROG, node->is_inlined));
 
   for (auto &loc : node->getLocals()->children) {
+    invalidate(loc->head->value);
     stack.back()[loc->head->value] = make_shared<ASTNode>(
         ASTNodeType::LEAF,
         make_shared<Token>(TokenType::NUL, "null", Span({0, 0})));
@@ -579,12 +2109,12 @@ Interpreter::interpret_prog(shared_ptr<ProgNode> const &node) {
   for (int i = 1; i < node->children.size() - 1; i++) {
     if (stack.back().return_value) {
       auto res = stack.back().return_value;
-      stack.pop_back();
+      pop_scope();
       return res;
     }
 
     if (stack.back().break_flag) {
-      stack.pop_back();
+      pop_scope();
       stack.back().break_flag = true;
       return make_shared<ASTNode>(
           ASTNodeType::LEAF,
@@ -599,23 +2129,70 @@ Interpreter::interpret_prog(shared_ptr<ProgNode> const &node) {
     auto res = interpret(node->children.back());
 
     if (stack.back().break_flag) {
-      stack.pop_back();
+      pop_scope();
       stack.back().break_flag = true;
       return make_shared<ASTNode>(
           ASTNodeType::LEAF,
           make_shared<Token>(TokenType::NUL, "null", Span({0, 0})));
     }
 
-    stack.pop_back();
+    pop_scope();
 
     return res;
   }
 
   auto res = stack.back().return_value;
-  stack.pop_back();
+  pop_scope();
   return res;
 }
 
+// the branches run on the thread pool unless the analysis found one that
+// could see another, each worker on a fork of the bindings visible here.
+// the values and the error thrown follow the order of the branches, not
+// the order they finish in
+shared_ptr<ASTNode>
+Interpreter::interpret_parallel(shared_ptr<ParallelNode> const &node) {
+  auto const &branches = node->children;
+  vector<shared_ptr<ASTNode>> res(branches.size());
+
+  if (node->serial || pool == nullptr) {
+    for (size_t i = 0; i < branches.size(); i++) {
+      res[i] = interpret(branches[i]);
+    }
+
+    return make_list(res);
+  }
+
+  vector<std::exception_ptr> errors(branches.size());
+
+  parallel(node, branches.size(),
+           [&](Interpreter &interpreter, shared_ptr<ASTNode> const &parallel,
+               size_t i) {
+             size_t depth = interpreter.stack.size();
+             size_t loops = interpreter.counters.size();
+
+             try {
+               res[i] = interpreter.interpret(parallel->children[i]);
+             } catch (...) {
+               // the worker goes on with the next branch
+               while (interpreter.stack.size() > depth)
+                 interpreter.pop_scope();
+               interpreter.counters.erase(interpreter.counters.begin() + loops,
+                                          interpreter.counters.end());
+               errors[i] = std::current_exception();
+             }
+           });
+
+  for (size_t i = 0; i < branches.size(); i++) {
+    if (errors[i] != nullptr)
+      std::rethrow_exception(errors[i]);
+
+    res[i] = isolate(res[i]);
+  }
+
+  return make_list(res);
+}
+
 shared_ptr<ASTNode>
 Interpreter::interpret_leaf(shared_ptr<ASTNode> const &node) {
   if (node->head->type == TokenType::IDENTIFIER) {
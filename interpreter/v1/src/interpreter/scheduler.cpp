@@ -0,0 +1,417 @@
+#include "scheduler.h"
+#include "../utils/stack.h"
+#include "interpeter.h"
+#include <algorithm>
+#include <new>
+#include <optional>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace interp {
+
+namespace {
+
+// guards every channel and scheduler
+std::mutex channel_lock;
+
+// signalled whenever a task blocks or finishes, and when a thread blocked
+// outside of tasks is woken
+std::condition_variable changed;
+
+thread_local Task *current_task = nullptr;
+
+// address space for the stack of a task, as much as a main thread gets. only
+// the pages it touches are backed. the lowest page is left inaccessible, and
+// the interpreter stops a recursion before it gets there, see Stack
+const size_t STACK_SIZE = size_t(8) << 20;
+const size_t KEPT_STACKS = 64;
+
+// thrown by the send or recv a cancelled task is blocked in, unwinds the
+// task to its entry
+struct Cancelled {};
+
+void *map_stack() {
+  void *stack =
+      mmap(nullptr, STACK_SIZE, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+  if (stack == MAP_FAILED)
+    throw std::bad_alloc();
+
+  mprotect(stack, sysconf(_SC_PAGESIZE), PROT_NONE);
+  return stack;
+}
+
+} // namespace
+
+Channel::Channel(size_t capacity) : capacity(capacity) {}
+
+void Channel::send(shared_ptr<ASTNode> const &value, Scheduler *scheduler,
+                   Span span) {
+  std::unique_lock<std::mutex> guard(channel_lock);
+
+  if (!receivers.empty()) {
+    Waiter *receiver = receivers.front();
+    receivers.pop_front();
+    receiver->value = value;
+    Scheduler::unblock(receiver);
+    return;
+  }
+
+  if (buffer.size() < capacity) {
+    buffer.push_back(value);
+    return;
+  }
+
+  Waiter waiter;
+  waiter.value = value;
+  Scheduler::await(waiter, senders, guard, scheduler, span);
+}
+
+shared_ptr<ASTNode> Channel::recv(Scheduler *scheduler, Span span) {
+  std::unique_lock<std::mutex> guard(channel_lock);
+
+  if (!buffer.empty()) {
+    auto value = buffer.front();
+    buffer.pop_front();
+
+    // the first sender waiting for room gets it
+    if (!senders.empty()) {
+      Waiter *sender = senders.front();
+      senders.pop_front();
+      buffer.push_back(sender->value);
+      Scheduler::unblock(sender);
+    }
+
+    return value;
+  }
+
+  if (!senders.empty()) {
+    Waiter *sender = senders.front();
+    senders.pop_front();
+    auto value = sender->value;
+    Scheduler::unblock(sender);
+    return value;
+  }
+
+  Waiter waiter;
+  Scheduler::await(waiter, receivers, guard, scheduler, span);
+  return waiter.value;
+}
+
+ChannelNode::ChannelNode(Span span, shared_ptr<Channel> channel)
+    : ASTNode(CHANNEL, make_shared<Token>(LITERAL, "<chan>", span)),
+      channel(std::move(channel)) {}
+
+shared_ptr<ASTNode> ChannelNode::copy() {
+  return make_shared<ChannelNode>(head->span, channel);
+}
+
+void Future::set(shared_ptr<ASTNode> const &value,
+                 std::exception_ptr error) {
+  std::lock_guard<std::mutex> guard(channel_lock);
+  done = true;
+  this->value = value;
+  this->error = error;
+
+  for (Waiter *waiter : waiters) {
+    Scheduler::unblock(waiter);
+  }
+  waiters.clear();
+}
+
+shared_ptr<ASTNode> Future::get(Scheduler *scheduler, Span span) {
+  std::unique_lock<std::mutex> guard(channel_lock);
+
+  if (!done) {
+    Waiter waiter;
+    Scheduler::await(waiter, waiters, guard, scheduler, span);
+  }
+
+  if (error)
+    std::rethrow_exception(error);
+
+  return value;
+}
+
+FutureNode::FutureNode(Span span, shared_ptr<Future> future)
+    : ASTNode(FUTURE, make_shared<Token>(LITERAL, "<future>", span)),
+      future(std::move(future)) {}
+
+shared_ptr<ASTNode> FutureNode::copy() {
+  return make_shared<FutureNode>(head->span, future);
+}
+
+Task::Task() {}
+
+Task::~Task() {
+  if (stack != nullptr)
+    munmap(stack, STACK_SIZE);
+}
+
+Scheduler::Scheduler(unsigned workers) {
+  for (unsigned i = 0; i < std::max(workers, 1u); i++) {
+    this->workers.push_back(std::make_unique<Worker>());
+  }
+
+  for (unsigned i = 0; i < this->workers.size(); i++) {
+    threads.emplace_back(&Scheduler::loop, this, i);
+  }
+}
+
+Scheduler::~Scheduler() {
+  cancel();
+
+  {
+    std::lock_guard<std::mutex> guard(channel_lock);
+    stopping = true;
+    for (auto &worker : workers) {
+      worker->wake.notify_all();
+    }
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  for (void *stack : stacks) {
+    munmap(stack, STACK_SIZE);
+  }
+}
+
+unsigned Scheduler::size() const { return workers.size(); }
+
+Task *Scheduler::current() { return current_task; }
+
+void Scheduler::spawn(unique_ptr<Task> task, unsigned worker) {
+  std::lock_guard<std::mutex> guard(channel_lock);
+
+  if (stacks.empty()) {
+    task->stack = map_stack();
+  } else {
+    task->stack = stacks.back();
+    stacks.pop_back();
+  }
+
+  task->scheduler = this;
+  task->worker = worker;
+
+  getcontext(&task->context);
+  task->context.uc_stack.ss_sp = task->stack;
+  task->context.uc_stack.ss_size = STACK_SIZE;
+  task->context.uc_link = &workers[worker]->context;
+  makecontext(&task->context, &Scheduler::run, 0);
+
+  Task *spawned = task.release();
+  tasks.insert(spawned);
+  make_ready(spawned);
+}
+
+void Scheduler::wait() {
+  std::unique_lock<std::mutex> guard(channel_lock);
+  changed.wait(guard, [&] { return tasks.empty() || runnable == 0; });
+
+  std::optional<DeadlockError> deadlock;
+  if (!tasks.empty()) {
+    deadlock.emplace((*tasks.begin())->span);
+    cancelling = true;
+    cancel_blocked();
+    wait_for_tasks(guard);
+    cancelling = false;
+  }
+
+  auto failed = error;
+  error = nullptr;
+  guard.unlock();
+
+  if (failed)
+    std::rethrow_exception(failed);
+  if (deadlock)
+    throw *deadlock;
+}
+
+void Scheduler::cancel() {
+  std::unique_lock<std::mutex> guard(channel_lock);
+  cancelling = true;
+  cancel_blocked();
+  wait_for_tasks(guard);
+  cancelling = false;
+  error = nullptr;
+}
+
+void Scheduler::cancel_blocked() {
+  for (Task *task : tasks) {
+    if (task->waiter == nullptr || task->cancelled)
+      continue;
+
+    auto &queue = *task->queue;
+    queue.erase(std::find(queue.begin(), queue.end(), task->waiter));
+    task->cancelled = true;
+    make_ready(task);
+  }
+}
+
+void Scheduler::wait_for_tasks(std::unique_lock<std::mutex> &guard) {
+  changed.wait(guard, [&] { return tasks.empty(); });
+}
+
+void Scheduler::make_ready(Task *task) {
+  runnable++;
+  workers[task->worker]->ready.push_back(task);
+  workers[task->worker]->wake.notify_one();
+}
+
+void Scheduler::loop(unsigned worker) {
+  Worker &self = *workers[worker];
+  std::unique_lock<std::mutex> guard(channel_lock);
+
+  while (true) {
+    self.wake.wait(guard, [&] { return stopping || !self.ready.empty(); });
+    if (self.ready.empty())
+      return;
+
+    Task *task = self.ready.front();
+    self.ready.pop_front();
+
+    guard.unlock();
+    resume(*task);
+    guard.lock();
+
+    if (!task->finished)
+      continue;
+
+    tasks.erase(task);
+    runnable--;
+    if (task->error && !error)
+      error = task->error;
+
+    if (stacks.size() < KEPT_STACKS) {
+      stacks.push_back(task->stack);
+      task->stack = nullptr;
+    }
+
+    changed.notify_all();
+
+    guard.unlock();
+    delete task;
+    guard.lock();
+  }
+}
+
+// runs the task until it blocks or returns, with its frames and the memory,
+// region and output of its spawn
+void Scheduler::resume(Task &task) {
+  auto &interpreter = *task.interpreter;
+  current_task = &task;
+  std::swap(interpreter.stack, task.frames);
+  std::swap(interpreter.counters, task.counters);
+
+  {
+    MemoryScope memory_scope(interpreter.memory);
+    RegionScope region_scope(interpreter.region);
+    StackScope stack_scope(task.stack);
+    std::optional<OutputScope> output_scope;
+    if (task.output != nullptr)
+      output_scope.emplace(*task.output);
+
+    swapcontext(&workers[task.worker]->context, &task.context);
+  }
+
+  std::swap(interpreter.stack, task.frames);
+  std::swap(interpreter.counters, task.counters);
+  current_task = nullptr;
+}
+
+void Scheduler::run() {
+  Task *task = current_task;
+  auto &interpreter = *task->interpreter;
+
+  try {
+    interpreter.stack.push_back(Scope(ASTNodeType::PROGRAM));
+    for (auto const &binding : *task->globals) {
+      interpreter.stack.back()[binding.first] = binding.second;
+    }
+
+    auto args = task->args;
+    auto value = interpreter.apply(task->function, args);
+
+    // the one forcing it may run on another interpreter
+    if (task->future != nullptr)
+      task->future->set(Interpreter::isolate(value), nullptr);
+  } catch (Cancelled &) {
+  } catch (...) {
+    if (task->future != nullptr)
+      task->future->set(nullptr, std::current_exception());
+    else
+      task->error = std::current_exception();
+  }
+
+  while (!interpreter.stack.empty()) {
+    interpreter.pop_scope();
+  }
+  interpreter.counters.clear();
+
+  task->finished = true;
+}
+
+// parks the calling task, or blocks the calling thread, until waiter is
+// done. guard holds channel_lock
+void Scheduler::await(Waiter &waiter, std::deque<Waiter *> &queue,
+                      std::unique_lock<std::mutex> &guard,
+                      Scheduler *scheduler, Span span) {
+  Task *task = current_task;
+
+  if (task != nullptr) {
+    if (task->scheduler->cancelling)
+      throw Cancelled();
+
+    waiter.task = task;
+    queue.push_back(&waiter);
+    task->waiter = &waiter;
+    task->queue = &queue;
+
+    if (--task->scheduler->runnable == 0)
+      changed.notify_all();
+
+    guard.unlock();
+    swapcontext(&task->context,
+                &task->scheduler->workers[task->worker]->context);
+    guard.lock();
+
+    task->waiter = nullptr;
+    task->queue = nullptr;
+    if (!waiter.done)
+      throw Cancelled();
+
+    return;
+  }
+
+  queue.push_back(&waiter);
+
+  while (!waiter.done) {
+    // no task is left that could wake it
+    if (scheduler == nullptr || scheduler->runnable == 0) {
+      queue.erase(std::find(queue.begin(), queue.end(), &waiter));
+
+      auto failed = scheduler != nullptr ? scheduler->error : nullptr;
+      if (failed) {
+        scheduler->error = nullptr;
+        std::rethrow_exception(failed);
+      }
+
+      throw DeadlockError(span);
+    }
+
+    changed.wait(guard);
+  }
+}
+
+void Scheduler::unblock(Waiter *waiter) {
+  waiter->done = true;
+
+  if (waiter->task != nullptr)
+    waiter->task->scheduler->make_ready(waiter->task);
+  else
+    changed.notify_all();
+}
+
+} // namespace interp
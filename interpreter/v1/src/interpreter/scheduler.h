@@ -0,0 +1,194 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "../semantic/semantic_analyzer.h"
+#include "../utils/output.h"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <ucontext.h>
+#include <vector>
+
+namespace interp {
+
+class Interpreter;
+struct Scope;
+struct Counter;
+class Scheduler;
+struct Task;
+
+// a task or a thread blocked on a channel, until another one hands it a
+// value or takes its value
+struct Waiter {
+  shared_ptr<ASTNode> value;
+  bool done = false;
+  Task *task = nullptr; // null for a thread that is not running a task
+};
+
+// values sent from one task to another. without capacity a send waits for
+// the recv that takes its value. channels are guarded by one lock shared by
+// all schedulers
+class Channel {
+public:
+  Channel(size_t capacity);
+
+  // block until there is room or a receiver, and until a value is there.
+  // scheduler is the one of the thread calling while it runs no task, to
+  // tell when nothing is left that could wake it
+  void send(shared_ptr<ASTNode> const &value, Scheduler *scheduler,
+            Span span);
+  shared_ptr<ASTNode> recv(Scheduler *scheduler, Span span);
+
+private:
+  friend class Scheduler;
+
+  size_t capacity;
+  std::deque<shared_ptr<ASTNode>> buffer;
+  std::deque<Waiter *> senders, receivers;
+};
+
+// the value chan makes
+class ChannelNode : public ASTNode {
+public:
+  shared_ptr<Channel> channel;
+
+  ChannelNode(Span span, shared_ptr<Channel> channel);
+
+  shared_ptr<ASTNode> copy() override;
+};
+
+// the result of a task spawned by future, set once it returns or fails
+class Future {
+public:
+  void set(shared_ptr<ASTNode> const &value, std::exception_ptr error);
+
+  // blocks like Channel::recv until the result is set, then returns the
+  // value or throws the error, to every caller alike
+  shared_ptr<ASTNode> get(Scheduler *scheduler, Span span);
+
+private:
+  bool done = false;
+  shared_ptr<ASTNode> value;
+  std::exception_ptr error;
+  std::deque<Waiter *> waiters;
+};
+
+// the value future makes
+class FutureNode : public ASTNode {
+public:
+  shared_ptr<Future> future;
+
+  FutureNode(Span span, shared_ptr<Future> future);
+
+  shared_ptr<ASTNode> copy() override;
+};
+
+// the global bindings a task starts with
+typedef map<string, shared_ptr<ASTNode>> Globals;
+
+// a call of a flang function running on a stack of its own. the tasks of a
+// worker share an interpreter and swap their frames into it while they run
+struct Task {
+  shared_ptr<Interpreter> interpreter;
+  shared_ptr<Globals const> globals;
+  shared_ptr<ASTNode> function;
+  vector<shared_ptr<ASTNode>> args;
+  CapturedOutput *output = nullptr; // of the thread that spawned it
+  Span span;                        // of the spawn
+  shared_ptr<Future> future;        // gets the result, null for spawn
+
+  vector<Scope> frames;
+  vector<Counter> counters;
+
+  Scheduler *scheduler = nullptr;
+  unsigned worker = 0;
+  ucontext_t context;
+  void *stack = nullptr;
+
+  Waiter *waiter = nullptr; // while blocked, in the queue below
+  std::deque<Waiter *> *queue = nullptr;
+  bool cancelled = false;
+  bool finished = false;
+  std::exception_ptr error;
+
+  Task();
+  ~Task();
+};
+
+// the interpreter of a worker for the tasks spawned outside of tasks, with
+// copies of the global bindings it was made for. a new one is made once
+// those change
+struct Generation {
+  shared_ptr<Interpreter> interpreter;
+  map<string, shared_ptr<ASTNode>> source; // the bindings copied
+  shared_ptr<Globals const> globals;       // their copies
+  map<ASTNode const *, shared_ptr<ASTNode>> copies;
+};
+
+// runs tasks on a fixed set of threads. a task stays on the worker it is
+// given, there it runs until it blocks on a channel or returns
+class Scheduler {
+public:
+  Scheduler(unsigned workers);
+
+  // cancels the tasks still blocked and waits for the others
+  ~Scheduler();
+
+  Scheduler(Scheduler const &) = delete;
+  Scheduler &operator=(Scheduler const &) = delete;
+
+  unsigned size() const;
+
+  // the task running on this thread, nullptr outside of one
+  static Task *current();
+
+  void spawn(unique_ptr<Task> task, unsigned worker);
+
+  // returns once every task is done. throws the first error of a task, or a
+  // DeadlockError if the tasks left are all blocked, those are cancelled
+  void wait();
+
+  // cancels the tasks blocked now and those that block from now on, then
+  // waits for all. their errors are dropped
+  void cancel();
+
+private:
+  friend class Channel;
+  friend class Future;
+
+  struct Worker {
+    std::deque<Task *> ready;
+    std::condition_variable wake;
+    ucontext_t context; // of the loop, while it runs a task
+  };
+
+  vector<unique_ptr<Worker>> workers;
+  vector<std::thread> threads;
+  std::set<Task *> tasks;
+  vector<void *> stacks; // of finished tasks, for the next ones
+  size_t runnable = 0;   // tasks ready or running
+  bool cancelling = false;
+  bool stopping = false;
+  std::exception_ptr error; // the first one of a task
+
+  void loop(unsigned worker);
+  void resume(Task &task);
+  void make_ready(Task *task);
+  void cancel_blocked();
+  void wait_for_tasks(std::unique_lock<std::mutex> &guard);
+
+  static void await(Waiter &waiter, std::deque<Waiter *> &queue,
+                    std::unique_lock<std::mutex> &guard, Scheduler *scheduler,
+                    Span span);
+  static void unblock(Waiter *waiter);
+  static void run(); // the entry of a task
+};
+
+} // namespace interp
+
+#endif
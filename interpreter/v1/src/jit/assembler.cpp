@@ -0,0 +1,226 @@
+#include "assembler.h"
+#include <stdexcept>
+
+using namespace jit;
+
+int Assembler::new_label() {
+  labels.push_back(-1);
+  return labels.size() - 1;
+}
+
+void Assembler::bind(int label) { labels[label] = position(); }
+
+int Assembler::position() const { return code.size(); }
+
+void Assembler::finish() {
+  for (auto const &fixup : fixups) {
+    if (labels[fixup.label] < 0)
+      throw std::logic_error("jit: unbound label");
+
+    patch32(fixup.offset, labels[fixup.label] - (fixup.offset + 4));
+  }
+
+  fixups.clear();
+}
+
+void Assembler::byte(uint8_t value) { code.push_back(value); }
+
+void Assembler::imm32(int32_t value) {
+  for (int i = 0; i < 4; i++)
+    byte((uint32_t)value >> (8 * i));
+}
+
+void Assembler::patch32(int offset, int32_t value) {
+  for (int i = 0; i < 4; i++)
+    code[offset + i] = (uint32_t)value >> (8 * i);
+}
+
+void Assembler::rex_w() { byte(0x48); }
+
+void Assembler::modrm_reg(int reg, int rm) {
+  byte(0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+void Assembler::modrm_mem(int reg, Reg base, int32_t disp) {
+  // rsp as base would need a sib byte
+  if (base == RSP)
+    throw std::logic_error("jit: rsp based operand");
+
+  byte(0x80 | (reg & 7) << 3 | base);
+  imm32(disp);
+}
+
+void Assembler::sse(uint8_t prefix, uint8_t opcode, int reg, int rm,
+                    bool wide) {
+  byte(prefix);
+  if (wide)
+    rex_w();
+  byte(0x0F);
+  byte(opcode);
+  modrm_reg(reg, rm);
+}
+
+void Assembler::rel32(int label) {
+  fixups.push_back({position(), label});
+  imm32(0);
+}
+
+void Assembler::push_rbp() { byte(0x55); }
+
+void Assembler::mov_rbp_rsp() {
+  rex_w();
+  byte(0x89);
+  modrm_reg(RSP, RBP);
+}
+
+int Assembler::sub_rsp() {
+  rex_w();
+  byte(0x81);
+  modrm_reg(5, RSP);
+  int offset = position();
+  imm32(0);
+  return offset;
+}
+
+void Assembler::leave() { byte(0xC9); }
+
+void Assembler::ret() { byte(0xC3); }
+
+void Assembler::movsd_load(Xmm dst, Reg base, int32_t disp) {
+  byte(0xF2);
+  byte(0x0F);
+  byte(0x10);
+  modrm_mem(dst, base, disp);
+}
+
+void Assembler::movsd_store(Reg base, int32_t disp, Xmm src) {
+  byte(0xF2);
+  byte(0x0F);
+  byte(0x11);
+  modrm_mem(src, base, disp);
+}
+
+void Assembler::movsd(Xmm dst, Xmm src) { sse(0xF2, 0x10, dst, src); }
+
+void Assembler::mov_load(Reg dst, Reg base, int32_t disp) {
+  rex_w();
+  byte(0x8B);
+  modrm_mem(dst, base, disp);
+}
+
+void Assembler::mov_store(Reg base, int32_t disp, Reg src) {
+  rex_w();
+  byte(0x89);
+  modrm_mem(src, base, disp);
+}
+
+void Assembler::mov_imm64(Reg dst, uint64_t value) {
+  rex_w();
+  byte(0xB8 + dst);
+  for (int i = 0; i < 8; i++)
+    byte(value >> (8 * i));
+}
+
+void Assembler::mov_imm32(Reg dst, uint32_t value) {
+  byte(0xB8 + dst);
+  imm32(value);
+}
+
+void Assembler::movq(Xmm dst, Reg src) { sse(0x66, 0x6E, dst, src, true); }
+
+void Assembler::movq(Reg dst, Xmm src) { sse(0x66, 0x7E, src, dst, true); }
+
+void Assembler::lea(Reg dst, Reg base, int32_t disp) {
+  rex_w();
+  byte(0x8D);
+  modrm_mem(dst, base, disp);
+}
+
+void Assembler::addsd(Xmm dst, Xmm src) { sse(0xF2, 0x58, dst, src); }
+
+void Assembler::subsd(Xmm dst, Xmm src) { sse(0xF2, 0x5C, dst, src); }
+
+void Assembler::mulsd(Xmm dst, Xmm src) { sse(0xF2, 0x59, dst, src); }
+
+void Assembler::divsd(Xmm dst, Xmm src) { sse(0xF2, 0x5E, dst, src); }
+
+void Assembler::ucomisd(Xmm a, Xmm b) { sse(0x66, 0x2E, a, b); }
+
+void Assembler::cvttsd2si(Reg dst, Xmm src) {
+  sse(0xF2, 0x2C, dst, src, true);
+}
+
+void Assembler::cvtsi2sd(Xmm dst, Reg src) { sse(0xF2, 0x2A, dst, src, true); }
+
+void Assembler::movsxd(Reg dst, Reg src) {
+  rex_w();
+  byte(0x63);
+  modrm_reg(dst, src);
+}
+
+void Assembler::cmp(Reg a, Reg b) {
+  rex_w();
+  byte(0x39);
+  modrm_reg(b, a);
+}
+
+void Assembler::cmp_load(Reg a, Reg base, int32_t disp) {
+  rex_w();
+  byte(0x3B);
+  modrm_mem(a, base, disp);
+}
+
+void Assembler::test(Reg a, Reg b) {
+  rex_w();
+  byte(0x85);
+  modrm_reg(b, a);
+}
+
+void Assembler::xor32(Reg dst, Reg src) {
+  byte(0x31);
+  modrm_reg(src, dst);
+}
+
+void Assembler::xor32_imm8(Reg dst, int8_t value) {
+  byte(0x83);
+  modrm_reg(6, dst);
+  byte(value);
+}
+
+void Assembler::and8(Reg dst, Reg src) {
+  byte(0x20);
+  modrm_reg(src, dst);
+}
+
+void Assembler::setcc(Cond cond, Reg dst) {
+  byte(0x0F);
+  byte(0x90 + cond);
+  modrm_reg(0, dst);
+}
+
+void Assembler::movzx8(Reg dst, Reg src) {
+  byte(0x0F);
+  byte(0xB6);
+  modrm_reg(dst, src);
+}
+
+void Assembler::jmp(int label) {
+  byte(0xE9);
+  rel32(label);
+}
+
+void Assembler::jcc(Cond cond, int label) {
+  byte(0x0F);
+  byte(0x80 + cond);
+  rel32(label);
+}
+
+void Assembler::call(int label) {
+  byte(0xE8);
+  rel32(label);
+}
+
+void Assembler::call(Reg target) {
+  byte(0xFF);
+  modrm_reg(2, target);
+}
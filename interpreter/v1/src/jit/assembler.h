@@ -0,0 +1,107 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <cstdint>
+#include <vector>
+
+namespace jit {
+
+enum Reg {
+  RAX = 0,
+  RCX = 1,
+  RDX = 2,
+  RBX = 3,
+  RSP = 4,
+  RBP = 5,
+  RSI = 6,
+  RDI = 7
+};
+
+enum Xmm { XMM0 = 0, XMM1 = 1 };
+
+// condition codes as encoded in jcc/setcc
+enum Cond {
+  BELOW = 0x2,
+  ABOVE_EQUAL = 0x3,
+  EQUAL = 0x4,
+  NOT_EQUAL = 0x5,
+  ABOVE = 0x7,
+  PARITY = 0xA,
+  NOT_PARITY = 0xB,
+};
+
+// minimal x86-64 encoder for the template jit. memory operands are always
+// [base + disp32] with rbp or rdi as base
+class Assembler {
+public:
+  std::vector<uint8_t> code;
+
+  int new_label();
+  void bind(int label);
+  int position() const;
+
+  // resolves label references, must be called once all labels are bound
+  void finish();
+
+  void push_rbp();
+  void mov_rbp_rsp();
+  int sub_rsp(); // returns the offset of the imm32 to patch
+  void patch32(int offset, int32_t value);
+  void leave();
+  void ret();
+
+  void movsd_load(Xmm dst, Reg base, int32_t disp);
+  void movsd_store(Reg base, int32_t disp, Xmm src);
+  void movsd(Xmm dst, Xmm src);
+  void mov_load(Reg dst, Reg base, int32_t disp);
+  void mov_store(Reg base, int32_t disp, Reg src);
+  void mov_imm64(Reg dst, uint64_t value);
+  void mov_imm32(Reg dst, uint32_t value);
+  void movq(Xmm dst, Reg src);
+  void movq(Reg dst, Xmm src);
+  void lea(Reg dst, Reg base, int32_t disp);
+
+  void addsd(Xmm dst, Xmm src);
+  void subsd(Xmm dst, Xmm src);
+  void mulsd(Xmm dst, Xmm src);
+  void divsd(Xmm dst, Xmm src);
+  void ucomisd(Xmm a, Xmm b);
+  void cvttsd2si(Reg dst, Xmm src);
+  void cvtsi2sd(Xmm dst, Reg src);
+
+  void movsxd(Reg dst, Reg src);
+  void cmp(Reg a, Reg b);
+  void cmp_load(Reg a, Reg base, int32_t disp);
+  void test(Reg a, Reg b);
+  void xor32(Reg dst, Reg src);
+  void xor32_imm8(Reg dst, int8_t value);
+  void and8(Reg dst, Reg src);
+  void setcc(Cond cond, Reg dst);
+  void movzx8(Reg dst, Reg src);
+
+  void jmp(int label);
+  void jcc(Cond cond, int label);
+  void call(int label);
+  void call(Reg target);
+
+private:
+  struct Fixup {
+    int offset; // of the rel32 field
+    int label;
+  };
+
+  std::vector<int> labels;
+  std::vector<Fixup> fixups;
+
+  void byte(uint8_t value);
+  void imm32(int32_t value);
+  void rex_w();
+  void modrm_reg(int reg, int rm);
+  void modrm_mem(int reg, Reg base, int32_t disp);
+  void sse(uint8_t prefix, uint8_t opcode, int reg, int rm, bool wide = false);
+  void rel32(int label);
+};
+
+} // namespace jit
+
+#endif
@@ -0,0 +1,961 @@
+#include "jit.h"
+#include "../semantic/semantic_analyzer.h"
+#include "../utils/stack.h"
+#include "assembler.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <csetjmp>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_X86_64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace jit;
+
+namespace {
+
+// stack_limit is the lowest address the stack may reach, the code bails out
+// through stack_overflow below it
+typedef JitValue (*Entry)(JitValue const *args, char const *stack_limit);
+
+// compiled code of a function, owned by its FuncDefNode
+struct NativeFunction {
+  Entry entry = nullptr; // null if the function could not be compiled
+  void *memory = nullptr;
+  size_t size = 0;
+  bool self_calls = false;
+
+  ~NativeFunction() {
+#ifdef JIT_X86_64
+    if (memory != nullptr)
+      munmap(memory, size);
+#endif
+  }
+};
+
+// thrown by the compiler when a function leaves the compiled subset
+struct Unsupported {};
+
+// interpreter builtins, a call to one of these never reaches a user function
+const vector<string> BUILTINS = {
+    "plus",   "minus",  "times",  "divide",  "equal",   "nonequal",  "less",
+    "lesseq", "greater", "greatereq", "and", "or",      "not",       "xor",
+    "eval",   "isint",  "isreal", "isbool",  "isnull",  "isatom",    "islist",
+    "head",   "tail",   "cons",   "isempty", "foldl",   "println",   "require",
+    "memo",   "_trampoline", "range", "_pipeline",
+    "vec",        "vecrange",     "veclist",  "vecget",  "vecplus",
+    "vecminus",   "vectimes",     "vecdivide", "vecless", "veclesseq",
+    "vecgreater", "vecgreatereq", "vecequal", "vecsum",  "vecdot",
+    "vecmin",     "vecmax",       "vecscan"};
+
+// canonical numbers are the ones arithmetic produces: they print back to
+// their own text, so compiled code can compare them by value and tag
+bool read_number(Token const &token, JitValue &result) {
+  if (token.type != INT && token.type != REAL)
+    return false;
+
+  char const *text = token.value.c_str();
+  char *end;
+  double value = strtod(text, &end);
+
+  if (end == text)
+    return false;
+
+  if (token.type == INT) {
+    if (!(value >= INT_MIN && value <= INT_MAX) || value != trunc(value) ||
+        to_string((int)value) != token.value)
+      return false;
+  } else if (to_string(value) != token.value) {
+    return false;
+  }
+
+  result = {value, token.type};
+  return true;
+}
+
+shared_ptr<ASTNode> box(JitValue const &value, Span span) {
+  string text = value.tag == INT ? to_string((int)value.value)
+                                 : to_string(value.value);
+
+  return make_shared<ASTNode>(
+      LEAF, make_shared<Token>((TokenType)value.tag, text, span));
+}
+
+// result conversion of pf_plus and friends for values that are not small
+// integers, the number goes through its text like in the interpreter
+JitValue normalize(double result) {
+  double intpart;
+  if (modf(result, &intpart) == 0.0)
+    return {(double)(int)result, INT};
+
+  return {strtod(to_string(result).c_str(), nullptr), REAL};
+}
+
+// where a recursion of compiled code that ran out of stack returns to, set
+// by Jit::call. compiled frames hold nothing to clean up, so they are
+// dropped at once
+thread_local std::jmp_buf *overflow_exit = nullptr;
+
+[[noreturn]] void stack_overflow() { std::longjmp(*overflow_exit, 1); }
+
+uint64_t bits(double value) {
+  uint64_t result;
+  memcpy(&result, &value, sizeof(result));
+  return result;
+}
+
+// expression results: numbers in xmm0 with their tag in rax, booleans as
+// 0 or 1 in rax
+enum Kind { NUMBER, BOOLEAN };
+
+struct Binding {
+  string name;
+  int slot;
+};
+
+struct LexicalScope {
+  vector<Binding> bindings;
+  int base;
+  bool inlined;
+};
+
+// where a break jumps, label -1 if break is not allowed
+struct BreakTarget {
+  int label;
+  bool used;
+};
+
+struct ProgContext {
+  int end;
+  bool has_exit;
+  vector<bool> exit; // assigned slots on every return out of the prog
+};
+
+// translates one function to machine code. every variable and temporary
+// lives in a 16 byte frame slot holding value and tag, so the generated code
+// is a fixed template per node
+class FunctionCompiler {
+public:
+  Assembler as;
+  bool self_calls = false;
+
+  FunctionCompiler(shared_ptr<FuncDefNode> const &funcdef)
+      : funcdef(funcdef), name(funcdef->getName()->value),
+        arity(funcdef->getParams()->children.size()) {}
+
+  void compile();
+
+private:
+  shared_ptr<FuncDefNode> funcdef;
+  string name;
+  size_t arity;
+  int entry;
+
+  vector<LexicalScope> scopes;
+  vector<ProgContext> progs;
+  vector<int> returns; // innermost prog a return leaves, -1 if not allowed
+  vector<BreakTarget> breaks;
+  vector<bool> assigned; // slots definitely assigned on the current path
+  int slots = 0;
+  int frame_slots = 0;
+  int limit_slot = 0; // the stack_limit passed in, for self calls
+
+  static int32_t value_of(int slot) { return -16 * (slot + 1); }
+  static int32_t tag_of(int slot) { return -16 * (slot + 1) + 8; }
+
+  int allocate();
+  void open_scope(bool inlined);
+  void close_scope();
+  int declare(string const &variable);
+  Binding const *lookup(string const &variable);
+  int resolve_read(string const &variable);
+  int resolve_write(string const &variable);
+  void merge(vector<bool> const &other);
+  void dead();
+
+  void result(shared_ptr<ASTNode> const &node);
+  void statement(shared_ptr<ASTNode> const &node);
+  void prog(shared_ptr<ASTNode> const &node, bool value_needed);
+  void cond(shared_ptr<ASTNode> const &node, bool value_needed);
+  void loop(shared_ptr<ASTNode> const &node);
+  void setq(shared_ptr<ASTNode> const &node);
+  void leave_prog(shared_ptr<ASTNode> const &node);
+
+  Kind expression(shared_ptr<ASTNode> const &node, bool operand = false);
+  void number(shared_ptr<ASTNode> const &node, bool operand = false);
+  void boolean(shared_ptr<ASTNode> const &node);
+  Kind call(shared_ptr<ASTNode> const &node);
+  void arithmetic(string const &op, vector<shared_ptr<ASTNode>> const &args);
+  void compare(string const &op, vector<shared_ptr<ASTNode>> const &args);
+  void equality(string const &op, vector<shared_ptr<ASTNode>> const &args);
+  void logic(string const &op, vector<shared_ptr<ASTNode>> const &args);
+  void self_call(vector<shared_ptr<ASTNode>> const &args);
+  void normalize_result();
+};
+
+int FunctionCompiler::allocate() {
+  int slot = slots++;
+  frame_slots = max(frame_slots, slots);
+
+  if (assigned.size() < slots)
+    assigned.resize(slots);
+
+  assigned[slot] = false;
+  return slot;
+}
+
+void FunctionCompiler::open_scope(bool inlined) {
+  scopes.push_back({{}, slots, inlined});
+}
+
+void FunctionCompiler::close_scope() {
+  slots = scopes.back().base;
+  scopes.pop_back();
+}
+
+int FunctionCompiler::declare(string const &variable) {
+  for (auto const &binding : scopes.back().bindings) {
+    if (binding.name == variable) {
+      assigned[binding.slot] = false;
+      return binding.slot;
+    }
+  }
+
+  int slot = allocate();
+  scopes.back().bindings.push_back({variable, slot});
+  return slot;
+}
+
+Binding const *FunctionCompiler::lookup(string const &variable) {
+  for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+    for (auto it = scope->bindings.rbegin(); it != scope->bindings.rend();
+         ++it) {
+      if (it->name == variable)
+        return &*it;
+    }
+  }
+
+  return nullptr;
+}
+
+int FunctionCompiler::resolve_read(string const &variable) {
+  auto binding = lookup(variable);
+
+  // globals and variables that may still be null stay in the interpreter
+  if (binding == nullptr || !assigned[binding->slot])
+    throw Unsupported();
+
+  return binding->slot;
+}
+
+int FunctionCompiler::resolve_write(string const &variable) {
+  // same lookup as interpret_setq, which stops at inlined progs
+  for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+    for (auto it = scope->bindings.rbegin(); it != scope->bindings.rend();
+         ++it) {
+      if (it->name == variable)
+        return it->slot;
+    }
+
+    if (scope->inlined)
+      break;
+  }
+
+  throw Unsupported();
+}
+
+void FunctionCompiler::merge(vector<bool> const &other) {
+  for (size_t i = 0; i < min(assigned.size(), other.size()); i++)
+    assigned[i] = assigned[i] && other[i];
+}
+
+void FunctionCompiler::dead() { assigned.assign(assigned.size(), true); }
+
+void FunctionCompiler::compile() {
+  auto const &params = funcdef->getParams();
+  auto const &body = funcdef->getBody();
+
+  entry = as.new_label();
+  as.bind(entry);
+  as.push_rbp();
+  as.mov_rbp_rsp();
+  int frame = as.sub_rsp();
+
+  int overflow = as.new_label();
+  limit_slot = allocate();
+  as.mov_store(RBP, value_of(limit_slot), RSI);
+  as.cmp(RSP, RSI);
+  as.jcc(BELOW, overflow);
+
+  // arguments arrive as an array of values in rdi
+  open_scope(false);
+  for (size_t i = 0; i < arity; i++) {
+    auto const &param = params->children[i];
+    if (param->node_type != LEAF || param->head->type != IDENTIFIER)
+      throw Unsupported();
+
+    int slot = declare(param->head->value);
+    as.movsd_load(XMM0, RDI, 16 * i);
+    as.movsd_store(RBP, value_of(slot), XMM0);
+    as.mov_load(RAX, RDI, 16 * i + 8);
+    as.mov_store(RBP, tag_of(slot), RAX);
+    assigned[slot] = true;
+  }
+
+  // setqs of the body are bound in the call frame, see interpret_funccall
+  if (body->node_type == PROG) {
+    for (auto const &child : body->children) {
+      if (child->node_type == SETQ)
+        declare(child->children[0]->head->value);
+    }
+  }
+
+  result(body);
+
+  as.leave();
+  as.ret();
+
+  as.bind(overflow);
+  as.mov_imm64(RAX, (uint64_t)&stack_overflow);
+  as.call(RAX);
+
+  as.patch32(frame, 16 * frame_slots);
+  as.finish();
+}
+
+void FunctionCompiler::result(shared_ptr<ASTNode> const &node) {
+  switch (node->node_type) {
+  case RETURN:
+    if (returns.empty())
+      number(node->children[0]);
+    else
+      leave_prog(node);
+    break;
+  case PROG:
+    prog(node, true);
+    break;
+  case COND:
+    cond(node, true);
+    break;
+  default:
+    number(node);
+  }
+}
+
+void FunctionCompiler::statement(shared_ptr<ASTNode> const &node) {
+  switch (node->node_type) {
+  case SETQ:
+    setq(node);
+    break;
+  case WHILE:
+    loop(node);
+    break;
+  case COND:
+    cond(node, false);
+    break;
+  case PROG:
+    prog(node, false);
+    break;
+  case RETURN:
+    leave_prog(node);
+    break;
+  case BREAK:
+    if (breaks.empty() || breaks.back().label < 0)
+      throw Unsupported();
+
+    breaks.back().used = true;
+    as.jmp(breaks.back().label);
+    dead();
+    break;
+  default:
+    expression(node);
+  }
+}
+
+void FunctionCompiler::prog(shared_ptr<ASTNode> const &node,
+                            bool value_needed) {
+  auto const &children = node->children;
+
+  // a prog without statements evaluates to its locals list
+  if (children.size() < 2) {
+    if (value_needed)
+      throw Unsupported();
+    return;
+  }
+
+  open_scope(static_pointer_cast<ProgNode>(node)->is_inlined);
+
+  for (auto const &local : children[0]->children) {
+    if (local->node_type != LEAF || local->head->type != IDENTIFIER)
+      throw Unsupported();
+
+    declare(local->head->value);
+  }
+
+  progs.push_back({as.new_label(), false, {}});
+  returns.push_back(progs.size() - 1);
+
+  auto before = assigned;
+  int outer = breaks.empty() ? -1 : breaks.back().label;
+
+  // interpret_prog runs the last statement even after a break in an earlier
+  // one, so those breaks go to a copy of it. a break in a prog whose value
+  // is needed would leave it with null
+  if (value_needed)
+    breaks.push_back({-1, false});
+  else
+    breaks.push_back({outer < 0 ? -1 : as.new_label(), false});
+
+  for (size_t i = 1; i < children.size() - 1; i++)
+    statement(children[i]);
+
+  BreakTarget handler = breaks.back();
+
+  if (value_needed) {
+    result(children.back());
+    breaks.pop_back();
+  } else {
+    breaks.pop_back();
+    statement(children.back());
+  }
+
+  if (handler.used) {
+    int end = as.new_label();
+    auto after = assigned;
+
+    as.jmp(end);
+    as.bind(handler.label);
+    assigned = before;
+    statement(children.back());
+    as.jmp(outer);
+    breaks.back().used = true;
+
+    assigned = after;
+    as.bind(end);
+  }
+
+  ProgContext context = progs.back();
+  progs.pop_back();
+  returns.pop_back();
+
+  as.bind(context.end);
+  if (context.has_exit)
+    merge(context.exit);
+
+  close_scope();
+}
+
+void FunctionCompiler::leave_prog(shared_ptr<ASTNode> const &node) {
+  if (returns.empty() || returns.back() < 0)
+    throw Unsupported();
+
+  number(node->children[0]);
+
+  auto &context = progs[returns.back()];
+  if (context.has_exit) {
+    for (size_t i = 0; i < min(assigned.size(), context.exit.size()); i++)
+      context.exit[i] = context.exit[i] && assigned[i];
+  } else {
+    context.exit = assigned;
+    context.has_exit = true;
+  }
+
+  as.jmp(context.end);
+  dead();
+}
+
+void FunctionCompiler::cond(shared_ptr<ASTNode> const &node,
+                            bool value_needed) {
+  bool has_else = node->children.size() == 3;
+
+  // without else the value is the cond node itself
+  if (value_needed && !has_else)
+    throw Unsupported();
+
+  int branch_false = as.new_label();
+  int end = as.new_label();
+
+  boolean(node->children[0]);
+  as.test(RAX, RAX);
+  as.jcc(EQUAL, branch_false);
+
+  auto before = assigned;
+
+  if (value_needed)
+    result(node->children[1]);
+  else
+    statement(node->children[1]);
+
+  auto after_true = assigned;
+  assigned = before;
+
+  as.jmp(end);
+  as.bind(branch_false);
+
+  if (has_else) {
+    if (value_needed)
+      result(node->children[2]);
+    else
+      statement(node->children[2]);
+  }
+
+  merge(after_true);
+  as.bind(end);
+}
+
+void FunctionCompiler::loop(shared_ptr<ASTNode> const &node) {
+  int top = as.new_label();
+  int end = as.new_label();
+
+  as.bind(top);
+  boolean(node->children[0]);
+  as.test(RAX, RAX);
+  as.jcc(EQUAL, end);
+
+  // the body may run zero times
+  auto before = assigned;
+
+  breaks.push_back({end, false});
+  returns.push_back(-1);
+  statement(node->children[1]);
+  returns.pop_back();
+  breaks.pop_back();
+
+  assigned = before;
+
+  as.jmp(top);
+  as.bind(end);
+}
+
+void FunctionCompiler::setq(shared_ptr<ASTNode> const &node) {
+  int slot = resolve_write(node->children[0]->head->value);
+
+  number(node->children[1]);
+  as.movsd_store(RBP, value_of(slot), XMM0);
+  as.mov_store(RBP, tag_of(slot), RAX);
+
+  assigned[slot] = true;
+}
+
+Kind FunctionCompiler::expression(shared_ptr<ASTNode> const &node,
+                                  bool operand) {
+  switch (node->node_type) {
+  case LEAF: {
+    auto const &token = *node->head;
+
+    if (token.type == IDENTIFIER) {
+      int slot = resolve_read(token.value);
+      as.movsd_load(XMM0, RBP, value_of(slot));
+      as.mov_load(RAX, RBP, tag_of(slot));
+      return NUMBER;
+    }
+
+    if (token.type == BOOL &&
+        (token.value == "true" || token.value == "false")) {
+      if (token.value == "true")
+        as.mov_imm32(RAX, 1);
+      else
+        as.xor32(RAX, RAX);
+      return BOOLEAN;
+    }
+
+    JitValue value;
+    if (!read_number(token, value)) {
+      // arithmetic only reads the value, any literal text will do there
+      char const *text = token.value.c_str();
+      char *end;
+      value = {strtod(text, &end), token.type};
+
+      if (!operand || (token.type != INT && token.type != REAL) ||
+          end == text)
+        throw Unsupported();
+    }
+
+    as.mov_imm64(RAX, bits(value.value));
+    as.movq(XMM0, RAX);
+    as.mov_imm32(RAX, value.tag);
+    return NUMBER;
+  }
+
+  case FUNCCALL:
+    return call(node);
+
+  case COND: {
+    if (node->children.size() != 3)
+      throw Unsupported();
+
+    int branch_false = as.new_label();
+    int end = as.new_label();
+
+    boolean(node->children[0]);
+    as.test(RAX, RAX);
+    as.jcc(EQUAL, branch_false);
+
+    auto before = assigned;
+    Kind kind = expression(node->children[1]);
+    auto after_true = assigned;
+    assigned = before;
+
+    as.jmp(end);
+    as.bind(branch_false);
+
+    if (expression(node->children[2]) != kind)
+      throw Unsupported();
+
+    merge(after_true);
+    as.bind(end);
+    return kind;
+  }
+
+  case PROG:
+    prog(node, true);
+    return NUMBER;
+
+  default:
+    throw Unsupported();
+  }
+}
+
+void FunctionCompiler::number(shared_ptr<ASTNode> const &node, bool operand) {
+  if (expression(node, operand) != NUMBER)
+    throw Unsupported();
+}
+
+void FunctionCompiler::boolean(shared_ptr<ASTNode> const &node) {
+  if (expression(node) != BOOLEAN)
+    throw Unsupported();
+}
+
+Kind FunctionCompiler::call(shared_ptr<ASTNode> const &node) {
+  if (node->children[0]->node_type != LEAF)
+    throw Unsupported();
+
+  string const &callee = node->children[0]->head->value;
+  vector<shared_ptr<ASTNode>> args(node->children.begin() + 1,
+                                   node->children.end());
+
+  if (callee == "plus" || callee == "minus" || callee == "times" ||
+      callee == "divide") {
+    if (args.empty())
+      throw Unsupported();
+
+    arithmetic(callee, args);
+    return NUMBER;
+  }
+
+  if (callee == "less" || callee == "lesseq" || callee == "greater" ||
+      callee == "greatereq") {
+    if (args.size() != 2)
+      throw Unsupported();
+
+    compare(callee, args);
+    return BOOLEAN;
+  }
+
+  if (callee == "equal" || callee == "nonequal") {
+    if (args.size() != 2)
+      throw Unsupported();
+
+    equality(callee, args);
+    return BOOLEAN;
+  }
+
+  if (callee == "and" || callee == "or" || callee == "not") {
+    if (args.empty() || (callee == "not" && args.size() != 1))
+      throw Unsupported();
+
+    logic(callee, args);
+    return BOOLEAN;
+  }
+
+  if (std::find(BUILTINS.begin(), BUILTINS.end(), callee) != BUILTINS.end())
+    throw Unsupported();
+
+  // a variable of the same name would shadow the function
+  if (callee != name || lookup(callee) != nullptr || args.size() != arity)
+    throw Unsupported();
+
+  self_call(args);
+  return NUMBER;
+}
+
+void FunctionCompiler::arithmetic(string const &op,
+                                  vector<shared_ptr<ASTNode>> const &args) {
+  auto apply = [&](Xmm dst, Xmm src) {
+    if (op == "plus")
+      as.addsd(dst, src);
+    else if (op == "minus")
+      as.subsd(dst, src);
+    else if (op == "times")
+      as.mulsd(dst, src);
+    else
+      as.divsd(dst, src);
+  };
+
+  int temp = allocate();
+
+  number(args[0], true);
+
+  // plus and times start from 0 and 1 like the builtins
+  if (op == "plus" || op == "times") {
+    as.mov_imm64(RAX, bits(op == "plus" ? 0.0 : 1.0));
+    as.movq(XMM1, RAX);
+    apply(XMM1, XMM0);
+    as.movsd(XMM0, XMM1);
+  }
+
+  for (size_t i = 1; i < args.size(); i++) {
+    as.movsd_store(RBP, value_of(temp), XMM0);
+    number(args[i], true);
+    as.movsd(XMM1, XMM0);
+    as.movsd_load(XMM0, RBP, value_of(temp));
+    apply(XMM0, XMM1);
+  }
+
+  slots--;
+  normalize_result();
+}
+
+// small integers are converted inline, everything else calls normalize
+void FunctionCompiler::normalize_result() {
+  int slow = as.new_label();
+  int done = as.new_label();
+
+  as.cvttsd2si(RAX, XMM0);
+  as.cvtsi2sd(XMM1, RAX);
+  as.ucomisd(XMM0, XMM1);
+  as.jcc(PARITY, slow);
+  as.jcc(NOT_EQUAL, slow);
+  as.movsxd(RCX, RAX);
+  as.cmp(RCX, RAX);
+  as.jcc(NOT_EQUAL, slow);
+  as.movsd(XMM0, XMM1);
+  as.mov_imm32(RAX, INT);
+  as.jmp(done);
+
+  as.bind(slow);
+  as.mov_imm64(RAX, (uint64_t)&normalize);
+  as.call(RAX);
+  as.bind(done);
+}
+
+void FunctionCompiler::compare(string const &op,
+                               vector<shared_ptr<ASTNode>> const &args) {
+  int temp = allocate();
+
+  number(args[0], true);
+  as.movsd_store(RBP, value_of(temp), XMM0);
+  number(args[1], true);
+  as.movsd(XMM1, XMM0);
+  as.movsd_load(XMM0, RBP, value_of(temp));
+
+  slots--;
+
+  // unordered operands compare false, as with doubles in the builtins
+  if (op == "less" || op == "lesseq")
+    as.ucomisd(XMM1, XMM0);
+  else
+    as.ucomisd(XMM0, XMM1);
+
+  as.setcc(op == "less" || op == "greater" ? ABOVE : ABOVE_EQUAL, RAX);
+  as.movzx8(RAX, RAX);
+}
+
+void FunctionCompiler::equality(string const &op,
+                                vector<shared_ptr<ASTNode>> const &args) {
+  // canonical numbers have equal text iff value and tag are equal
+  int temp = allocate();
+
+  number(args[0]);
+  as.movsd_store(RBP, value_of(temp), XMM0);
+  as.mov_store(RBP, tag_of(temp), RAX);
+  number(args[1]);
+
+  slots--;
+
+  as.cmp_load(RAX, RBP, tag_of(temp));
+  as.setcc(EQUAL, RCX);
+  as.movq(RAX, XMM0);
+  as.cmp_load(RAX, RBP, value_of(temp));
+  as.setcc(EQUAL, RAX);
+  as.and8(RAX, RCX);
+  as.movzx8(RAX, RAX);
+
+  if (op == "nonequal")
+    as.xor32_imm8(RAX, 1);
+}
+
+void FunctionCompiler::logic(string const &op,
+                             vector<shared_ptr<ASTNode>> const &args) {
+  if (op == "not") {
+    boolean(args[0]);
+    as.xor32_imm8(RAX, 1);
+    return;
+  }
+
+  // operands are pure, so evaluation may stop at the first decisive one
+  int decided = as.new_label();
+  int done = as.new_label();
+  bool is_and = op == "and";
+
+  for (auto const &arg : args) {
+    boolean(arg);
+    as.test(RAX, RAX);
+    as.jcc(is_and ? EQUAL : NOT_EQUAL, decided);
+  }
+
+  as.mov_imm32(RAX, is_and ? 1 : 0);
+  as.jmp(done);
+  as.bind(decided);
+  as.mov_imm32(RAX, is_and ? 0 : 1);
+  as.bind(done);
+}
+
+void FunctionCompiler::self_call(vector<shared_ptr<ASTNode>> const &args) {
+  auto const &params = funcdef->getParams()->children;
+  int n = args.size();
+  int base = slots;
+
+  self_calls = true;
+
+  // arguments are passed as an array, argument i in slot base + n - 1 - i
+  for (int i = 0; i < n; i++)
+    allocate();
+
+  for (int i = 0; i < n; i++) {
+    // the interpreter evaluates argument i with the earlier parameters
+    // already bound in the new frame
+    open_scope(false);
+    for (int j = 0; j < i; j++)
+      scopes.back().bindings.push_back(
+          {params[j]->head->value, base + n - 1 - j});
+
+    number(args[i]);
+    close_scope();
+
+    int slot = base + n - 1 - i;
+    as.movsd_store(RBP, value_of(slot), XMM0);
+    as.mov_store(RBP, tag_of(slot), RAX);
+    assigned[slot] = true;
+  }
+
+  as.lea(RDI, RBP, value_of(base + n - 1));
+  as.mov_load(RSI, RBP, value_of(limit_slot));
+  as.call(entry);
+
+  slots = base;
+}
+
+#ifdef JIT_X86_64
+shared_ptr<NativeFunction> compile(shared_ptr<FuncDefNode> const &funcdef) {
+  auto native = make_shared<NativeFunction>();
+  FunctionCompiler compiler(funcdef);
+
+  try {
+    compiler.compile();
+  } catch (Unsupported const &) {
+    return native;
+  }
+
+  auto const &code = compiler.as.code;
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t size = (code.size() + page - 1) / page * page;
+
+  void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED)
+    return native;
+
+  memcpy(memory, code.data(), code.size());
+
+  if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(memory, size);
+    return native;
+  }
+
+  native->memory = memory;
+  native->size = size;
+  native->entry = (Entry)memory;
+  native->self_calls = compiler.self_calls;
+
+  return native;
+}
+#endif
+
+} // namespace
+
+Jit::Jit(unsigned threshold) : threshold(threshold), compiled_functions(0) {}
+
+bool Jit::available() {
+#ifdef JIT_X86_64
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool Jit::supports(shared_ptr<FuncDefNode> const &funcdef) {
+#ifdef JIT_X86_64
+  try {
+    FunctionCompiler(funcdef).compile();
+    return true;
+  } catch (Unsupported const &) {
+    return false;
+  }
+#else
+  return false;
+#endif
+}
+
+shared_ptr<ASTNode> Jit::call(shared_ptr<FuncDefNode> const &funcdef,
+                              vector<shared_ptr<ASTNode>> const &args,
+                              bool self_bound) {
+#ifdef JIT_X86_64
+  auto native = static_pointer_cast<NativeFunction>(funcdef->jit_code);
+
+  if (native == nullptr) {
+    if (++funcdef->call_count < threshold)
+      return nullptr;
+
+    native = compile(funcdef);
+    funcdef->jit_code = native;
+
+    if (native->entry != nullptr)
+      compiled_functions++;
+  }
+
+  // native self calls skip the name lookup
+  if (native->entry == nullptr || (native->self_calls && !self_bound))
+    return nullptr;
+
+  arguments.resize(args.size());
+
+  for (size_t i = 0; i < args.size(); i++) {
+    if (args[i]->node_type != LEAF ||
+        !read_number(*args[i]->head, arguments[i]))
+      return nullptr;
+  }
+
+  if (!native->self_calls)
+    return box(native->entry(arguments.data(), nullptr), funcdef->head->span);
+
+  // a deep recursion stops at the end of the stack like an interpreted one
+  std::jmp_buf exit;
+  overflow_exit = &exit;
+  if (setjmp(exit) != 0)
+    throw StackOverflowError(funcdef->head->span);
+
+  return box(native->entry(arguments.data(), Stack::end()),
+             funcdef->head->span);
+#else
+  return nullptr;
+#endif
+}
+
+size_t Jit::compiled() const { return compiled_functions; }
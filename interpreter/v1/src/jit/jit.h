@@ -0,0 +1,51 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "../parser/ast.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+using namespace flang;
+
+namespace jit {
+
+// a number as passed between compiled code and the interpreter. the tag is
+// the token type of the value (INT or REAL), returned in xmm0:rax
+struct JitValue {
+  double value;
+  int64_t tag;
+};
+
+// template jit for numeric functions. a function is compiled to x86-64 once
+// it was called threshold times; calls whose arguments are not plain numbers
+// keep running in the interpreter
+class Jit {
+public:
+  Jit(unsigned threshold = 20);
+
+  // false on hosts the code generator does not target
+  static bool available();
+
+  // whether the function body lies in the compiled subset: numeric params
+  // and locals, arithmetic, comparisons, cond, while, setq and self calls
+  static bool supports(shared_ptr<FuncDefNode> const &funcdef);
+
+  // counts a call of funcdef and runs it natively once hot. self_bound tells
+  // whether the function name still resolves to funcdef. returns nullptr if
+  // the interpreter has to evaluate the call
+  shared_ptr<ASTNode> call(shared_ptr<FuncDefNode> const &funcdef,
+                           vector<shared_ptr<ASTNode>> const &args,
+                           bool self_bound);
+
+  size_t compiled() const;
+
+private:
+  unsigned threshold;
+  size_t compiled_functions;
+  vector<JitValue> arguments; // reused, compiled code does not reenter
+};
+
+} // namespace jit
+
+#endif
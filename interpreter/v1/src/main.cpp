@@ -1,16 +1,22 @@
-#include "interpreter/interpeter.h"
+#include "engine/engine.h"
+#include "engine/runner.h"
+#include "jit/jit.h"
 #include "parser/ast.h"
-#include "parser/driver.hh"
-#include "semantic/semantic_analyzer.h"
+#include "server/server.h"
+#include "utils/simd.h"
 #include "utils/utils.h"
-#include <graphviz/gvc.h>
+#include <charconv>
+#include <cstring>
 #include <iostream>
+#include <limits>
 #include <locale.h>
 #include <termios.h>
+#include <thread>
 #include <unistd.h>
 #include <wchar.h>
 
-using interp::Interpreter;
+using flang::Engine;
+using flang::Reports;
 
 wint_t mygetwch() {
   // Save the current terminal details
@@ -33,143 +39,311 @@ wint_t mygetwch() {
   return wc;
 }
 
-int main(int argc, char *argv[]) {
-  int res = 0;
-  Driver drv;
-  SemanticAnalyzer semantic_analyzer;
-  Interpreter interpreter;
+// on stderr, so what a program prints stays its own
+void report_memory(size_t peak) {
+  std::cerr << "Peak memory usage: " << peak << " bytes" << '\n';
+}
 
-  for (int i = 1; i < argc; ++i) {
-    if (argv[i] == std::string("-p"))
-      drv.trace_parsing = true;
-    else if (argv[i] == std::string("-s"))
-      drv.trace_scanning = true;
-    else if (argv[i] == std::string("-repl")) {
-      std::wcout << "Flang REPL 0.0.1" << '\n';
-      std::wcout << "Type \"exit\" to exit" << '\n';
-      vector<std::string> history;
-      int current_history = 0;
-      int cell = 0;
-
-      setlocale(LC_ALL, "");
-
-      while (true) {
-        std::wcout << "\033[93m[" << cell++ << "]>\033[0m ";
-        fflush(stdout);
-        cout.flush();
-        std::string input;
-
-        while (1) {
-          wint_t c = mygetwch();
-          if (c == WEOF)
-            break;
-
-          else if (c == L'\n') {
-            wprintf(L"\n");
-            break;
-          }
+// reads a whole decimal number into value, leaves it as it is on anything
+// else
+bool read_size(char const *text, size_t &value) {
+  char const *end = text + strlen(text);
+  auto res = std::from_chars(text, end, value);
+  return res.ec == std::errc() && res.ptr == end && res.ptr != text;
+}
 
-          // if arrow up pressed and history is not empty
-          else if (c == L'\033') {
-            mygetwch(); // skip [
-            switch (mygetwch()) {
-            case 'A':
-              if (history.size() > 0 && current_history > 0) {
-                --current_history;
-                // remove current input
-                for (int i = 0; i < input.size(); ++i)
-                  wprintf(L"\b \b");
-                std::wcout << history[current_history].c_str();
-                input = history[current_history];
-              }
-              break;
-
-            case 'B':
-              if (history.size() > 0 && current_history < history.size() - 1) {
-                ++current_history;
-                // remove current input
-                for (int i = 0; i < input.size(); ++i)
-                  wprintf(L"\b \b");
-                std::wcout << history[current_history].c_str();
-                input = history[current_history];
-              } else if (current_history == history.size() - 1) {
-                ++current_history;
-                // remove current input
-                for (int i = 0; i < input.size(); ++i)
-                  wprintf(L"\b \b");
-                input = "";
-              }
-              break;
-            }
-          }
+// reads a whole decimal number from 1 up to the largest unsigned into value,
+// leaves it as it is on anything else
+bool read_count(char const *text, unsigned &value) {
+  size_t count;
+  if (!read_size(text, count) || count == 0 ||
+      count > std::numeric_limits<unsigned>::max())
+    return false;
 
-          // if \ pressed
-          else if (c == 92) {
-            wprintf(L"\n");
-            input += '\n';
-          }
+  value = count;
+  return true;
+}
 
-          // if ctrl + c pressed
-          else if (c == 3) {
-            wprintf(L"Bye\n");
-            remove("tmp.flang");
-            return 0;
-          }
+// reads a number of seconds up to a billion into limit, leaves it as it is on
+// anything else. deadlines further away would not fit the clock
+bool read_seconds(char const *text, std::chrono::milliseconds &limit) {
+  char const *end = text + strlen(text);
+  double seconds;
+  auto res = std::from_chars(text, end, seconds);
+  if (res.ec != std::errc() || res.ptr != end || res.ptr == text ||
+      !(seconds >= 0 && seconds <= 1e9))
+    return false;
+
+  limit = std::chrono::milliseconds(static_cast<long long>(seconds * 1000));
+  return true;
+}
+
+// reads cells from the terminal and runs them on the engine until "exit" or
+// ctrl + c
+int repl(Engine &engine, Engine::Options &settings) {
+  std::wcout << "Flang REPL 0.0.1" << '\n';
+  std::wcout << "Type \"exit\" to exit" << '\n';
+  vector<std::string> history;
+  int current_history = 0;
+  int cell = 0;
+
+  // cells share their bindings, no cell sees the whole program
+  settings.infer_types = false;
+  engine.set_type_inference(false);
+
+  setlocale(LC_ALL, "");
 
-          // if backspace pressed
-          else if (c == 127) {
-            if (input.size() > 0) {
-              input.pop_back();
+  while (true) {
+    std::wcout << "\033[93m[" << cell++ << "]>\033[0m ";
+    fflush(stdout);
+    cout.flush();
+    std::string input;
+
+    while (1) {
+      wint_t c = mygetwch();
+      if (c == WEOF)
+        break;
+
+      else if (c == L'\n') {
+        wprintf(L"\n");
+        break;
+      }
+
+      // if arrow up pressed and history is not empty
+      else if (c == L'\033') {
+        mygetwch(); // skip [
+        switch (mygetwch()) {
+        case 'A':
+          if (history.size() > 0 && current_history > 0) {
+            --current_history;
+            // remove current input
+            for (int i = 0; i < input.size(); ++i)
               wprintf(L"\b \b");
-            }
-          } else {
+            std::wcout << history[current_history].c_str();
+            input = history[current_history];
+          }
+          break;
 
-            input += c;
-            wprintf(L"%lc", c);
+        case 'B':
+          if (history.size() > 0 && current_history < history.size() - 1) {
+            ++current_history;
+            // remove current input
+            for (int i = 0; i < input.size(); ++i)
+              wprintf(L"\b \b");
+            std::wcout << history[current_history].c_str();
+            input = history[current_history];
+          } else if (current_history == history.size() - 1) {
+            ++current_history;
+            // remove current input
+            for (int i = 0; i < input.size(); ++i)
+              wprintf(L"\b \b");
+            input = "";
           }
+          break;
         }
+      }
+
+      // if \ pressed
+      else if (c == 92) {
+        wprintf(L"\n");
+        input += '\n';
+      }
 
-        if (input == "exit") {
-          std::wcout << "Bye" << '\n';
-          remove("tmp.flang");
-          return 0;
+      // if ctrl + c pressed
+      else if (c == 3) {
+        wprintf(L"Bye\n");
+        report_memory(engine.peak_memory());
+        return 0;
+      }
+
+      // if backspace pressed
+      else if (c == 127) {
+        if (input.size() > 0) {
+          input.pop_back();
+          wprintf(L"\b \b");
         }
+      } else {
 
-        if (input == "")
-          continue;
+        input += c;
+        wprintf(L"%lc", c);
+      }
+    }
 
-        history.push_back(input);
-        current_history = history.size();
+    if (input == "exit") {
+      std::wcout << "Bye" << '\n';
+      report_memory(engine.peak_memory());
+      return 0;
+    }
 
-        FILE *tmp = fopen("tmp.flang", "w");
-        fprintf(tmp, "%s", input.c_str());
-        fclose(tmp);
+    if (input == "")
+      continue;
 
-        try {
-          if (drv.parse("tmp.flang")) {
-            throw std::runtime_error("Parsing failed");
-          }
+    history.push_back(input);
+    current_history = history.size();
 
-          semantic_analyzer.analyze(drv.ast);
-          generate_graph_svg(drv.ast, "repl.svg");
-          interpreter.interpret(drv.ast);
-        } catch (std::exception &e) {
-          std::wcout << e.what() << '\n';
-          semantic_analyzer.clear_stack(drv.ast);
+    shared_ptr<ASTNode> ast;
+
+    try {
+      ast = engine.parse(input);
+      engine.analyze(ast);
+      generate_graph_svg(ast, "repl.svg");
+      engine.run(ast);
+    } catch (std::exception &e) {
+      std::wcout << e.what() << '\n';
+      engine.clear_stack(ast);
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int res = 0;
+  Reports reports;
+
+  // the files given are whole programs
+  Engine::Options settings;
+  settings.infer_types = true;
+  Engine engine(settings);
+
+  // files after --jobs or --isolated are run together at the end, then the
+  // manifests of --batch. with --serve the files before it are the modules
+  // every session starts with
+  vector<std::string> files;
+  vector<std::string> manifests;
+  unsigned jobs = 0;
+  bool isolated = false;
+  size_t isolated_peak = 0;
+  std::string socket_path;
+
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i] == std::string("-p")) {
+      settings.trace_parsing = true;
+      engine.set_options(settings);
+    } else if (argv[i] == std::string("-s")) {
+      settings.trace_scanning = true;
+      engine.set_options(settings);
+    } else if (argv[i] == std::string("--types"))
+      reports.types = true;
+    else if (argv[i] == std::string("--opt-report"))
+      reports.optimizations = true;
+    else if (argv[i] == std::string("--memoize-pure")) {
+      settings.memoize_pure = true;
+      engine.set_options(settings);
+    } else if (argv[i] == std::string("--simd")) {
+      std::string level = i + 1 < argc ? argv[++i] : "";
+      if (level == "scalar")
+        simd::limit(simd::SCALAR);
+      else if (level == "sse2")
+        simd::limit(simd::SSE2);
+      else if (level == "avx2")
+        simd::limit(simd::AVX2);
+      else {
+        std::cerr << "Usage: --simd scalar|sse2|avx2" << '\n';
+        return 1;
+      }
+    } else if (argv[i] == std::string("--threads")) {
+      if (i + 1 == argc || !read_count(argv[i + 1], settings.threads)) {
+        std::cerr << "Usage: --threads <count>" << '\n';
+        return 1;
+      }
+      i++;
+      engine.set_options(settings);
+    } else if (argv[i] == std::string("--memory-limit")) {
+      if (i + 1 == argc || !read_size(argv[i + 1], settings.memory_limit)) {
+        std::cerr << "Usage: --memory-limit <bytes>" << '\n';
+        return 1;
+      }
+      i++;
+      engine.set_options(settings);
+    } else if (argv[i] == std::string("--max-depth")) {
+      if (i + 1 == argc || !read_size(argv[i + 1], settings.depth_limit)) {
+        std::cerr << "Usage: --max-depth <calls>" << '\n';
+        return 1;
+      }
+      i++;
+      engine.set_options(settings);
+    } else if (argv[i] == std::string("--jobs")) {
+      if (i + 1 == argc || !read_count(argv[i + 1], jobs)) {
+        std::cerr << "Usage: --jobs <count>" << '\n';
+        return 1;
+      }
+      i++;
+    } else if (argv[i] == std::string("--isolated"))
+      isolated = true;
+    else if (argv[i] == std::string("--batch") && i + 1 < argc)
+      manifests.push_back(argv[++i]);
+    else if (argv[i] == std::string("--serve") && i + 1 < argc)
+      socket_path = argv[++i];
+    else if (argv[i] == std::string("--timeout")) {
+      if (i + 1 == argc || !read_seconds(argv[i + 1], settings.time_limit)) {
+        std::cerr << "Usage: --timeout <seconds>" << '\n';
+        return 1;
+      }
+      i++;
+      engine.set_options(settings);
+    } else if (argv[i] == std::string("--jit") ||
+               argv[i] == std::string("--jit-threshold")) {
+      unsigned threshold = 20;
+      if (argv[i] == std::string("--jit-threshold")) {
+        if (i + 1 == argc || !read_count(argv[i + 1], threshold)) {
+          std::cerr << "Usage: --jit-threshold <calls>" << '\n';
+          return 1;
         }
+        i++;
+      }
+
+      if (jit::Jit::available()) {
+        settings.jit_threshold = threshold;
+        engine.set_options(settings);
+      } else
+        std::cout << "JIT is not supported on this platform" << '\n';
+    } else if (argv[i] == std::string("-repl"))
+      return repl(engine, settings);
+    else if (jobs > 1 || isolated)
+      files.push_back(argv[i]);
+    else {
+      shared_ptr<ASTNode> ast;
+
+      try {
+        ast = engine.parse_file(argv[i]);
+      } catch (flang::ParseError &) {
+        res = 1;
+        continue;
+      } catch (flang::FileError &e) {
+        std::cerr << e.what() << '\n';
+        res = 1;
+        continue;
+      }
+
+      try {
+        flang::run_program(ast, engine, reports);
+      } catch (std::exception &e) {
+        std::cout << std::flush;
+        std::cerr << e.what() << '\n';
+        report_memory(engine.peak_memory());
+        return 1;
       }
-    } else if (!drv.parse(argv[i])) {
-      std::cout << "Parsing successful" << '\n';
-      generate_graph_svg(drv.ast, "after_parsing.svg");
-      semantic_analyzer.analyze(drv.ast);
-      std::cout << "Semantic analysis successful" << '\n';
-      generate_graph_svg(drv.ast);
-      std::cout << "Graphviz file generated" << '\n';
-      interpreter.interpret(drv.ast);
-      std::cout << '\n';
-      std::cout << "Done" << '\n';
-    } else
-      res = 1;
+    }
   }
+
+  if (jobs == 0)
+    jobs = std::max(1u, std::thread::hardware_concurrency());
+
+  if (!files.empty())
+    res |= flang::run_files(files, jobs, isolated, reports, engine,
+                            isolated_peak);
+
+  // the report of a batch is all it prints
+  if (!manifests.empty()) {
+    for (auto const &manifest : manifests)
+      res |= flang::run_batch(manifest, jobs, settings);
+    return res;
+  }
+
+  if (!socket_path.empty()) {
+    Server server(engine);
+    return server.serve(socket_path);
+  }
+
+  report_memory(std::max(engine.peak_memory(), isolated_peak));
   return res;
 }
@@ -1,4 +1,6 @@
 #include "ast.h"
+#include <climits>
+#include <cmath>
 
 using namespace flang;
 
@@ -24,12 +26,13 @@ ASTNode::~ASTNode() {
 }
 
 shared_ptr<ASTNode> ASTNode::copy() {
-  vector<shared_ptr<ASTNode>> children_copy;
-  for (auto child : children) {
-    children_copy.push_back(child->copy());
-  }
+  auto node = make_shared<ASTNode>(node_type, head, children);
+  node->inferred = inferred;
+  return node;
+}
 
-  return make_shared<ASTNode>(node_type, head, children_copy);
+bool ASTNode::proven(unsigned types) const {
+  return inferred != 0 && (inferred & ~types) == 0;
 }
 
 bool ASTNode::calculable() {
@@ -110,6 +113,13 @@ void ASTNode::print(shared_ptr<Agraph_t> const &graph) {
       break;
     }
 
+    case PARALLEL: {
+      child->print(graph);
+      agedge(graph.get(), graph_node.get(), child->graph_node.get(), NULL,
+             TRUE);
+      break;
+    }
+
     case SETQ: {
       shared_ptr<SetqNode> setq = static_pointer_cast<SetqNode>(child);
       setq->print(graph);
@@ -166,13 +176,13 @@ void FuncDefNode::setParams(shared_ptr<ASTNode> const &params) {
 }
 
 shared_ptr<ASTNode> FuncDefNode::copy() {
-  vector<shared_ptr<ASTNode>> children_copy;
-  for (auto child : children) {
-    children_copy.push_back(child->copy());
-  }
-
-  return make_shared<FuncDefNode>(head, children_copy, is_recursive,
-                                  is_tail_recursive);
+  auto node = make_shared<FuncDefNode>(head, children, is_recursive,
+                                       is_tail_recursive);
+  node->inferred = inferred;
+  node->is_inlined = is_inlined;
+  node->effect = effect;
+  node->memoized = memoized;
+  return node;
 }
 
 void FuncDefNode::print(shared_ptr<Agraph_t> const &graph) {
@@ -222,12 +232,10 @@ void FuncCallNode::setArgs(vector<shared_ptr<ASTNode>> const &args) {
 }
 
 shared_ptr<ASTNode> FuncCallNode::copy() {
-  vector<shared_ptr<ASTNode>> children_copy;
-  for (auto child : children) {
-    children_copy.push_back(child->copy());
-  }
-
-  return make_shared<FuncCallNode>(head, children_copy);
+  auto node = make_shared<FuncCallNode>(head, children);
+  node->inferred = inferred;
+  node->scoped = scoped;
+  return node;
 }
 
 void FuncCallNode::print(shared_ptr<Agraph_t> const &graph) {
@@ -261,12 +269,9 @@ void LambdaNode::setParams(shared_ptr<ASTNode> const &params) {
 }
 
 shared_ptr<ASTNode> LambdaNode::copy() {
-  vector<shared_ptr<ASTNode>> children_copy;
-  for (auto child : children) {
-    children_copy.push_back(child->copy());
-  }
-
-  return make_shared<LambdaNode>(head, children_copy);
+  auto node = make_shared<LambdaNode>(head, children);
+  node->inferred = inferred;
+  return node;
 }
 
 void LambdaNode::print(shared_ptr<Agraph_t> const &graph) {
@@ -299,12 +304,11 @@ ListNode::ListNode(bool is_quote, vector<shared_ptr<ASTNode>> const &children)
 }
 
 shared_ptr<ASTNode> ListNode::copy() {
-  vector<shared_ptr<ASTNode>> children_copy;
-  for (auto child : children) {
-    children_copy.push_back(child->copy());
-  }
-
-  return make_shared<ListNode>(children_copy);
+  auto node = make_shared<ListNode>(children);
+  node->inferred = inferred;
+  node->is_constant = is_constant;
+  node->scoped = scoped;
+  return node;
 }
 
 void ListNode::print(shared_ptr<Agraph_t> const &graph) {
@@ -331,12 +335,9 @@ void ReturnNode::setValue(shared_ptr<ASTNode> const &value) {
 }
 
 shared_ptr<ASTNode> ReturnNode::copy() {
-  vector<shared_ptr<ASTNode>> children_copy;
-  for (auto child : children) {
-    children_copy.push_back(child->copy());
-  }
-
-  return make_shared<ReturnNode>(head, children_copy);
+  auto node = make_shared<ReturnNode>(head, children);
+  node->inferred = inferred;
+  return node;
 }
 
 void ReturnNode::print(shared_ptr<Agraph_t> const &graph) {
@@ -367,12 +368,9 @@ shared_ptr<ASTNode> CondNode::getBranchFalse() {
 }
 
 shared_ptr<ASTNode> CondNode::copy() {
-  vector<shared_ptr<ASTNode>> children_copy;
-  for (auto child : children) {
-    children_copy.push_back(child->copy());
-  }
-
-  return make_shared<CondNode>(head, children_copy);
+  auto node = make_shared<CondNode>(head, children);
+  node->inferred = inferred;
+  return node;
 }
 
 void CondNode::print(shared_ptr<Agraph_t> const &graph) {
@@ -415,12 +413,10 @@ void WhileNode::setBody(shared_ptr<ASTNode> const &body) { children[1] = body; }
 void WhileNode::setCond(shared_ptr<ASTNode> const &cond) { children[0] = cond; }
 
 shared_ptr<ASTNode> WhileNode::copy() {
-  vector<shared_ptr<ASTNode>> children_copy;
-  for (auto child : children) {
-    children_copy.push_back(child->copy());
-  }
-
-  return make_shared<WhileNode>(head, children_copy);
+  auto node = make_shared<WhileNode>(head, children);
+  node->inferred = inferred;
+  node->counted = counted;
+  return node;
 }
 
 void WhileNode::print(shared_ptr<Agraph_t> const &graph) {
@@ -453,12 +449,9 @@ ProgNode::ProgNode(shared_ptr<Token> const &head,
 shared_ptr<ASTNode> ProgNode::getLocals() { return children[0]; }
 
 shared_ptr<ASTNode> ProgNode::copy() {
-  vector<shared_ptr<ASTNode>> children_copy;
-  for (auto child : children) {
-    children_copy.push_back(child->copy());
-  }
-
-  return make_shared<ProgNode>(head, children_copy, is_inlined);
+  auto node = make_shared<ProgNode>(head, children, is_inlined);
+  node->inferred = inferred;
+  return node;
 }
 
 void ProgNode::print(shared_ptr<Agraph_t> const &graph) {
@@ -482,6 +475,31 @@ void ProgNode::print(shared_ptr<Agraph_t> const &graph) {
   }
 }
 
+ParallelNode::ParallelNode() {}
+
+ParallelNode::ParallelNode(shared_ptr<Token> const &head,
+                           vector<shared_ptr<ASTNode>> const &children)
+    : ASTNode(PARALLEL, head, children) {}
+
+shared_ptr<ASTNode> ParallelNode::copy() {
+  auto node = make_shared<ParallelNode>(head, children);
+  node->inferred = inferred;
+  node->serial = serial;
+  return node;
+}
+
+void ParallelNode::print(shared_ptr<Agraph_t> const &graph) {
+  this->graph_node = shared_ptr<Agnode_t>(agnode(graph.get(), NULL, TRUE));
+  string serial = this->serial ? "serial" : "";
+  string label = "ParallelNode\n" + serial;
+  agsafeset(graph_node.get(), (char *)"label", label.c_str(), (char *)"");
+
+  for (auto const &child : children) {
+    child->print(graph);
+    agedge(graph.get(), graph_node.get(), child->graph_node.get(), NULL, TRUE);
+  }
+}
+
 SetqNode::SetqNode() {}
 
 SetqNode::SetqNode(shared_ptr<Token> const &head,
@@ -500,12 +518,9 @@ void SetqNode::setValue(shared_ptr<ASTNode> const &value) {
 }
 
 shared_ptr<ASTNode> SetqNode::copy() {
-  vector<shared_ptr<ASTNode>> children_copy;
-  for (auto child : children) {
-    children_copy.push_back(child->copy());
-  }
-
-  return make_shared<SetqNode>(head, children_copy);
+  auto node = make_shared<SetqNode>(head, children);
+  node->inferred = inferred;
+  return node;
 }
 
 void SetqNode::print(shared_ptr<Agraph_t> const &graph) {
@@ -520,6 +535,70 @@ void SetqNode::print(shared_ptr<Agraph_t> const &graph) {
   agsafeset(e, (char *)"label", "value", (char *)"");
 }
 
+VectorNode::VectorNode(Span span, vector<int64_t> ints)
+    : ASTNode(VECTOR, make_shared<Token>(LITERAL, "vec", span)),
+      is_real(false), ints(std::move(ints)) {}
+
+VectorNode::VectorNode(Span span, vector<double> reals)
+    : ASTNode(VECTOR, make_shared<Token>(LITERAL, "vec", span)),
+      is_real(true), reals(std::move(reals)) {}
+
+size_t VectorNode::size() const { return is_real ? reals.size() : ints.size(); }
+
+// reals print like the results of the arithmetic builtins, as ints when
+// they have no fraction
+string VectorNode::text(size_t i) const {
+  if (!is_real)
+    return to_string(ints[i]);
+
+  double intpart;
+  if (modf(reals[i], &intpart) == 0.0 && reals[i] >= INT_MIN &&
+      reals[i] <= INT_MAX)
+    return to_string((int)reals[i]);
+
+  return to_string(reals[i]);
+}
+
+shared_ptr<ASTNode> VectorNode::copy() {
+  auto node = is_real ? make_shared<VectorNode>(head->span, reals)
+                      : make_shared<VectorNode>(head->span, ints);
+  node->inferred = inferred;
+  return node;
+}
+
+StreamNode::StreamNode(Span span, Kind kind, shared_ptr<ASTNode> first,
+                       shared_ptr<ASTNode> function,
+                       shared_ptr<ASTNode> source, long long count)
+    : ASTNode(STREAM, make_shared<Token>(LITERAL, "<stream>", span)),
+      first(std::move(first)), kind(kind), count(count),
+      function(std::move(function)), source(std::move(source)) {}
+
+StreamNode::~StreamNode() {
+  auto next = std::move(rest);
+
+  while (next != nullptr && next->node_type == STREAM &&
+         next.use_count() == 1) {
+    auto cell = static_pointer_cast<StreamNode>(next);
+    next = std::move(cell->rest);
+  }
+}
+
+shared_ptr<ASTNode> StreamNode::copy() {
+  std::lock_guard<std::mutex> guard(lock);
+  auto node = make_shared<StreamNode>(head->span, kind, first, function,
+                                      source, count);
+  node->step = step;
+  node->rest = rest;
+  node->inferred = inferred;
+  return node;
+}
+
+void VectorNode::print(shared_ptr<Agraph_t> const &graph) {
+  this->graph_node = shared_ptr<Agnode_t>(agnode(graph.get(), NULL, TRUE));
+  string label = "VectorNode\n" + to_string(size());
+  agsafeset(graph_node.get(), (char *)"label", label.c_str(), (char *)"");
+}
+
 shared_ptr<Token> flang::calculate(vector<shared_ptr<ASTNode>> const &args,
                                    string const &op) {
   double result;
@@ -563,6 +642,17 @@ shared_ptr<Token> flang::calculate(vector<shared_ptr<ASTNode>> const &args,
   }
 }
 
+shared_ptr<ASTNode> flang::clone(shared_ptr<ASTNode> const &node) {
+  auto res = node->copy();
+  res->node_type = node->node_type;
+
+  for (auto &child : res->children) {
+    child = clone(child);
+  }
+
+  return res;
+}
+
 wostream &flang::operator<<(wostream &os, const Token &token) {
   os << token.value.c_str();
   return os;
@@ -630,3 +720,14 @@ wostream &flang::operator<<(wostream &os, const SetqNode &node) {
   os << "<setq>";
   return os;
 }
+
+wostream &flang::operator<<(wostream &os, const VectorNode &node) {
+  os << "#(";
+  for (size_t i = 0; i < node.size(); i++) {
+    os << node.text(i).c_str();
+    if (i != node.size() - 1)
+      os << " ";
+  }
+  os << ")";
+  return os;
+}
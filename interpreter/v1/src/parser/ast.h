@@ -3,8 +3,10 @@
 
 #include <graphviz/cgraph.h>
 #include <graphviz/gvc.h>
+#include <cstdint>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -42,6 +44,27 @@ enum ASTNodeType {
   PROG,
   SETQ,
   LEAF,
+  VECTOR,
+  CHANNEL,
+  FUTURE,
+  PARALLEL,
+  STREAM,
+  DICT,
+};
+
+// value types an expression can evaluate to, as a set. filled by the type
+// inference pass in semantic/type_inference.cpp
+enum ValueType : unsigned {
+  TYPE_INT = 1,
+  TYPE_REAL = 2,
+  TYPE_BOOL = 4,
+  TYPE_NULL = 8,
+  TYPE_LIST = 16,
+  TYPE_FUNCTION = 32,
+  TYPE_ATOM = 64, // chars, literals and unbound names
+  TYPE_VECTOR = 128,
+  TYPE_NUMBER = TYPE_INT | TYPE_REAL,
+  TYPE_ANY = 255,
 };
 
 class ASTNode {
@@ -50,6 +73,10 @@ public:
   shared_ptr<Token> head;
   vector<shared_ptr<ASTNode>> children;
   ASTNodeType node_type;
+  unsigned inferred = TYPE_ANY; // set of ValueType
+
+  // whether the node always evaluates to one of the given types
+  bool proven(unsigned types) const;
 
   ASTNode();
 
@@ -62,14 +89,27 @@ public:
 
   virtual ~ASTNode();
   virtual void print(shared_ptr<Agraph_t> const &graph);
+
+  // copy on write: the copy shares its children with the original, so a
+  // child has to be copied itself before it is modified in place. what the
+  // analysis passes found about the node is kept
   virtual shared_ptr<ASTNode> copy();
 };
 
+// what a call of a function can do besides computing its result, found by
+// semantic/effect_analysis.cpp. a function has the largest of its own effect
+// and the effects of the functions it calls
+enum Effect { PURE, READS_GLOBALS, EFFECTFUL };
+
 class FuncDefNode : public ASTNode {
 public:
   bool is_recursive;
   bool is_inlined = false;
   bool is_tail_recursive;
+  Effect effect = EFFECTFUL;
+  bool memoized = false; // results cached by the interpreter, see (memo f)
+  unsigned call_count = 0; // runtime calls, counted by the jit
+  shared_ptr<void> jit_code; // owned native code, see jit/jit.cpp
   shared_ptr<Token> getName();
   shared_ptr<ASTNode> getBody();
   shared_ptr<ASTNode> getParams();
@@ -88,8 +128,31 @@ public:
   shared_ptr<ASTNode> copy() override;
 };
 
+typedef shared_ptr<ASTNode> (*BuiltinFunction)(vector<shared_ptr<ASTNode>> &);
+
+// inline cache of a call site, filled by the interpreter. a closure entry is
+// valid while the binding version of the called name is unchanged
+struct CallCache {
+  enum Kind { EMPTY, BUILTIN, CLOSURE };
+
+  Kind kind = EMPTY;
+  BuiltinFunction builtin = nullptr;
+  shared_ptr<ASTNode> target;
+  size_t arity = 0;
+  unsigned const *version = nullptr;
+  unsigned resolved_version = 0;
+
+  // specialized builtin for int arguments, returns nullptr on other types
+  BuiltinFunction quickened = nullptr;
+  unsigned observed = 0; // consecutive calls with int arguments
+  unsigned deopts = 0;
+};
+
 class FuncCallNode : public ASTNode {
 public:
+  CallCache cache;
+  bool scoped = false; // a list result that does not escape its call
+
   shared_ptr<Token> getName();
   vector<shared_ptr<ASTNode>> getArgs();
 
@@ -124,6 +187,9 @@ public:
 
 class ListNode : public ASTNode {
 public:
+  bool is_constant = false; // pooled, evaluates to itself
+  bool scoped = false;      // does not escape its call, see escape_analysis
+
   ListNode();
   ListNode(vector<shared_ptr<ASTNode>> const &children);
   ListNode(bool is_quote, vector<shared_ptr<ASTNode>> const &children);
@@ -164,8 +230,24 @@ public:
   shared_ptr<ASTNode> copy() override;
 };
 
+// a while stepping an int counter by a constant until it passes a bound,
+// found by semantic/induction_variables.cpp. the interpreter compares and
+// steps the counter natively while it and the bound hold ints
+struct CountedLoop {
+  enum Comparison { LESS, LESSEQ, GREATER, GREATEREQ };
+
+  Comparison comparison;
+  shared_ptr<ASTNode> counter;   // leaf naming the counter
+  shared_ptr<ASTNode> bound;     // int literal or name
+  shared_ptr<ASTNode> increment; // setq of the counter ending the body
+  long long step;
+  bool step_first; // (plus step i), the step's span is the result's
+};
+
 class WhileNode : public ASTNode {
 public:
+  shared_ptr<CountedLoop> counted; // null unless a counted loop
+
   shared_ptr<ASTNode> getBody();
   shared_ptr<ASTNode> getCond();
 
@@ -212,9 +294,85 @@ public:
   shared_ptr<ASTNode> copy() override;
 };
 
+// (parallel e1 e2 ...), evaluates to the list of the values of its
+// branches. they run at once unless serial: only the effect analysis in
+// semantic/effect_analysis.cpp proves that no branch assigns a binding
+// outside of it or calls a function that could
+class ParallelNode : public ASTNode {
+public:
+  bool serial = true;
+
+  ParallelNode();
+  ParallelNode(shared_ptr<Token> const &head,
+               vector<shared_ptr<ASTNode>> const &children);
+
+  void print(shared_ptr<Agraph_t> const &graph) override;
+  shared_ptr<ASTNode> copy() override;
+};
+
+// a packed vector of numbers made by the vec builtins, all ints or all
+// reals. only ever a value, the parser never makes one
+class VectorNode : public ASTNode {
+public:
+  bool is_real;
+  vector<int64_t> ints;
+  vector<double> reals;
+
+  VectorNode(Span span, vector<int64_t> ints);
+  VectorNode(Span span, vector<double> reals);
+
+  size_t size() const;
+  string text(size_t i) const; // element i as the number literal it prints as
+
+  void print(shared_ptr<Agraph_t> const &graph) override;
+  shared_ptr<ASTNode> copy() override;
+};
+
+// a cell of a lazy list made by the stream builtins, only ever a value.
+// first is computed when the cell is made, the rest on the first tail of
+// it and then kept. kind tells how, see Interpreter::stream_rest
+class StreamNode : public ASTNode {
+public:
+  enum Kind {
+    THUNK,   // rest is (function)
+    ITERATE, // a cell of (function first)
+    MAP,     // the rest of source, mapped by function
+    FILTER,  // the rest of source, filtered by function
+    TAKE,    // count items of the rest of source
+    COPY,    // a copy of the rest of source, made for another interpreter
+    RANGE,   // count more ints, each step past first. rest is never kept
+  };
+
+  shared_ptr<ASTNode> first;
+  Kind kind;
+  long long count = 0;
+  long long step = 0;
+
+  // guarded by lock. rest is a stream or a list, the fields after it are
+  // dropped once it is set
+  std::mutex lock;
+  shared_ptr<ASTNode> rest;
+  shared_ptr<ASTNode> function;
+  shared_ptr<ASTNode> source; // a cell
+
+  StreamNode(Span span, Kind kind, shared_ptr<ASTNode> first,
+             shared_ptr<ASTNode> function,
+             shared_ptr<ASTNode> source = nullptr, long long count = 0);
+
+  // frees a long chain of forced cells without recursing along it
+  ~StreamNode() override;
+
+  shared_ptr<ASTNode> copy() override;
+};
+
 shared_ptr<Token> calculate(vector<shared_ptr<ASTNode>> const &args,
                             string const &op);
 
+// a deep copy that keeps the node type of every node, unlike copy(). it
+// shares nothing the interpreter writes while running it, its call sites
+// start with empty caches
+shared_ptr<ASTNode> clone(shared_ptr<ASTNode> const &node);
+
 // overload cout
 
 wostream &operator<<(wostream &os, const Token &token);
@@ -228,6 +386,7 @@ wostream &operator<<(wostream &os, const CondNode &node);
 wostream &operator<<(wostream &os, const WhileNode &node);
 wostream &operator<<(wostream &os, const ProgNode &node);
 wostream &operator<<(wostream &os, const SetqNode &node);
+wostream &operator<<(wostream &os, const VectorNode &node);
 
 } // namespace flang
 
@@ -5,14 +5,25 @@ Driver::Driver() : trace_scanning(false), trace_parsing(false) {}
 int Driver::parse(const std::string &f) {
   file = f;
   this->ast = nullptr;
-  scan_begin();
-  yy::parser parser(*this);
+  error.clear();
+  location.initialize();
+  if (!scan_begin())
+    return 1;
+
+  yy::parser parser(*this, scanner);
   parser.set_debug_level(trace_parsing);
   int res = parser.parse();
   scan_end();
   return res;
 }
 
+int Driver::parse_source(const std::string &text) {
+  source = &text;
+  int res = parse("");
+  source = nullptr;
+  return res;
+}
+
 void Driver::parse_ast(const std::shared_ptr<flang::ASTNode> &ast) {
   this->ast = ast;
 }
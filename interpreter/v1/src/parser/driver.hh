@@ -5,7 +5,8 @@
 #include <map>
 #include <string>
 
-#define YY_DECL yy::parser::symbol_type yylex(Driver &driver)
+#define YY_DECL                                                                \
+  yy::parser::symbol_type yylex(Driver &driver, yyscan_t yyscanner)
 YY_DECL;
 
 class Driver {
@@ -19,14 +20,24 @@ public:
 
   int parse(const std::string &f);
 
+  // parses source text instead of a file
+  int parse_source(const std::string &text);
+
   std::string file;
+  const std::string *source = nullptr; // scanned instead of file when set
 
   bool trace_parsing;
   bool trace_scanning;
 
-  void scan_begin();
+  // false if the file cannot be opened, with the reason in error
+  bool scan_begin();
   void scan_end();
 
+  std::string error; // of the last parse that could not open its file
+
+  // the state of the scanner while a file is parsed, every driver has its own
+  yyscan_t scanner = nullptr;
+
   yy::location location;
 };
 
@@ -14,11 +14,16 @@
   #include "ast.h"
   class Driver;
 
+  #ifndef YY_TYPEDEF_YY_SCANNER_T
+  #define YY_TYPEDEF_YY_SCANNER_T
+  typedef void *yyscan_t;
+  #endif
+
   using namespace flang;
 
 }
 
-%param { Driver& driver }
+%param { Driver& driver } { yyscan_t scanner }
 
 %locations
 
@@ -32,7 +37,7 @@
 }
 
 %define api.token.prefix {TOK_}
-%token <std::string> SF_BREAK SF_COND SF_FUNC SF_LAMBDA SF_PROG SF_QUOTE SF_RETURN SF_SETQ SF_WHILE
+%token <std::string> SF_BREAK SF_COND SF_FUNC SF_LAMBDA SF_PROG SF_QUOTE SF_RETURN SF_SETQ SF_WHILE SF_PARALLEL
 %token <std::string> IDENTIFIER
 %token <std::string> INT
 %token <std::string> REAL
@@ -54,6 +59,7 @@
 %type <std::shared_ptr<SetqNode>> setq_def
 %type <std::shared_ptr<ProgNode>> prog_def
 %type <std::shared_ptr<CondNode>> cond_def
+%type <std::shared_ptr<ParallelNode>> parallel_def
 
 %type <std::shared_ptr<FuncCallNode>> func_call
 
@@ -258,6 +264,13 @@ cond_def:
       $$ = std::make_shared<CondNode>(t, children);
     } 
 
+parallel_def:
+    "(" SF_PARALLEL elements ")"
+    {
+      std::shared_ptr<Token> t = std::make_shared<Token>(TokenType::KEYWORD, $2, Span({@2.begin.line, @2.begin.column}));
+      $$ = std::make_shared<ParallelNode>(t, $3);
+    }
+
 
 list:
   "(" elements ")" { $$ = std::make_shared<ListNode>($2); }
@@ -292,6 +305,7 @@ stmt:
   | prog_def {$$ = $1;}
   | cond_def {$$ = $1;}
   | setq_def {$$ = $1;}
+  | parallel_def {$$ = $1;}
   | func_call {$$ = $1;}
   ;
 
@@ -305,6 +319,7 @@ sf:
   | SF_PROG { $$ = std::make_shared<Token>(TokenType::KEYWORD, $1, Span({@1.begin.line, @1.begin.column})); }
   | SF_COND { $$ = std::make_shared<Token>(TokenType::KEYWORD, $1, Span({@1.begin.line, @1.begin.column})); }
   | SF_SETQ { $$ = std::make_shared<Token>(TokenType::KEYWORD, $1, Span({@1.begin.line, @1.begin.column})); }
+  | SF_PARALLEL { $$ = std::make_shared<Token>(TokenType::KEYWORD, $1, Span({@1.begin.line, @1.begin.column})); }
   ;
 
 
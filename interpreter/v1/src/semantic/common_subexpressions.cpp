@@ -0,0 +1,453 @@
+#include "common_subexpressions.h"
+
+CommonSubexpressions::CommonSubexpressions() {}
+
+CommonSubexpressions::~CommonSubexpressions() {}
+
+size_t CommonSubexpressions::eliminated() const { return replaced; }
+
+// builtins without side effects whose result only depends on their
+// arguments. lists are never modified in place, so a list result can be
+// shared as well
+static bool is_pure_builtin(string const &name) {
+  static const set<string> builtins = {
+      "plus",   "minus",  "times",  "divide",  "equal",   "nonequal",
+      "less",   "lesseq", "greater", "greatereq", "and",  "or",
+      "not",    "xor",    "isint",  "isreal",  "isbool",  "isnull",
+      "isatom", "islist", "head",   "tail",    "cons",    "isempty"};
+
+  return builtins.find(name) != builtins.end();
+}
+
+// a call of a pure builtin on names, literals and other such calls
+static bool is_pure(shared_ptr<ASTNode> const &node) {
+  if (node->node_type != FUNCCALL || node->children.size() < 2)
+    return false;
+
+  auto const &head = node->children[0];
+  if (head->node_type != LEAF || !is_pure_builtin(head->head->value))
+    return false;
+
+  for (int i = 1; i < node->children.size(); i++) {
+    auto const &arg = node->children[i];
+    if (arg->node_type != LEAF && !is_pure(arg))
+      return false;
+  }
+
+  return true;
+}
+
+// equal keys for equal pure expressions
+static string key_of(shared_ptr<ASTNode> const &node) {
+  if (node->node_type == LEAF)
+    return to_string(node->head->type) + ":" + node->head->value;
+
+  string key = "(" + node->children[0]->head->value;
+  for (int i = 1; i < node->children.size(); i++) {
+    key += " " + key_of(node->children[i]);
+  }
+
+  return key + ")";
+}
+
+static void collect_reads(shared_ptr<ASTNode> const &node, set<string> &reads) {
+  if (node->node_type == LEAF) {
+    if (node->head->type == IDENTIFIER)
+      reads.insert(node->head->value);
+    return;
+  }
+
+  for (int i = 1; i < node->children.size(); i++) {
+    collect_reads(node->children[i], reads);
+  }
+}
+
+// arithmetic and comparisons on proven numbers, the other builtins reject
+// some arguments
+static bool can_fail(shared_ptr<ASTNode> const &call) {
+  auto const &name = call->children[0]->head->value;
+  size_t args = call->children.size() - 1;
+
+  bool arithmetic = name == "plus" || name == "minus" || name == "times" ||
+                    name == "divide";
+  bool comparison = name == "less" || name == "lesseq" ||
+                    name == "greater" || name == "greatereq";
+  if (!arithmetic && !(comparison && args == 2))
+    return true;
+
+  for (int i = 1; i < call->children.size(); i++) {
+    if (!call->children[i]->proven(TYPE_NUMBER))
+      return true;
+  }
+
+  return false;
+}
+
+static bool contains_break(shared_ptr<ASTNode> const &node) {
+  if (node->node_type == BREAK)
+    return true;
+
+  for (auto const &child : node->children) {
+    if (contains_break(child))
+      return true;
+  }
+
+  return false;
+}
+
+static bool intersects(set<string> const &a, set<string> const &b) {
+  for (auto const &name : a) {
+    if (b.find(name) != b.end())
+      return true;
+  }
+
+  return false;
+}
+
+// functions defined by the statement are not run by it, their bodies do
+// not count
+void CommonSubexpressions::collect_effects(shared_ptr<ASTNode> const &node,
+                                           Effects &effects) {
+  switch (node->node_type) {
+  case FUNCDEF:
+    effects.bound.insert(node->children[0]->head->value);
+    return;
+
+  case LAMBDA:
+  case QUOTE_LIST:
+  case LEAF:
+    return;
+
+  case FUNCCALL: {
+    auto const &head = node->children[0];
+    if (head->node_type != LEAF || (!is_pure_builtin(head->head->value) &&
+                                    head->head->value != "println")) {
+      effects.unknown = true;
+      return;
+    }
+    break;
+  }
+
+  case PROG:
+    for (auto const &local : node->children[0]->children) {
+      effects.bound.insert(local->head->value);
+    }
+    break;
+
+  case SETQ:
+    effects.bound.insert(node->children[0]->head->value);
+    break;
+
+  default:
+    break;
+  }
+
+  for (auto const &child : node->children) {
+    collect_effects(child, effects);
+  }
+}
+
+shared_ptr<ASTNode>
+CommonSubexpressions::replace(shared_ptr<ASTNode> const &node,
+                              map<string, Value> const &available) {
+  switch (node->node_type) {
+  case FUNCDEF:
+  case LAMBDA:
+  case QUOTE_LIST:
+  case LEAF:
+    return node;
+
+  default:
+    break;
+  }
+
+  if (!available.empty() && is_pure(node)) {
+    auto value = available.find(key_of(node));
+    if (value != available.end()) {
+      auto leaf = make_shared<ASTNode>(
+          LEAF, make_shared<Token>(IDENTIFIER, value->second.name,
+                                   node->children[0]->head->span));
+      leaf->inferred = node->inferred;
+      replaced++;
+      return leaf;
+    }
+  }
+
+  shared_ptr<ASTNode> res = node;
+  for (int i = 0; i < node->children.size(); i++) {
+    auto child = replace(node->children[i], available);
+    if (child == node->children[i])
+      continue;
+
+    if (res == node)
+      res = node->copy();
+    res->children[i] = child;
+  }
+
+  return res;
+}
+
+size_t CommonSubexpressions::count(shared_ptr<ASTNode> const &node,
+                                   string const &key) {
+  switch (node->node_type) {
+  case FUNCDEF:
+  case LAMBDA:
+  case QUOTE_LIST:
+  case LEAF:
+    return 0;
+
+  default:
+    break;
+  }
+
+  if (is_pure(node) && key_of(node) == key)
+    return 1;
+
+  size_t res = 0;
+  for (auto const &child : node->children) {
+    res += count(child, key);
+  }
+
+  return res;
+}
+
+// uses by the statements after statement i that still see the same value
+size_t
+CommonSubexpressions::count_later(vector<shared_ptr<ASTNode>> const &statements,
+                                  int i, string const &key,
+                                  set<string> const &reads) {
+  size_t res = 0;
+
+  for (int j = i + 1; j < statements.size(); j++) {
+    Effects effects;
+    collect_effects(statements[j], effects);
+    if (effects.unknown || intersects(effects.bound, reads))
+      break;
+
+    res += count(statements[j], key);
+  }
+
+  return res;
+}
+
+// walks the parts of statement i evaluated before anything else could be
+// observed, in evaluation order. a pure call used again is computed into a
+// new local by a setq in front of the statement instead
+shared_ptr<ASTNode> CommonSubexpressions::reuse(
+    shared_ptr<ASTNode> const &node,
+    vector<shared_ptr<ASTNode>> const &statements, int i,
+    Effects const &effects, bool &observed, vector<shared_ptr<ASTNode>> &setqs,
+    map<string, Value> &available) {
+  if (observed || node->node_type == LEAF)
+    return node;
+
+  if (is_pure(node)) {
+    auto key = key_of(node);
+    set<string> reads;
+    collect_reads(node, reads);
+
+    // computed by a setq of this statement already
+    auto value = available.find(key);
+
+    if (value == available.end() && !intersects(effects.bound, reads) &&
+        count(statements[i], key) + count_later(statements, i, key, reads) >=
+            2) {
+      auto name = make_shared<Token>(IDENTIFIER, "_cse" + to_string(++counter),
+                                     node->children[0]->head->span);
+
+      setqs.push_back(make_shared<SetqNode>(
+          make_shared<Token>(IDENTIFIER, "setq", name->span),
+          vector<shared_ptr<ASTNode>>{make_shared<ASTNode>(LEAF, name),
+                                      node}));
+      value = available.emplace(key, Value{name->value, reads}).first;
+    }
+
+    if (value != available.end()) {
+      auto leaf = make_shared<ASTNode>(
+          LEAF, make_shared<Token>(IDENTIFIER, value->second.name,
+                                   node->children[0]->head->span));
+      leaf->inferred = node->inferred;
+      replaced++;
+      return leaf;
+    }
+  }
+
+  // anything else could print or fail before the rest is evaluated
+  if (node->node_type != FUNCCALL || node->children[0]->node_type != LEAF ||
+      !is_pure_builtin(node->children[0]->head->value)) {
+    observed = true;
+    return node;
+  }
+
+  shared_ptr<ASTNode> res = node;
+  for (int j = 1; j < node->children.size(); j++) {
+    auto child = reuse(node->children[j], statements, i, effects, observed,
+                       setqs, available);
+    if (child == node->children[j])
+      continue;
+
+    if (res == node)
+      res = node->copy();
+    res->children[j] = child;
+  }
+
+  if (can_fail(node))
+    observed = true;
+
+  return res;
+}
+
+shared_ptr<ASTNode> CommonSubexpressions::reuse_statement(
+    vector<shared_ptr<ASTNode>> const &statements, int i,
+    Effects const &effects, vector<shared_ptr<ASTNode>> &setqs,
+    map<string, Value> &available) {
+  auto const &statement = statements[i];
+  bool observed = false;
+
+  switch (statement->node_type) {
+  case SETQ: {
+    // a pure value is held by the variable itself, only its parts are
+    // computed into new locals
+    auto const &value = statement->children[1];
+    shared_ptr<ASTNode> res = value;
+
+    if (is_pure(value)) {
+      for (int j = 1; j < value->children.size(); j++) {
+        auto child = reuse(value->children[j], statements, i, effects,
+                           observed, setqs, available);
+        if (child == value->children[j])
+          continue;
+
+        if (res == value)
+          res = value->copy();
+        res->children[j] = child;
+      }
+    } else
+      res = reuse(value, statements, i, effects, observed, setqs, available);
+
+    if (res == value)
+      return statement;
+
+    auto setq = statement->copy();
+    setq->children[1] = res;
+    return setq;
+  }
+
+  case RETURN:
+  case FUNCCALL:
+  case COND: {
+    // the condition of a cond and the value of a return come first
+    auto const &first =
+        statement->node_type == FUNCCALL ? statement : statement->children[0];
+    auto res = reuse(first, statements, i, effects, observed, setqs, available);
+
+    if (res == first)
+      return statement;
+
+    if (statement->node_type == FUNCCALL)
+      return res;
+
+    auto copy = statement->copy();
+    copy->children[0] = res;
+    return copy;
+  }
+
+  default:
+    return statement;
+  }
+}
+
+shared_ptr<ASTNode>
+CommonSubexpressions::optimize_prog(shared_ptr<ASTNode> const &prog) {
+  auto res = prog->copy();
+  auto &statements = res->children;
+  map<string, Value> available; // by key
+  bool breaks = false;
+
+  for (int i = 1; i < statements.size(); i++) {
+    Effects effects;
+    collect_effects(statements[i], effects);
+
+    if (effects.unknown)
+      available.clear();
+
+    for (auto value = available.begin(); value != available.end();) {
+      if (effects.bound.find(value->second.name) != effects.bound.end() ||
+          intersects(effects.bound, value->second.reads))
+        value = available.erase(value);
+      else
+        value++;
+    }
+
+    statements[i] = replace(statements[i], available);
+
+    // the last statement of a prog runs even after a break, the ones
+    // before it do not
+    if (!effects.unknown && !(breaks && i == statements.size() - 1)) {
+      vector<shared_ptr<ASTNode>> setqs;
+      auto statement =
+          reuse_statement(statements, i, effects, setqs, available);
+
+      if (!setqs.empty()) {
+        statements[i] = replace(statement, available);
+
+        auto locals = statements[0]->copy();
+        for (auto const &setq : setqs) {
+          locals->children.push_back(setq->children[0]);
+        }
+        statements[0] = locals;
+
+        statements.insert(statements.begin() + i, setqs.begin(), setqs.end());
+        i += setqs.size();
+      }
+    }
+
+    auto const &statement = statements[i];
+    breaks = breaks || contains_break(statement);
+
+    // the assigned variable holds the value until a later statement binds
+    // a name it reads
+    if (statement->node_type == SETQ && is_pure(statement->children[1])) {
+      auto const &name = statement->children[0]->head->value;
+      set<string> reads;
+      collect_reads(statement->children[1], reads);
+
+      if (reads.find(name) == reads.end())
+        available[key_of(statement->children[1])] = {name, reads};
+    }
+  }
+
+  if (res->children == prog->children)
+    return prog;
+
+  return res;
+}
+
+shared_ptr<ASTNode>
+CommonSubexpressions::visit(shared_ptr<ASTNode> const &node) {
+  if (node->node_type == LEAF || node->node_type == QUOTE_LIST)
+    return node;
+
+  // inner progs first, the outer one may replace more in them
+  shared_ptr<ASTNode> res = node;
+  for (int i = 0; i < node->children.size(); i++) {
+    auto child = visit(node->children[i]);
+    if (child == node->children[i])
+      continue;
+
+    if (res == node)
+      res = node->copy();
+    res->children[i] = child;
+  }
+
+  if (res->node_type == PROG)
+    return optimize_prog(res);
+
+  return res;
+}
+
+void CommonSubexpressions::optimize(shared_ptr<ASTNode> const &root) {
+  for (auto &statement : root->children) {
+    statement = visit(statement);
+  }
+}
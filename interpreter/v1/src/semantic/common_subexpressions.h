@@ -0,0 +1,63 @@
+#ifndef COMMON_SUBEXPRESSIONS_H
+#define COMMON_SUBEXPRESSIONS_H
+
+#include "../parser/ast.h"
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+using namespace flang;
+using std::map, std::set, std::shared_ptr, std::string, std::vector;
+
+// common subexpression elimination over the statements of a prog. a pure
+// builtin call whose value some variable already holds is replaced by that
+// variable, and one computed again by a later statement is stored in a new
+// local first. a value is forgotten once a statement assigns or rebinds a
+// name it reads, or calls anything but a builtin: scoping is dynamic, a
+// function could assign any name
+class CommonSubexpressions {
+public:
+  CommonSubexpressions();
+  ~CommonSubexpressions();
+
+  // rewrites the progs under root, shared subtrees are copied
+  void optimize(shared_ptr<ASTNode> const &root);
+
+  size_t eliminated() const; // calls replaced so far
+
+private:
+  struct Value {
+    string name; // the variable holding it
+    set<string> reads;
+  };
+
+  // the names a statement may bind, all of them if it calls user code
+  struct Effects {
+    set<string> bound;
+    bool unknown = false;
+  };
+
+  size_t counter = 0;
+  size_t replaced = 0;
+
+  shared_ptr<ASTNode> visit(shared_ptr<ASTNode> const &node);
+  shared_ptr<ASTNode> optimize_prog(shared_ptr<ASTNode> const &prog);
+  void collect_effects(shared_ptr<ASTNode> const &node, Effects &effects);
+  shared_ptr<ASTNode> replace(shared_ptr<ASTNode> const &node,
+                              map<string, Value> const &available);
+  size_t count(shared_ptr<ASTNode> const &node, string const &key);
+  size_t count_later(vector<shared_ptr<ASTNode>> const &statements, int i,
+                     string const &key, set<string> const &reads);
+  shared_ptr<ASTNode> reuse(shared_ptr<ASTNode> const &node,
+                            vector<shared_ptr<ASTNode>> const &statements,
+                            int i, Effects const &effects, bool &observed,
+                            vector<shared_ptr<ASTNode>> &setqs,
+                            map<string, Value> &available);
+  shared_ptr<ASTNode>
+  reuse_statement(vector<shared_ptr<ASTNode>> const &statements, int i,
+                  Effects const &effects, vector<shared_ptr<ASTNode>> &setqs,
+                  map<string, Value> &available);
+};
+
+#endif
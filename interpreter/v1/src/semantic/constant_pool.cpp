@@ -0,0 +1,93 @@
+#include "constant_pool.h"
+
+ConstantPool::ConstantPool() {}
+
+ConstantPool::~ConstantPool() {}
+
+size_t ConstantPool::size() const { return leaves.size() + lists.size(); }
+
+bool ConstantPool::is_constant(shared_ptr<ASTNode> const &node) {
+  switch (node->node_type) {
+  case LEAF:
+    return node->head->type != IDENTIFIER;
+  case QUOTE_LIST:
+    return true;
+  case LIST: {
+    auto list = static_pointer_cast<ListNode>(node);
+    if (list->is_constant)
+      return true;
+
+    for (auto const &child : node->children) {
+      if (!is_constant(child))
+        return false;
+    }
+
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+shared_ptr<ASTNode> ConstantPool::intern(shared_ptr<ASTNode> const &node) {
+  if (node->node_type == LEAF) {
+    auto &pooled = leaves[{node->head->type, node->head->value}];
+    if (pooled == nullptr)
+      pooled = node;
+
+    return pooled;
+  }
+
+  if (node->node_type != LIST && node->node_type != QUOTE_LIST)
+    return node; // quoted code is kept as it is
+
+  vector<shared_ptr<ASTNode>> children;
+  vector<ASTNode *> key;
+
+  // children are interned first, so equal lists have equal child pointers
+  for (auto const &child : node->children) {
+    children.push_back(intern(child));
+    key.push_back(children.back().get());
+  }
+
+  auto &pooled = lists[{node->node_type, key}];
+  if (pooled != nullptr)
+    return pooled;
+
+  // replacing children with equal pooled ones is safe even if the list is
+  // shared with an inlined copy
+  node->children = children;
+
+  if (node->node_type == LIST)
+    static_pointer_cast<ListNode>(node)->is_constant = is_constant(node);
+
+  pooled = node;
+  return pooled;
+}
+
+void ConstantPool::hoist(shared_ptr<ASTNode> &node) {
+  if (node->node_type == QUOTE_LIST ||
+      (node->node_type == LIST && is_constant(node))) {
+    node = intern(node);
+    return;
+  }
+
+  // names, parameters and locals are not evaluated
+  int first = 0;
+  switch (node->node_type) {
+  case FUNCDEF:
+    first = 2;
+    break;
+  case LAMBDA:
+  case PROG:
+  case SETQ:
+    first = 1;
+    break;
+  default:
+    break;
+  }
+
+  for (int i = first; i < node->children.size(); ++i) {
+    hoist(node->children[i]);
+  }
+}
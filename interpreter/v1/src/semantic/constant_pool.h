@@ -0,0 +1,34 @@
+#ifndef CONSTANT_POOL_H
+#define CONSTANT_POOL_H
+
+#include "../parser/ast.h"
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+using namespace flang;
+using std::map, std::pair, std::shared_ptr, std::string, std::vector;
+
+// hash-consed literal data of a program. quoted lists and lists that
+// evaluate to themselves are replaced by one shared immutable node per
+// structure, so evaluating them does not allocate
+class ConstantPool {
+public:
+  ConstantPool();
+  ~ConstantPool();
+
+  // post-analysis pass, rewrites constant lists under node in place
+  void hoist(shared_ptr<ASTNode> &node);
+
+  size_t size() const;
+
+private:
+  map<pair<TokenType, string>, shared_ptr<ASTNode>> leaves;
+  map<pair<ASTNodeType, vector<ASTNode *>>, shared_ptr<ASTNode>> lists;
+
+  bool is_constant(shared_ptr<ASTNode> const &node);
+  shared_ptr<ASTNode> intern(shared_ptr<ASTNode> const &node);
+};
+
+#endif
@@ -0,0 +1,339 @@
+#include "effect_analysis.h"
+
+EffectAnalysis::EffectAnalysis() {}
+
+EffectAnalysis::~EffectAnalysis() {}
+
+size_t EffectAnalysis::pure() const { return counter; }
+
+// builtins without side effects, a call of one fails at worst
+static bool is_pure_builtin(string const &name) {
+  static const set<string> builtins = {
+      "plus",    "minus",  "times",   "divide",    "equal",  "nonequal",
+      "less",    "lesseq", "greater", "greatereq", "and",    "or",
+      "not",     "xor",    "isint",   "isreal",    "isbool", "isnull",
+      "isatom",  "islist", "head",    "tail",      "cons",   "isempty",
+      "reverse", "length", "append",  "range",     "get",
+      "vec",        "vecrange",     "veclist",  "vecget",  "vecplus",
+      "vecminus",   "vectimes",     "vecdivide", "vecless", "veclesseq",
+      "vecgreater", "vecgreatereq", "vecequal", "vecsum",  "vecdot",
+      "vecmin",     "vecmax",       "vecscan"};
+
+  return builtins.find(name) != builtins.end();
+}
+
+static bool is_builtin(string const &name) {
+  return is_pure_builtin(name) || name == "eval" || name == "println" ||
+         name == "require" || name == "memo" || name == "foldl" ||
+         name == "foldr" || name == "map" || name == "filter" ||
+         name == "pmap" || name == "pfilter" || name == "preduce" ||
+         name == "spawn" || name == "chan" || name == "send" ||
+         name == "recv" || name == "future" || name == "force" ||
+         name == "streamcons" || name == "iterate" || name == "take" ||
+         name == "drop" || name == "streamlist" || name == "_trampoline" ||
+         name == "_pipeline" || name == "dict" || name == "put" ||
+         name == "putinplace";
+}
+
+static Effect join(Effect a, Effect b) { return a > b ? a : b; }
+
+// the names the interpreter binds in the frame of a call before running the
+// body: the parameters and the variables the body assigns at its top level
+static set<string> frame_locals(shared_ptr<ASTNode> const &params,
+                                shared_ptr<ASTNode> const &body) {
+  set<string> res;
+
+  for (auto const &param : params->children) {
+    res.insert(param->head->value);
+  }
+
+  if (body->node_type == PROG) {
+    for (auto const &child : body->children) {
+      if (child->node_type == SETQ)
+        res.insert(child->children[0]->head->value);
+    }
+  }
+
+  return res;
+}
+
+void EffectAnalysis::count_bindings(shared_ptr<ASTNode> const &node) {
+  switch (node->node_type) {
+  case LEAF:
+  case QUOTE_LIST:
+    return;
+
+  case FUNCDEF:
+    bindings[node->children[0]->head->value]++;
+    for (auto const &param : node->children[1]->children) {
+      bindings[param->head->value]++;
+    }
+    break;
+
+  case LAMBDA:
+    for (auto const &param : node->children[0]->children) {
+      bindings[param->head->value]++;
+    }
+    break;
+
+  case PROG:
+    for (auto const &local : node->children[0]->children) {
+      bindings[local->head->value]++;
+    }
+    break;
+
+  case SETQ:
+    bindings[node->children[0]->head->value]++;
+    break;
+
+  case FUNCCALL:
+    // either can bind any name at runtime
+    if (node->children[0]->node_type == LEAF &&
+        (node->children[0]->head->value == "eval" ||
+         node->children[0]->head->value == "require"))
+      has_eval = true;
+    break;
+
+  default:
+    break;
+  }
+
+  for (auto const &child : node->children) {
+    count_bindings(child);
+  }
+}
+
+void EffectAnalysis::collect(shared_ptr<ASTNode> const &node) {
+  if (node->node_type == LEAF || node->node_type == QUOTE_LIST)
+    return;
+
+  if (node->node_type == FUNCDEF) {
+    Function function;
+    function.node = static_pointer_cast<FuncDefNode>(node);
+    functions.push_back(function);
+  }
+
+  if (node->node_type == PARALLEL)
+    parallels.push_back(static_pointer_cast<ParallelNode>(node));
+
+  for (auto const &child : node->children) {
+    collect(child);
+  }
+}
+
+bool EffectAnalysis::stable(string const &name) const {
+  if (has_eval || toplevel.find(name) == toplevel.end())
+    return false;
+
+  auto count = bindings.find(name);
+  return count != bindings.end() && count->second == 1;
+}
+
+// a builtin of the name is called, the library ones can be hidden by a
+// function of the program. reading one reads no variable
+bool EffectAnalysis::builtin(string const &name) const {
+  return is_builtin(name) && bindings.find(name) == bindings.end();
+}
+
+bool EffectAnalysis::reaches_builtin(string const &name) const {
+  return !has_eval && builtin(name);
+}
+
+bool EffectAnalysis::calls_without_effects(shared_ptr<ASTNode> const &node) {
+  if (node->node_type == LEAF) {
+    auto const &name = node->head->value;
+    if (node->head->type != IDENTIFIER)
+      return false;
+
+    if (stable(name))
+      return toplevel[name]->effect != EFFECTFUL;
+    return builtin(name) && is_pure_builtin(name);
+  }
+
+  if (node->node_type != LAMBDA)
+    return false;
+
+  Function lambda;
+  visit(node->children[1],
+        frame_locals(node->children[0], node->children[1]), lambda);
+
+  for (auto const &name : lambda.calls) {
+    lambda.effect = join(lambda.effect, toplevel[name]->effect);
+  }
+
+  return lambda.effect != EFFECTFUL;
+}
+
+void EffectAnalysis::visit(shared_ptr<ASTNode> const &node,
+                           set<string> const &locals, Function &function) {
+  switch (node->node_type) {
+  case LEAF:
+    if (node->head->type == IDENTIFIER &&
+        locals.find(node->head->value) == locals.end() &&
+        !stable(node->head->value) && !builtin(node->head->value))
+      function.effect = join(function.effect, READS_GLOBALS);
+    return;
+
+  case QUOTE_LIST:
+    return;
+
+  case SETQ:
+    // setq assigns the nearest binding, out of this call it is the
+    // caller's or a global
+    if (locals.find(node->children[0]->head->value) == locals.end())
+      function.effect = EFFECTFUL;
+    visit(node->children[1], locals, function);
+    return;
+
+  case FUNCCALL: {
+    auto const &head = node->children[0];
+    if (head->node_type != LEAF) {
+      function.effect = EFFECTFUL;
+      return;
+    }
+
+    auto const &name = head->head->value;
+    if (locals.find(name) == locals.end() && stable(name))
+      function.calls.insert(name);
+    else if (!builtin(name) || !is_pure_builtin(name)) {
+      function.effect = EFFECTFUL;
+      return;
+    }
+
+    for (int i = 1; i < node->children.size(); i++) {
+      visit(node->children[i], locals, function);
+    }
+    return;
+  }
+
+  case LAMBDA:
+    visit_captures(node->children[1],
+                   frame_locals(node->children[0], node->children[1]), locals,
+                   function);
+    return;
+
+  case FUNCDEF:
+    // binds its name in the frame of the call, reads of it are not known
+    // to be local and calls of it are not resolved
+    visit_captures(node->children[2],
+                   frame_locals(node->children[1], node->children[2]), locals,
+                   function);
+    return;
+
+  case PROG: {
+    auto scope = locals;
+    for (auto const &local : node->children[0]->children) {
+      scope.insert(local->head->value);
+    }
+
+    for (int i = 1; i < node->children.size(); i++) {
+      visit(node->children[i], scope, function);
+    }
+    return;
+  }
+
+  default:
+    for (auto const &child : node->children) {
+      visit(child, locals, function);
+    }
+  }
+}
+
+// a closure made in a call captures the values bound to the free names of
+// its body when it is made, see Interpreter::iterate_closure. defined are
+// the names of its own frame, locals those of the call making it
+void EffectAnalysis::visit_captures(shared_ptr<ASTNode> const &node,
+                                    set<string> const &defined,
+                                    set<string> const &locals,
+                                    Function &function) {
+  if (node->node_type == LEAF) {
+    if (node->head->type == IDENTIFIER &&
+        defined.find(node->head->value) == defined.end())
+      visit(node, locals, function);
+    return;
+  }
+
+  for (int i = 0; i < node->children.size(); i++) {
+    if ((node->node_type == PROG || node->node_type == FUNCCALL ||
+         node->node_type == FUNCDEF) &&
+        i == 0)
+      continue;
+
+    visit_captures(node->children[i], defined, locals, function);
+  }
+}
+
+void EffectAnalysis::analyze(shared_ptr<ASTNode> const &root) {
+  bindings.clear();
+  toplevel.clear();
+  functions.clear();
+  parallels.clear();
+  has_eval = false;
+
+  count_bindings(root);
+  for (auto const &child : root->children) {
+    if (child->node_type == FUNCDEF)
+      toplevel[child->children[0]->head->value] =
+          static_pointer_cast<FuncDefNode>(child);
+  }
+
+  collect(root);
+
+  map<string, size_t> index;
+  for (size_t i = 0; i < functions.size(); i++) {
+    auto &function = functions[i];
+    auto const &params = function.node->getParams();
+    auto const &body = function.node->getBody();
+
+    visit(body, frame_locals(params, body), function);
+
+    auto const &name = function.node->getName()->value;
+    if (stable(name) && toplevel[name] == function.node)
+      index[name] = i;
+  }
+
+  // a function has the effects of the ones it calls, recursion included
+  for (bool changed = true; changed;) {
+    changed = false;
+
+    for (auto &function : functions) {
+      for (auto const &name : function.calls) {
+        auto callee = index.find(name);
+        Effect effect = callee == index.end()
+                            ? EFFECTFUL
+                            : functions[callee->second].effect;
+
+        if (effect > function.effect) {
+          function.effect = effect;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  for (auto const &function : functions) {
+    function.node->effect = function.effect;
+    if (function.effect == PURE)
+      counter++;
+  }
+
+  // the branches of a parallel run on interpreters of their own, one that
+  // assigns a name it does not bind itself has to see the assignments of
+  // the others
+  for (auto const &parallel : parallels) {
+    Function branches;
+    for (auto const &branch : parallel->children) {
+      visit(branch, {}, branches);
+    }
+
+    for (auto const &name : branches.calls) {
+      auto callee = index.find(name);
+      branches.effect = join(branches.effect,
+                             callee == index.end()
+                                 ? EFFECTFUL
+                                 : functions[callee->second].effect);
+    }
+
+    parallel->serial = branches.effect == EFFECTFUL;
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef EFFECT_ANALYSIS_H
+#define EFFECT_ANALYSIS_H
+
+#include "../parser/ast.h"
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+using namespace flang;
+using std::map, std::set, std::shared_ptr, std::string, std::vector;
+
+// classifies every function of the program as pure, reading globals or
+// effectful, see Effect. a function is pure when it only reads its
+// parameters and locals and calls builtins without side effects or other
+// pure functions. calls are resolved by name, so only functions defined
+// once at the top level, with no other binding of their name and no eval
+// in the program, can be called from a pure one. the branches of a
+// parallel are run at once when none of them is effectful
+class EffectAnalysis {
+public:
+  EffectAnalysis();
+  ~EffectAnalysis();
+
+  // sets FuncDefNode::effect of the functions under root and
+  // ParallelNode::serial of the parallels
+  void analyze(shared_ptr<ASTNode> const &root);
+
+  size_t pure() const; // functions found pure so far
+
+  // for the program analyzed last: a call of the builtin name reaches it,
+  // no function of the program or eval can hide it
+  bool reaches_builtin(string const &name) const;
+
+  // calling the function value node evaluates to has no side effects: a
+  // stable function that is not effectful, a pure builtin, or a lambda
+  // whose body calls only those
+  bool calls_without_effects(shared_ptr<ASTNode> const &node);
+
+private:
+  struct Function {
+    shared_ptr<FuncDefNode> node;
+    Effect effect = PURE;
+    set<string> calls; // stable functions called
+  };
+
+  size_t counter = 0;
+  map<string, unsigned> bindings; // binding sites of each name
+  map<string, shared_ptr<FuncDefNode>> toplevel;
+  bool has_eval = false;
+  vector<Function> functions;
+  vector<shared_ptr<ParallelNode>> parallels;
+
+  void count_bindings(shared_ptr<ASTNode> const &node);
+  void collect(shared_ptr<ASTNode> const &node);
+  bool stable(string const &name) const;
+  bool builtin(string const &name) const;
+
+  void visit(shared_ptr<ASTNode> const &node, set<string> const &locals,
+             Function &function);
+  void visit_captures(shared_ptr<ASTNode> const &node,
+                      set<string> const &defined, set<string> const &locals,
+                      Function &function);
+};
+
+#endif
@@ -0,0 +1,224 @@
+#include "escape_analysis.h"
+
+EscapeAnalysis::EscapeAnalysis() {}
+
+EscapeAnalysis::~EscapeAnalysis() {}
+
+size_t EscapeAnalysis::scoped() const { return marked; }
+
+// builtins that keep a reference to their arguments. cons keeps its first
+// one, the rest only read or copy them
+static bool keeps_args(string const &name) {
+  return name == "eval" || name == "_trampoline";
+}
+
+static bool is_builtin(string const &name) {
+  static const set<string> builtins = {
+      "plus",    "minus",  "times",   "divide",    "equal",  "nonequal",
+      "less",    "lesseq", "greater", "greatereq", "and",    "or",
+      "not",     "xor",    "eval",    "isint",     "isreal", "isbool",
+      "isnull",  "isatom", "islist",  "head",      "tail",   "cons",
+      "isempty", "println", "_trampoline"};
+
+  return builtins.find(name) != builtins.end();
+}
+
+// prog locals and the setq targets a function body predeclares live in the
+// frame of the call. setqs deeper down are not collected, they may assign a
+// binding of the caller
+void EscapeAnalysis::collect_locals(shared_ptr<ASTNode> const &node) {
+  switch (node->node_type) {
+  case FUNCDEF:
+  case LAMBDA:
+  case QUOTE_LIST:
+  case LEAF:
+    return;
+
+  case PROG:
+    for (auto const &local : node->children[0]->children) {
+      locals.insert(local->head->value);
+    }
+    break;
+
+  default:
+    break;
+  }
+
+  for (auto const &child : node->children) {
+    collect_locals(child);
+  }
+}
+
+// names a nested function reads are copied into its closure
+void EscapeAnalysis::capture(shared_ptr<ASTNode> const &node) {
+  if (node->node_type == LEAF) {
+    if (node->head->type == IDENTIFIER &&
+        escaped.insert(node->head->value).second)
+      changed = true;
+    return;
+  }
+
+  for (auto const &child : node->children) {
+    capture(child);
+  }
+}
+
+void EscapeAnalysis::analyze_function(shared_ptr<ASTNode> const &params,
+                                      shared_ptr<ASTNode> const &body) {
+  auto outer_locals = locals;
+  auto outer_escaped = escaped;
+  bool outer_changed = changed;
+  bool outer_mark = mark;
+
+  locals.clear();
+  escaped.clear();
+
+  if (params != nullptr) {
+    for (auto const &param : params->children) {
+      locals.insert(param->head->value);
+    }
+  }
+
+  if (body->node_type == PROG) {
+    for (auto const &child : body->children) {
+      if (child->node_type == SETQ)
+        locals.insert(child->children[0]->head->value);
+    }
+  }
+
+  collect_locals(body);
+
+  // the escaping locals only grow, a last pass marks the sites
+  mark = false;
+  do {
+    changed = false;
+    visit(body, params != nullptr);
+  } while (changed);
+
+  mark = true;
+  visit(body, params != nullptr);
+
+  locals = outer_locals;
+  escaped = outer_escaped;
+  changed = outer_changed;
+  mark = outer_mark;
+}
+
+void EscapeAnalysis::visit_call(shared_ptr<FuncCallNode> const &node,
+                                bool escapes) {
+  auto const &head = node->children[0];
+
+  if (head->node_type != LEAF || !is_builtin(head->head->value) ||
+      keeps_args(head->head->value)) {
+    for (auto const &child : node->children) {
+      if (child != head || head->node_type != LEAF)
+        visit(child, true);
+    }
+    return;
+  }
+
+  auto const &name = head->head->value;
+
+  for (int i = 1; i < node->children.size(); i++) {
+    visit(node->children[i], name == "cons" && i == 1);
+  }
+
+  if (mark && !escapes && (name == "cons" || name == "tail")) {
+    node->scoped = true;
+    marked++;
+  }
+}
+
+void EscapeAnalysis::visit(shared_ptr<ASTNode> const &node, bool escapes) {
+  switch (node->node_type) {
+  case LEAF:
+    if (escapes && node->head->type == IDENTIFIER &&
+        escaped.insert(node->head->value).second)
+      changed = true;
+    return;
+
+  case QUOTE_LIST:
+    return;
+
+  case LIST: {
+    auto list = static_pointer_cast<ListNode>(node);
+    if (list->is_constant)
+      return;
+
+    for (auto const &child : node->children) {
+      visit(child, true);
+    }
+
+    if (mark && !escapes) {
+      list->scoped = true;
+      marked++;
+    }
+    return;
+  }
+
+  case FUNCCALL:
+    visit_call(static_pointer_cast<FuncCallNode>(node), escapes);
+    return;
+
+  case SETQ: {
+    auto const &name = node->children[0]->head->value;
+    visit(node->children[1], locals.find(name) == locals.end() ||
+                                 escaped.find(name) != escaped.end());
+    return;
+  }
+
+  case COND:
+    visit(node->children[0], false);
+    for (int i = 1; i < node->children.size(); i++) {
+      visit(node->children[i], escapes);
+    }
+    return;
+
+  case WHILE:
+    visit(node->children[0], false);
+    visit(node->children[1], false);
+    return;
+
+  case PROG:
+    for (int i = 1; i < node->children.size(); i++) {
+      visit(node->children[i], escapes && i == node->children.size() - 1);
+    }
+    return;
+
+  case RETURN:
+    visit(node->children[0], true);
+    return;
+
+  case PARALLEL:
+    // the values of the branches are handed from their interpreters
+    for (auto const &child : node->children) {
+      visit(child, true);
+    }
+    return;
+
+  case FUNCDEF:
+    if (!mark)
+      capture(node->children[2]);
+    else
+      analyze_function(node->children[1], node->children[2]);
+    return;
+
+  case LAMBDA:
+    if (!mark)
+      capture(node->children[1]);
+    else
+      analyze_function(node->children[0], node->children[1]);
+    return;
+
+  default:
+    for (auto const &child : node->children) {
+      visit(child, escapes);
+    }
+  }
+}
+
+void EscapeAnalysis::analyze(shared_ptr<ASTNode> const &root) {
+  // the program runs like a function without parameters whose statements'
+  // values are dropped, its setq targets are globals
+  analyze_function(nullptr, root);
+}
@@ -0,0 +1,40 @@
+#ifndef ESCAPE_ANALYSIS_H
+#define ESCAPE_ANALYSIS_H
+
+#include "../parser/ast.h"
+#include <memory>
+#include <set>
+
+using namespace flang;
+using std::set, std::shared_ptr, std::string;
+
+// marks list allocation sites (cons, tail and list literals) whose value
+// dies with the call it is built in: it is only kept in locals of the
+// function and only passed to builtins that copy it. the interpreter places
+// those lists in its region, see utils/region.h. frames are never captured,
+// closures copy the values they read, so every frame is placed there anyway
+class EscapeAnalysis {
+public:
+  EscapeAnalysis();
+  ~EscapeAnalysis();
+
+  void analyze(shared_ptr<ASTNode> const &root);
+
+  size_t scoped() const; // sites marked so far
+
+private:
+  set<string> locals;  // of the function being analyzed
+  set<string> escaped; // locals whose value may leave the function
+  bool changed = false;
+  bool mark = false;
+  size_t marked = 0;
+
+  void analyze_function(shared_ptr<ASTNode> const &params,
+                        shared_ptr<ASTNode> const &body);
+  void collect_locals(shared_ptr<ASTNode> const &node);
+  void capture(shared_ptr<ASTNode> const &node);
+  void visit(shared_ptr<ASTNode> const &node, bool escapes);
+  void visit_call(shared_ptr<FuncCallNode> const &node, bool escapes);
+};
+
+#endif
@@ -0,0 +1,158 @@
+#include "induction_variables.h"
+#include <charconv>
+#include <climits>
+#include <map>
+
+InductionVariables::InductionVariables() {}
+
+InductionVariables::~InductionVariables() {}
+
+size_t InductionVariables::counted() const { return marked; }
+
+static bool int_literal(shared_ptr<ASTNode> const &node, long long &value) {
+  if (node->node_type != LEAF || node->head->type != INT)
+    return false;
+
+  auto const &text = node->head->value;
+  auto res = std::from_chars(text.data(), text.data() + text.size(), value);
+
+  return res.ec == std::errc() && res.ptr == text.data() + text.size() &&
+         value >= INT_MIN && value <= INT_MAX;
+}
+
+static bool names(shared_ptr<ASTNode> const &node, string const &name) {
+  return node->node_type == LEAF && node->head->type == IDENTIFIER &&
+         node->head->value == name;
+}
+
+// whether anything under node but the increment binds name
+static bool binds(shared_ptr<ASTNode> const &node, string const &name,
+                  shared_ptr<ASTNode> const &increment) {
+  switch (node->node_type) {
+  case LEAF:
+  case QUOTE_LIST:
+    return false;
+
+  case FUNCDEF:
+    return node->children[0]->head->value == name;
+
+  case LAMBDA:
+    return false;
+
+  case PROG:
+    for (auto const &local : node->children[0]->children) {
+      if (local->head->value == name)
+        return true;
+    }
+    break;
+
+  case SETQ:
+    if (node != increment && node->children[0]->head->value == name)
+      return true;
+    break;
+
+  default:
+    break;
+  }
+
+  for (auto const &child : node->children) {
+    if (binds(child, name, increment))
+      return true;
+  }
+
+  return false;
+}
+
+shared_ptr<CountedLoop>
+InductionVariables::recognize(shared_ptr<ASTNode> const &loop) {
+  static const std::map<string, CountedLoop::Comparison> comparisons = {
+      {"less", CountedLoop::LESS},
+      {"lesseq", CountedLoop::LESSEQ},
+      {"greater", CountedLoop::GREATER},
+      {"greatereq", CountedLoop::GREATEREQ}};
+
+  auto const &cond = loop->children[0];
+  auto const &body = loop->children[1];
+
+  if (cond->node_type != FUNCCALL || cond->children.size() != 3 ||
+      cond->children[0]->node_type != LEAF)
+    return nullptr;
+
+  auto comparison = comparisons.find(cond->children[0]->head->value);
+  if (comparison == comparisons.end())
+    return nullptr;
+
+  auto const &counter = cond->children[1];
+  auto const &bound = cond->children[2];
+  long long value;
+
+  if (counter->node_type != LEAF || counter->head->type != IDENTIFIER)
+    return nullptr;
+
+  auto const &name = counter->head->value;
+  if (!int_literal(bound, value) &&
+      !(bound->node_type == LEAF && bound->head->type == IDENTIFIER &&
+        bound->head->value != name))
+    return nullptr;
+
+  // the last statement of the body steps the counter
+  if (body->node_type != PROG || body->children.size() < 2)
+    return nullptr;
+
+  auto const &increment = body->children.back();
+  if (increment->node_type != SETQ ||
+      increment->children[0]->head->value != name)
+    return nullptr;
+
+  auto const &step = increment->children[1];
+  if (step->node_type != FUNCCALL || step->children.size() != 3 ||
+      step->children[0]->node_type != LEAF)
+    return nullptr;
+
+  auto const &op = step->children[0]->head->value;
+  auto const &left = step->children[1];
+  auto const &right = step->children[2];
+
+  auto res = make_shared<CountedLoop>();
+  res->comparison = comparison->second;
+  res->counter = counter;
+  res->bound = bound;
+  res->increment = increment;
+
+  if (op == "plus" && names(left, name) && int_literal(right, value)) {
+    res->step = value;
+    res->step_first = false;
+  } else if (op == "plus" && int_literal(left, value) && names(right, name)) {
+    res->step = value;
+    res->step_first = true;
+  } else if (op == "minus" && names(left, name) && int_literal(right, value)) {
+    res->step = -value;
+    res->step_first = false;
+  } else
+    return nullptr;
+
+  if (binds(loop, name, increment) ||
+      (bound->head->type == IDENTIFIER &&
+       binds(loop, bound->head->value, nullptr)))
+    return nullptr;
+
+  return res;
+}
+
+void InductionVariables::visit(shared_ptr<ASTNode> const &node) {
+  for (auto const &child : node->children) {
+    visit(child);
+  }
+
+  if (node->node_type != WHILE)
+    return;
+
+  auto loop = static_pointer_cast<WhileNode>(node);
+  loop->counted = recognize(node);
+  if (loop->counted != nullptr)
+    marked++;
+}
+
+void InductionVariables::analyze(shared_ptr<ASTNode> const &root) {
+  visit(root);
+}
@@ -0,0 +1,33 @@
+#ifndef INDUCTION_VARIABLES_H
+#define INDUCTION_VARIABLES_H
+
+#include "../parser/ast.h"
+#include <memory>
+#include <set>
+
+using namespace flang;
+using std::set, std::shared_ptr, std::string;
+
+// finds the counted loops of the program, whiles of the shape
+//   (while (less i n) (prog (..) .. (setq i (plus i 1))))
+// with any of the four comparisons, an int literal or a name as the bound
+// and a constant int step. the interpreter checks the counter and the bound
+// hold ints whenever it uses them, so the shape is all that is needed
+class InductionVariables {
+public:
+  InductionVariables();
+  ~InductionVariables();
+
+  // sets WhileNode::counted of the loops under root
+  void analyze(shared_ptr<ASTNode> const &root);
+
+  size_t counted() const; // loops marked so far
+
+private:
+  size_t marked = 0;
+
+  void visit(shared_ptr<ASTNode> const &node);
+  shared_ptr<CountedLoop> recognize(shared_ptr<ASTNode> const &loop);
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include "list_fusion.h"
+
+ListFusion::ListFusion() {}
+
+ListFusion::~ListFusion() {}
+
+size_t ListFusion::fused() const { return counter; }
+
+// a call of map or filter, or of a fold when outer, whose last argument is
+// the list
+bool ListFusion::is_stage(shared_ptr<ASTNode> const &node, bool outer) const {
+  if (node->node_type != FUNCCALL || node->children[0]->node_type != LEAF)
+    return false;
+
+  auto const &name = node->children[0]->head->value;
+  size_t args;
+  if (name == "map" || name == "filter")
+    args = 2;
+  else if (outer && (name == "foldl" || name == "foldr"))
+    args = 3;
+  else
+    return false;
+
+  return node->children.size() == args + 1 && effects->reaches_builtin(name);
+}
+
+// the pipeline of calls starting at node as one call, nullptr if there is
+// none or it can not be fused
+shared_ptr<ASTNode> ListFusion::fuse(shared_ptr<ASTNode> const &node) {
+  if (!is_stage(node, true))
+    return nullptr;
+
+  vector<shared_ptr<ASTNode>> calls = {node};
+  while (is_stage(calls.back()->children.back(), false)) {
+    calls.push_back(calls.back()->children.back());
+  }
+
+  if (calls.size() < 2)
+    return nullptr;
+
+  Pipeline pipeline;
+  pipeline.span = node->children[0]->head->span;
+  pipeline.fused = true;
+
+  for (auto const &call : calls) {
+    pipeline.stages.push_back(call->children[0]->head->value);
+    if (!effects->calls_without_effects(call->children[1]))
+      pipeline.fused = false;
+  }
+
+  pipelines.push_back(pipeline);
+  if (!pipeline.fused)
+    return nullptr;
+
+  auto const &span = pipeline.span;
+  vector<shared_ptr<ASTNode>> stages;
+  for (auto const &stage : pipeline.stages) {
+    stages.push_back(make_shared<ASTNode>(
+        LEAF, make_shared<Token>(IDENTIFIER, stage, span)));
+  }
+
+  auto name = make_shared<Token>(IDENTIFIER, "_pipeline", span);
+  vector<shared_ptr<ASTNode>> children = {make_shared<ASTNode>(LEAF, name),
+                                          make_shared<ListNode>(true, stages)};
+
+  for (auto const &call : calls) {
+    for (size_t i = 1; i + 1 < call->children.size(); i++) {
+      children.push_back(call->children[i]);
+    }
+  }
+  children.push_back(calls.back()->children.back());
+
+  auto res = make_shared<FuncCallNode>(name, children);
+  res->inferred = node->inferred;
+  counter++;
+  return res;
+}
+
+shared_ptr<ASTNode> ListFusion::visit(shared_ptr<ASTNode> const &node) {
+  if (node->node_type == LEAF || node->node_type == QUOTE_LIST)
+    return node;
+
+  // the outermost call of a pipeline first, its arguments may hold more
+  auto fused = fuse(node);
+  auto const &from = fused != nullptr ? fused : node;
+
+  shared_ptr<ASTNode> res = from;
+  for (int i = 0; i < from->children.size(); i++) {
+    auto child = visit(from->children[i]);
+    if (child == from->children[i])
+      continue;
+
+    if (res == node)
+      res = node->copy();
+    res->children[i] = child;
+  }
+
+  return res;
+}
+
+void ListFusion::optimize(shared_ptr<ASTNode> const &root,
+                          EffectAnalysis &effects) {
+  this->effects = &effects;
+  pipelines.clear();
+
+  for (auto &statement : root->children) {
+    statement = visit(statement);
+  }
+}
+
+void ListFusion::report(std::ostream &out) const {
+  out << "Fused pipelines:" << '\n';
+
+  size_t fused = 0;
+  for (auto const &pipeline : pipelines) {
+    out << "  line " << pipeline.span.line << ", column "
+        << pipeline.span.column << ": ";
+
+    for (size_t i = 0; i < pipeline.stages.size(); i++) {
+      out << (i == 0 ? "" : " of ") << pipeline.stages[i];
+    }
+
+    if (pipeline.fused)
+      fused++;
+    else
+      out << ", not fused: a function may have side effects";
+    out << '\n';
+  }
+
+  out << fused << " of " << pipelines.size() << " pipelines fused" << '\n';
+}
@@ -0,0 +1,50 @@
+#ifndef LIST_FUSION_H
+#define LIST_FUSION_H
+
+#include "../parser/ast.h"
+#include "effect_analysis.h"
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace flang;
+using std::shared_ptr, std::string, std::vector;
+
+// fuses nested calls of map and filter, under a foldl, a foldr or neither,
+// into one call of the _pipeline native, which runs every item through all
+// of them in one pass without the lists in between. the functions given to
+// the calls have to be free of side effects, see
+// EffectAnalysis::calls_without_effects: their calls run in another order.
+// the arguments are evaluated in the order of the calls replaced
+class ListFusion {
+public:
+  ListFusion();
+  ~ListFusion();
+
+  // rewrites the calls under root, shared subtrees are copied. effects has
+  // analyzed root
+  void optimize(shared_ptr<ASTNode> const &root, EffectAnalysis &effects);
+
+  // the pipelines found by the last optimize, fused or not
+  void report(std::ostream &out) const;
+
+  size_t fused() const; // pipelines fused so far
+
+private:
+  struct Pipeline {
+    Span span;
+    vector<string> stages; // from the outer call in
+    bool fused;
+  };
+
+  size_t counter = 0;
+  vector<Pipeline> pipelines;
+  EffectAnalysis *effects = nullptr;
+
+  shared_ptr<ASTNode> visit(shared_ptr<ASTNode> const &node);
+  shared_ptr<ASTNode> fuse(shared_ptr<ASTNode> const &node);
+  bool is_stage(shared_ptr<ASTNode> const &node, bool outer) const;
+};
+
+#endif
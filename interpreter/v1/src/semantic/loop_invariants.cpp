@@ -0,0 +1,320 @@
+#include "loop_invariants.h"
+
+LoopInvariantMotion::LoopInvariantMotion() {}
+
+LoopInvariantMotion::~LoopInvariantMotion() {}
+
+size_t LoopInvariantMotion::hoisted() const { return counter; }
+
+static bool is_arithmetic_op(string const &name) {
+  return name == "plus" || name == "minus" || name == "times" ||
+         name == "divide";
+}
+
+static bool is_comparison_op(string const &name) {
+  return name == "less" || name == "lesseq" || name == "greater" ||
+         name == "greatereq";
+}
+
+static bool is_builtin(string const &name) {
+  static const set<string> builtins = {
+      "plus",   "minus",  "times",   "divide",    "equal",  "nonequal",
+      "less",   "lesseq", "greater", "greatereq", "and",    "or",
+      "not",    "xor",    "isint",   "isreal",    "isbool", "isnull",
+      "isatom", "islist", "head",    "tail",      "cons",   "isempty",
+      "println"};
+
+  return builtins.find(name) != builtins.end();
+}
+
+// names the loop may bind while it runs. functions defined in it are not
+// called by it, see only_builtins, their bodies do not count
+static void collect_variant(shared_ptr<ASTNode> const &node,
+                            set<string> &variant) {
+  switch (node->node_type) {
+  case FUNCDEF:
+    variant.insert(node->children[0]->head->value);
+    return;
+
+  case LAMBDA:
+  case QUOTE_LIST:
+  case LEAF:
+    return;
+
+  case PROG:
+    for (auto const &local : node->children[0]->children) {
+      variant.insert(local->head->value);
+    }
+    break;
+
+  case SETQ:
+    variant.insert(node->children[0]->head->value);
+    break;
+
+  default:
+    break;
+  }
+
+  for (auto const &child : node->children) {
+    collect_variant(child, variant);
+  }
+}
+
+// scoping is dynamic, any function the loop calls could assign the names
+// it reads, and eval could run anything
+static bool only_builtins(shared_ptr<ASTNode> const &node) {
+  switch (node->node_type) {
+  case FUNCDEF:
+  case LAMBDA:
+  case QUOTE_LIST:
+  case LEAF:
+    return true;
+
+  case FUNCCALL: {
+    auto const &head = node->children[0];
+    if (head->node_type != LEAF || !is_builtin(head->head->value))
+      return false;
+    break;
+  }
+
+  default:
+    break;
+  }
+
+  for (auto const &child : node->children) {
+    if (!only_builtins(child))
+      return false;
+  }
+
+  return true;
+}
+
+static bool contains_break(shared_ptr<ASTNode> const &node) {
+  if (node->node_type == BREAK)
+    return true;
+
+  for (auto const &child : node->children) {
+    if (contains_break(child))
+      return true;
+  }
+
+  return false;
+}
+
+bool LoopInvariantMotion::is_invariant(shared_ptr<ASTNode> const &node,
+                                       set<string> const &variant) const {
+  switch (node->node_type) {
+  case LEAF:
+    if (node->head->type == INT || node->head->type == REAL)
+      return true;
+
+    return node->head->type == IDENTIFIER &&
+           variant.find(node->head->value) == variant.end() &&
+           bound.find(node->head->value) != bound.end() &&
+           node->proven(TYPE_NUMBER);
+
+  case FUNCCALL: {
+    auto const &head = node->children[0];
+    if (head->node_type != LEAF)
+      return false;
+
+    auto const &name = head->head->value;
+    size_t args = node->children.size() - 1;
+    if (!(is_arithmetic_op(name) && args >= 1) &&
+        !(is_comparison_op(name) && args == 2))
+      return false;
+
+    for (int i = 1; i < node->children.size(); i++) {
+      if (!is_invariant(node->children[i], variant))
+        return false;
+    }
+
+    return true;
+  }
+
+  default:
+    return false;
+  }
+}
+
+// replaces the largest invariant expressions under node by a fresh name,
+// the setqs computing them are appended to setqs
+shared_ptr<ASTNode>
+LoopInvariantMotion::hoist(shared_ptr<ASTNode> const &node,
+                           set<string> const &variant,
+                           vector<shared_ptr<ASTNode>> &setqs) {
+  switch (node->node_type) {
+  case FUNCDEF:
+  case LAMBDA:
+  case QUOTE_LIST:
+  case LEAF:
+    return node;
+
+  case FUNCCALL:
+    if (is_invariant(node, variant)) {
+      auto name = make_shared<Token>(
+          IDENTIFIER, "_licm" + to_string(++counter), node->head->span);
+
+      auto target = make_shared<ASTNode>(LEAF, name);
+      setqs.push_back(make_shared<SetqNode>(
+          make_shared<Token>(IDENTIFIER, "setq", node->head->span),
+          vector<shared_ptr<ASTNode>>{target, node}));
+
+      auto leaf = make_shared<ASTNode>(LEAF, name);
+      leaf->inferred = node->inferred;
+      return leaf;
+    }
+    break;
+
+  default:
+    break;
+  }
+
+  shared_ptr<ASTNode> res = node;
+  for (int i = 0; i < node->children.size(); i++) {
+    auto child = hoist(node->children[i], variant, setqs);
+    if (child == node->children[i])
+      continue;
+
+    if (res == node)
+      res = node->copy();
+    res->children[i] = child;
+  }
+
+  return res;
+}
+
+shared_ptr<ASTNode>
+LoopInvariantMotion::optimize_loop(shared_ptr<ASTNode> const &loop,
+                                   vector<shared_ptr<ASTNode>> &setqs) {
+  if (!only_builtins(loop))
+    return loop;
+
+  set<string> variant;
+  collect_variant(loop, variant);
+
+  return hoist(loop, variant, setqs);
+}
+
+// moves the invariants of the loop statement i of node in front of it,
+// locals of a prog are its first child. returns the statements inserted
+size_t LoopInvariantMotion::optimize_statement(shared_ptr<ASTNode> const &node,
+                                               int i) {
+  auto &statements = node->children;
+  if (statements[i]->node_type != WHILE)
+    return 0;
+
+  // the last statement of a prog runs even after a break, the ones before
+  // it do not
+  if (node->node_type == PROG && i == statements.size() - 1) {
+    for (int j = 1; j < i; j++) {
+      if (contains_break(statements[j]))
+        return 0;
+    }
+  }
+
+  vector<shared_ptr<ASTNode>> setqs;
+  statements[i] = optimize_loop(statements[i], setqs);
+  if (setqs.empty())
+    return 0;
+
+  if (node->node_type == PROG) {
+    auto locals = statements[0]->copy();
+    for (auto const &setq : setqs) {
+      locals->children.push_back(setq->children[0]);
+    }
+    statements[0] = locals;
+  }
+
+  statements.insert(statements.begin() + i, setqs.begin(), setqs.end());
+  return setqs.size();
+}
+
+shared_ptr<ASTNode>
+LoopInvariantMotion::visit_function(shared_ptr<ASTNode> const &node,
+                                    int params, int body) {
+  auto outer = bound;
+
+  // a function runs after its definition, when the globals assigned before
+  // it are set
+  bound = globals;
+  for (auto const &param : node->children[params]->children) {
+    bound.insert(param->head->value);
+  }
+
+  auto res = node;
+  auto rewritten = visit(node->children[body]);
+  if (rewritten != node->children[body]) {
+    res = node->copy();
+    res->children[body] = rewritten;
+  }
+
+  bound = outer;
+  return res;
+}
+
+shared_ptr<ASTNode>
+LoopInvariantMotion::visit(shared_ptr<ASTNode> const &node) {
+  switch (node->node_type) {
+  case FUNCDEF:
+    return visit_function(node, 1, 2);
+
+  case LAMBDA:
+    return visit_function(node, 0, 1);
+
+  case QUOTE_LIST:
+  case LEAF:
+    return node;
+
+  default:
+    break;
+  }
+
+  auto outer = bound;
+
+  if (node->node_type == PROG) {
+    for (auto const &local : node->children[0]->children) {
+      bound.insert(local->head->value);
+    }
+  }
+
+  // inner loops first, their invariants may be invariant here too
+  shared_ptr<ASTNode> res = node;
+  for (int i = 0; i < node->children.size(); i++) {
+    auto child = visit(node->children[i]);
+    if (child == node->children[i])
+      continue;
+
+    if (res == node)
+      res = node->copy();
+    res->children[i] = child;
+  }
+
+  if (node->node_type == PROG) {
+    if (res == node)
+      res = node->copy();
+
+    for (int i = 1; i < res->children.size(); i++) {
+      i += optimize_statement(res, i);
+    }
+
+    if (res->children == node->children)
+      res = node;
+  }
+
+  bound = outer;
+  return res;
+}
+
+void LoopInvariantMotion::optimize(shared_ptr<ASTNode> const &root) {
+  // the statements of the program are rewritten in place, the same way the
+  // analyzer does
+  for (int i = 0; i < root->children.size(); i++) {
+    bound = globals;
+    root->children[i] = visit(root->children[i]);
+    i += optimize_statement(root, i);
+
+    if (root->children[i]->node_type == SETQ)
+      globals.insert(root->children[i]->children[0]->head->value);
+  }
+}
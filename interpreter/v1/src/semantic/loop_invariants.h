@@ -0,0 +1,46 @@
+#ifndef LOOP_INVARIANTS_H
+#define LOOP_INVARIANTS_H
+
+#include "../parser/ast.h"
+#include <memory>
+#include <set>
+#include <vector>
+
+using namespace flang;
+using std::set, std::shared_ptr, std::string, std::vector;
+
+// loop invariant code motion for while. arithmetic and comparisons inside a
+// loop whose operands nothing in the loop assigns are computed once into a
+// local of the enclosing prog, or a global at the top level, right before
+// the loop. runs after type inference and only moves expressions on proven
+// numbers: those can not fail, so computing them when the loop would not
+// have is harmless
+class LoopInvariantMotion {
+public:
+  LoopInvariantMotion();
+  ~LoopInvariantMotion();
+
+  // rewrites the statements of root, shared subtrees are copied
+  void optimize(shared_ptr<ASTNode> const &root);
+
+  size_t hoisted() const; // expressions moved so far
+
+private:
+  size_t counter = 0;
+  set<string> globals; // assigned by the top level statements so far
+  set<string> bound;   // surely bound where the visited code runs
+
+  shared_ptr<ASTNode> visit(shared_ptr<ASTNode> const &node);
+  shared_ptr<ASTNode> visit_function(shared_ptr<ASTNode> const &node,
+                                     int params, int body);
+  size_t optimize_statement(shared_ptr<ASTNode> const &node, int i);
+  shared_ptr<ASTNode> optimize_loop(shared_ptr<ASTNode> const &loop,
+                                    vector<shared_ptr<ASTNode>> &setqs);
+  bool is_invariant(shared_ptr<ASTNode> const &node,
+                    set<string> const &variant) const;
+  shared_ptr<ASTNode> hoist(shared_ptr<ASTNode> const &node,
+                            set<string> const &variant,
+                            vector<shared_ptr<ASTNode>> &setqs);
+};
+
+#endif
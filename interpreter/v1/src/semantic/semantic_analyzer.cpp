@@ -11,6 +11,37 @@ SemanticAnalyzer::SemanticAnalyzer() { tmp_counter = 0; }
 
 SemanticAnalyzer::~SemanticAnalyzer() {}
 
+void SemanticAnalyzer::set_jit(bool enabled) { keep_jit_calls = enabled; }
+
+void SemanticAnalyzer::set_type_inference(bool enabled) {
+  infer_types = enabled;
+}
+
+void SemanticAnalyzer::report_types(std::ostream &out) const {
+  types.report(out);
+}
+
+void SemanticAnalyzer::report_optimizations(std::ostream &out) const {
+  list_fusion.report(out);
+}
+
+void SemanticAnalyzer::declare_native(string const &name) {
+  natives.insert(name);
+}
+
+SemanticAnalyzer SemanticAnalyzer::fork() const {
+  SemanticAnalyzer res = *this;
+
+  for (auto &scope : res.scope_stack) {
+    for (auto &variable : scope.variables) {
+      if (variable.second.value != nullptr)
+        variable.second.value = clone(variable.second.value);
+    }
+  }
+
+  return res;
+}
+
 shared_ptr<ASTNode> SemanticAnalyzer::inline_require(shared_ptr<ASTNode> node) {
   if (node->node_type == QUOTE_LIST) {
     string filename;
@@ -21,10 +52,15 @@ shared_ptr<ASTNode> SemanticAnalyzer::inline_require(shared_ptr<ASTNode> node) {
 
     filename += ".flang";
 
+    auto cached = required.find(filename);
+    if (cached != required.end())
+      return clone(cached->second);
+
     FILE *file = fopen(filename.c_str(), "r");
 
     if (file == nullptr)
       throw RuntimeError(node->head->span, "File not found");
+    fclose(file);
 
     Driver drv;
     drv.parse(filename);
@@ -34,6 +70,7 @@ shared_ptr<ASTNode> SemanticAnalyzer::inline_require(shared_ptr<ASTNode> node) {
     if (ast == nullptr)
       throw RuntimeError(node->head->span, "File not found");
 
+    required[filename] = clone(ast);
     return ast;
   }
 
@@ -102,6 +139,25 @@ void SemanticAnalyzer::analyze(shared_ptr<ASTNode> &root) {
 
     node = analyze_node(node);
   }
+
+  constant_pool.hoist(root);
+  escape_analysis.analyze(root);
+
+  // the interpreter keeps the bindings of a program, a later program could
+  // read them, so only the first one is typed and has pure functions
+  if (infer_types) {
+    types.infer(root);
+    loop_invariants.optimize(root);
+    effects.analyze(root);
+    list_fusion.optimize(root, effects);
+    infer_types = false;
+  }
+
+  common_subexpressions.optimize(root);
+
+  // marks nodes in place, the passes before would drop the marks of the
+  // subtrees they copy
+  induction_variables.analyze(root);
 }
 
 Var SemanticAnalyzer::find_variable(shared_ptr<Token> identifier) {
@@ -116,7 +172,8 @@ Var SemanticAnalyzer::find_variable(shared_ptr<Token> identifier) {
   }
 
   if (find(PF_FUNCTIONS.begin(), PF_FUNCTIONS.end(), identifier_str) !=
-      PF_FUNCTIONS.end())
+          PF_FUNCTIONS.end() ||
+      natives.count(identifier_str) != 0)
     return Var(make_shared<ASTNode>(LEAF, identifier));
 #ifdef DEBUG
   cout << "error in find " << identifier_str << endl;
@@ -153,6 +210,18 @@ SemanticAnalyzer::remove_variable(shared_ptr<ASTNode> node, Scope &scope,
   throw VariableNotFoundError(node->head->span, identifier);
 }
 
+// quoted lists in function and lambda bodies are evaluated as plain lists.
+// every call site and closure used to get this from a deep copy of the body,
+// now that copies share the body it is done once after the analysis
+void unquote_lists(shared_ptr<ASTNode> const &node) {
+  if (node->node_type == QUOTE_LIST)
+    node->node_type = LIST;
+
+  for (auto &child : node->children) {
+    unquote_lists(child);
+  }
+}
+
 shared_ptr<FuncCallNode> wrap_trampoline(shared_ptr<ASTNode> node) {
   shared_ptr<Token> identifier =
       make_shared<Token>(IDENTIFIER, "_trampoline", node->head->span);
@@ -255,6 +324,69 @@ void SemanticAnalyzer::mark_inlined_function(
   }
 }
 
+static bool mentions(shared_ptr<ASTNode> const &node, string const &name) {
+  if (node->node_type == LEAF)
+    return node->head->type == IDENTIFIER && node->head->value == name;
+
+  for (auto const &child : node->children) {
+    if (mentions(child, name))
+      return true;
+  }
+
+  return false;
+}
+
+shared_ptr<ASTNode>
+SemanticAnalyzer::get_jit_call(shared_ptr<FuncDefNode> const &funcdef,
+                               vector<shared_ptr<ASTNode>> const &args) {
+  vector<shared_ptr<ASTNode>> params = funcdef->getParams()->children;
+
+  if (args.size() != params.size())
+    throw WrongNumberOfArgumentsError(funcdef->head->span, funcdef->head->value,
+                                      params.size(), args.size());
+
+  shared_ptr<ASTNode> head_node = make_shared<ASTNode>(
+      LEAF, make_shared<Token>(IDENTIFIER, funcdef->getName()->value,
+                               funcdef->getName()->span));
+
+  // the interpreter binds parameters one by one and evaluates later
+  // arguments in the new frame, so an argument naming an earlier parameter
+  // would see its new value. such arguments go through tmp variables
+  bool early_bound = false;
+  for (int i = 1; i < args.size(); i++) {
+    for (int j = 0; j < i; j++) {
+      if (mentions(args[i], params[j]->head->value))
+        early_bound = true;
+    }
+  }
+
+  if (!early_bound) {
+    vector<shared_ptr<ASTNode>> call_args = {head_node};
+    call_args.insert(call_args.end(), args.begin(), args.end());
+    return make_shared<FuncCallNode>(head_node->head, call_args);
+  }
+
+  vector<shared_ptr<ASTNode>> locals;
+  vector<shared_ptr<ASTNode>> children = {nullptr};
+  vector<shared_ptr<ASTNode>> call_args = {head_node};
+
+  for (int i = 0; i < args.size(); i++) {
+    auto tmp = make_shared<ASTNode>(
+        LEAF, make_shared<Token>(IDENTIFIER, "_tmp" + to_string(++tmp_counter),
+                                 params[i]->head->span));
+
+    locals.push_back(tmp);
+    children.push_back(make_shared<SetqNode>(
+        params[i]->head, vector<shared_ptr<ASTNode>>{tmp, args[i]}));
+    call_args.push_back(tmp);
+  }
+
+  children[0] = make_shared<ListNode>(locals);
+  children.push_back(make_shared<FuncCallNode>(head_node->head, call_args));
+
+  return make_shared<ProgNode>(funcdef->head, children, true);
+}
+
 shared_ptr<ASTNode> SemanticAnalyzer::get_inlined_function(
     shared_ptr<FuncDefNode> const &funcdef,
     vector<shared_ptr<ASTNode>> const &args) {
@@ -301,6 +433,9 @@ shared_ptr<ASTNode> SemanticAnalyzer::get_inlined_function(
     return recursive_call;
   }
 
+  if (keep_jit_calls && jit::Jit::supports(funcdef))
+    return get_jit_call(funcdef, args);
+
   // create tmp variables for each parameter
   for (int i = 0; i < params.size(); i++) {
     string tmp = "_tmp" + to_string(++tmp_counter);
@@ -310,6 +445,10 @@ shared_ptr<ASTNode> SemanticAnalyzer::get_inlined_function(
     params_to_args[params[i]->head->value] = args[i];
   }
 
+  // the copied definition still shares its body, copy the top node before
+  // its children are replaced
+  node_body = node_body->copy();
+
   for (auto &child : node_body->children) {
     child = inline_function(child, tmps, params_to_args);
     if (child->node_type == SETQ) {
@@ -385,11 +524,23 @@ shared_ptr<ASTNode> SemanticAnalyzer::inline_function(
       }
     }
   }
-  for (auto &child : node->children) {
-    child = inline_function(child, tmps, params_to_args);
+  // the body is shared with the function definition, so only the path down
+  // to a replaced parameter is copied
+  shared_ptr<ASTNode> result = node;
+
+  for (int i = 0; i < node->children.size(); ++i) {
+    auto child = inline_function(node->children[i], tmps, params_to_args);
+
+    if (child == node->children[i])
+      continue;
+
+    if (result == node)
+      result = node->copy();
+
+    result->children[i] = child;
   }
 
-  return node;
+  return result;
 }
 
 shared_ptr<ASTNode>
@@ -429,6 +580,8 @@ shared_ptr<ASTNode> SemanticAnalyzer::analyze_node(shared_ptr<ASTNode> node) {
     return analyze_while(static_pointer_cast<WhileNode>(node));
   case COND:
     return analyze_cond(static_pointer_cast<CondNode>(node));
+  case PARALLEL:
+    return analyze_parallel(static_pointer_cast<ParallelNode>(node));
   case BREAK:
     return analyze_break(node);
   case QUOTE_LIST:
@@ -492,6 +645,7 @@ SemanticAnalyzer::analyze_funcdef(shared_ptr<FuncDefNode> node) {
   }
 
   node->setBody(analyze_node(node->getBody()));
+  unquote_lists(node->getBody());
 
   scope_stack.pop_back();
 
@@ -544,7 +698,8 @@ SemanticAnalyzer::analyze_funccall(shared_ptr<FuncCallNode> node) {
 
     // Function not found, check if it is a predefined function
     if (find(PF_FUNCTIONS.begin(), PF_FUNCTIONS.end(), identifier) ==
-        PF_FUNCTIONS.end())
+            PF_FUNCTIONS.end() &&
+        natives.count(identifier) == 0)
       throw FunctionNotFoundError(node->head->span, identifier);
     else {
       if (identifier == "plus" || identifier == "minus" ||
@@ -608,6 +763,7 @@ SemanticAnalyzer::analyze_lambda(shared_ptr<LambdaNode> node) {
   }
 
   node->setBody(analyze_node(node->getBody()));
+  unquote_lists(node->getBody());
 
   // remove variables that has 0 referrers
   for (auto it = scope_stack.back().variables.rbegin();
@@ -735,6 +891,8 @@ SemanticAnalyzer::analyze_return(shared_ptr<ReturnNode> node) {
       return node;
     case PROG:
       return node;
+    case PARALLEL:
+      throw RuntimeError(node->head->span, "Return is not allowed here");
     default:
       break;
     }
@@ -754,6 +912,7 @@ shared_ptr<ASTNode> SemanticAnalyzer::analyze_break(shared_ptr<ASTNode> node) {
       return node;
     case LAMBDA:
     case FUNCDEF:
+    case PARALLEL:
       throw RuntimeError(node->head->span, "Break is not allowed here");
     default:
       break;
@@ -789,6 +948,26 @@ shared_ptr<ASTNode> SemanticAnalyzer::analyze_cond(shared_ptr<CondNode> node) {
   return node;
 }
 
+// a branch cannot leave the parallel with return or break, its scope is
+// there to tell. the names its setq bind are those of the enclosing scope
+shared_ptr<ASTNode>
+SemanticAnalyzer::analyze_parallel(shared_ptr<ParallelNode> node) {
+#ifdef DEBUG
+  cout << "analyze_parallel" << endl;
+#endif
+  scope_stack.push_back(Scope(node));
+
+  for (auto &child : node->children) {
+    child = analyze_node(child);
+  }
+
+  auto bound = std::move(scope_stack.back().variables);
+  scope_stack.pop_back();
+  scope_stack.back().variables.insert(bound.begin(), bound.end());
+
+  return node;
+}
+
 shared_ptr<ASTNode> SemanticAnalyzer::calculate_node(shared_ptr<ASTNode> node) {
 #ifdef DEBUG
   cout << "calculate_node" << endl;
@@ -1,16 +1,26 @@
 #ifndef SEMANTIC_ANALYZER_H
 #define SEMANTIC_ANALYZER_H
 
+#include "../jit/jit.h"
 #include "../parser/ast.h"
 #include "../parser/driver.hh"
+#include "common_subexpressions.h"
+#include "constant_pool.h"
+#include "effect_analysis.h"
+#include "escape_analysis.h"
+#include "induction_variables.h"
+#include "list_fusion.h"
+#include "loop_invariants.h"
+#include "type_inference.h"
 #include <algorithm>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <set>
 
 using namespace flang;
-using std::make_shared, std::map, std::shared_ptr, std::string, std::to_string,
-    std::vector;
+using std::make_shared, std::map, std::set, std::shared_ptr, std::string,
+    std::to_string, std::vector;
 
 struct Var {
   shared_ptr<ASTNode> value;
@@ -44,15 +54,56 @@ public:
   void analyze(shared_ptr<ASTNode> &root);
   void clear_stack(shared_ptr<ASTNode> &root);
 
+  // keep calls of functions the jit compiles instead of inlining them
+  void set_jit(bool enabled);
+
+  // annotate the analyzed program with inferred types, on by default
+  void set_type_inference(bool enabled);
+  void report_types(std::ostream &out) const;
+
+  // the pipelines of list builtins the first program had and which of them
+  // were fused, see ListFusion
+  void report_optimizations(std::ostream &out) const;
+
+  // an analyzer for another thread that knows the bindings known here and
+  // analyzes against copies of them of its own
+  SemanticAnalyzer fork() const;
+
+  // lets calls of a native function of the interpreter through
+  void declare_native(string const &name);
+
 private:
   vector<Scope> scope_stack;
+  bool keep_jit_calls = false;
+  ConstantPool constant_pool;
+  EscapeAnalysis escape_analysis;
+  TypeInference types;
+  LoopInvariantMotion loop_invariants; // needs the inferred types
+  EffectAnalysis effects;
+  ListFusion list_fusion; // needs the effects
+  CommonSubexpressions common_subexpressions;
+  InductionVariables induction_variables;
+  bool infer_types = true;
   int tmp_counter;
+
+  // required files, parsed once and cloned for every require of them
+  map<string, shared_ptr<ASTNode>> required;
+  set<string> natives;
   const vector<string> PF_FUNCTIONS = {
-      "plus",    "minus",   "times",      "divide",    "equal",  "nonequal",
-      "less",    "lesseq",  "greater",    "greatereq", "and",    "or",
-      "not",     "xor",     "eval",       "isint",     "isreal", "isbool",
-      "isnull",  "isatom",  "islist",     "head",      "tail",   "cons",
-      "isempty", "println", "_trampoline"};
+      "plus",    "minus",   "times",   "divide",      "equal",   "nonequal",
+      "less",    "lesseq",  "greater", "greatereq",   "and",     "or",
+      "not",     "xor",     "eval",    "isint",       "isreal",  "isbool",
+      "isnull",  "isatom",  "islist",  "head",        "tail",    "cons",
+      "isempty", "println", "memo",    "_trampoline", "foldl",   "foldr",
+      "map",     "filter",  "reverse", "length",      "append",
+      "dict",    "get",     "put",     "putinplace",
+      "pmap",    "pfilter", "preduce", "spawn",       "chan",    "send",
+      "recv",    "future",  "force",       "streamcons", "iterate",
+      "take",    "drop",    "streamlist",  "range",   "_pipeline",
+      "vec",        "vecrange",     "veclist",  "vecget",  "vecplus",
+      "vecminus",   "vectimes",     "vecdivide", "vecless", "veclesseq",
+      "vecgreater", "vecgreatereq", "vecequal", "vecsum",  "vecdot",
+      "vecmin",     "vecmax",       "vecscan"};
 
   shared_ptr<ASTNode> analyze_funcdef(shared_ptr<FuncDefNode> node);
   shared_ptr<ASTNode> analyze_funccall(shared_ptr<FuncCallNode> node);
@@ -64,6 +115,7 @@ private:
   shared_ptr<ASTNode> analyze_break(shared_ptr<ASTNode> node);
   shared_ptr<ASTNode> analyze_while(shared_ptr<WhileNode> node);
   shared_ptr<ASTNode> analyze_cond(shared_ptr<CondNode> node);
+  shared_ptr<ASTNode> analyze_parallel(shared_ptr<ParallelNode> node);
 
   shared_ptr<ASTNode> calculate_node(shared_ptr<ASTNode> node);
 
@@ -80,6 +132,9 @@ private:
 
   void mark_inlined_function(shared_ptr<Token> const &identifier);
 
+  shared_ptr<ASTNode> get_jit_call(shared_ptr<FuncDefNode> const &funcdef,
+                                   vector<shared_ptr<ASTNode>> const &args);
+
   shared_ptr<ASTNode>
   is_recursive_call(shared_ptr<FuncDefNode> const &funcdef,
                     vector<shared_ptr<ASTNode>> const &args);
@@ -138,4 +193,30 @@ public:
                                to_string(got)) {}
 };
 
+class TimeLimitExceededError : public RuntimeError {
+public:
+  TimeLimitExceededError(Span span, long long milliseconds)
+      : RuntimeError(span, "time limit of " + to_string(milliseconds) +
+                               " ms exceeded") {}
+};
+
+class DepthLimitExceededError : public RuntimeError {
+public:
+  DepthLimitExceededError(Span span, size_t depth)
+      : RuntimeError(span, "call depth limit of " + to_string(depth) +
+                               " exceeded") {}
+};
+
+class DeadlockError : public RuntimeError {
+public:
+  DeadlockError(Span span)
+      : RuntimeError(span, "deadlock, every task is blocked on a channel") {}
+};
+
+class StackOverflowError : public RuntimeError {
+public:
+  StackOverflowError(Span span)
+      : RuntimeError(span, "stack overflow, calls are nested too deeply") {}
+};
+
 #endif
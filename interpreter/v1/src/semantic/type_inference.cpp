@@ -0,0 +1,395 @@
+#include "type_inference.h"
+
+// result types of the builtins, eval, head and println are unknown
+static const map<string, unsigned> BUILTIN_TYPES = {
+    {"plus", TYPE_NUMBER},    {"minus", TYPE_NUMBER},  {"times", TYPE_NUMBER},
+    {"divide", TYPE_NUMBER},  {"equal", TYPE_BOOL},    {"nonequal", TYPE_BOOL},
+    {"less", TYPE_BOOL},      {"lesseq", TYPE_BOOL},   {"greater", TYPE_BOOL},
+    {"greatereq", TYPE_BOOL}, {"and", TYPE_BOOL},      {"or", TYPE_BOOL},
+    {"not", TYPE_BOOL},       {"xor", TYPE_BOOL},      {"isint", TYPE_BOOL},
+    {"isreal", TYPE_BOOL},    {"isbool", TYPE_BOOL},   {"isnull", TYPE_BOOL},
+    {"isatom", TYPE_BOOL},    {"islist", TYPE_BOOL},   {"isempty", TYPE_BOOL},
+    {"tail", TYPE_LIST},      {"cons", TYPE_LIST},     {"head", TYPE_ANY},
+    {"range", TYPE_LIST},     {"eval", TYPE_ANY},      {"println", TYPE_ANY},
+    {"_trampoline", TYPE_ANY}, {"memo", TYPE_FUNCTION}, {"vec", TYPE_VECTOR},
+    {"vecrange", TYPE_VECTOR}, {"veclist", TYPE_LIST},
+    {"vecget", TYPE_NUMBER},  {"vecplus", TYPE_VECTOR},
+    {"vecminus", TYPE_VECTOR}, {"vectimes", TYPE_VECTOR},
+    {"vecdivide", TYPE_VECTOR}, {"vecless", TYPE_VECTOR},
+    {"veclesseq", TYPE_VECTOR}, {"vecgreater", TYPE_VECTOR},
+    {"vecgreatereq", TYPE_VECTOR}, {"vecequal", TYPE_VECTOR},
+    {"vecsum", TYPE_NUMBER},  {"vecdot", TYPE_NUMBER}, {"vecmin", TYPE_NUMBER},
+    {"vecmax", TYPE_NUMBER},  {"vecscan", TYPE_VECTOR}};
+
+TypeInference::TypeInference() {}
+
+TypeInference::~TypeInference() {}
+
+static bool is_builtin(string const &name) {
+  return BUILTIN_TYPES.find(name) != BUILTIN_TYPES.end();
+}
+
+static bool mentions(shared_ptr<ASTNode> const &node,
+                     set<string> const &names) {
+  if (node->node_type == LEAF)
+    return node->head->type == IDENTIFIER &&
+           names.find(node->head->value) != names.end();
+
+  for (auto const &child : node->children) {
+    if (mentions(child, names))
+      return true;
+  }
+
+  return false;
+}
+
+// evaluating node can not run user code, which could read a local of the
+// prog through the dynamic scope before it is assigned
+static bool is_simple(shared_ptr<ASTNode> const &node) {
+  switch (node->node_type) {
+  case LEAF:
+  case QUOTE_LIST:
+    return true;
+  case FUNCCALL: {
+    auto const &head = node->children[0];
+    if (head->node_type != LEAF || !is_builtin(head->head->value) ||
+        head->head->value == "eval" || head->head->value == "_trampoline")
+      return false;
+
+    for (int i = 1; i < node->children.size(); i++) {
+      if (!is_simple(node->children[i]))
+        return false;
+    }
+
+    return true;
+  }
+  case LIST:
+  case COND:
+    for (auto const &child : node->children) {
+      if (!is_simple(child))
+        return false;
+    }
+
+    return true;
+  default:
+    return false;
+  }
+}
+
+void TypeInference::collect(shared_ptr<ASTNode> const &node) {
+  switch (node->node_type) {
+  case LEAF:
+    if (node->head->type == IDENTIFIER)
+      escaped.insert(node->head->value);
+    return;
+
+  case FUNCDEF: {
+    auto funcdef = static_pointer_cast<FuncDefNode>(node);
+    functions[funcdef->getName()->value].push_back(funcdef);
+    collect(funcdef->getBody());
+    return;
+  }
+
+  case LAMBDA:
+    collect(node->children[1]);
+    return;
+
+  case FUNCCALL: {
+    auto const &head = node->children[0];
+    if (head->node_type == LEAF) {
+      if (head->head->value == "eval")
+        uses_eval = true;
+    } else if (head->node_type == FUNCDEF) {
+      // bound and called by the interpreter without a call site
+      escaped.insert(static_pointer_cast<FuncDefNode>(head)->getName()->value);
+      collect(static_pointer_cast<FuncDefNode>(head)->getBody());
+    } else
+      collect(head);
+
+    for (int i = 1; i < node->children.size(); i++) {
+      collect(node->children[i]);
+    }
+    return;
+  }
+
+  case PROG:
+  case SETQ:
+    for (int i = 1; i < node->children.size(); i++) {
+      collect(node->children[i]);
+    }
+    return;
+
+  default:
+    for (auto const &child : node->children) {
+      collect(child);
+    }
+  }
+}
+
+void TypeInference::bind(string const &name, unsigned type) {
+  auto variable = variables.emplace(name, type);
+
+  if (variable.second) {
+    changed = true;
+  } else if ((variable.first->second | type) != variable.first->second) {
+    variable.first->second |= type;
+    changed = true;
+  }
+}
+
+void TypeInference::bind_params(shared_ptr<ASTNode> const &params,
+                                unsigned type) {
+  for (auto const &param : params->children) {
+    bind(param->head->value, type);
+  }
+}
+
+// locals start as null, and so do the setq targets of a function body.
+// a local assigned by one of the leading setqs before anything could read
+// it never shows the null
+void TypeInference::visit_prog(shared_ptr<ASTNode> const &node, bool is_body) {
+  set<string> pending;
+
+  for (auto const &local : node->children[0]->children) {
+    pending.insert(local->head->value);
+  }
+
+  if (is_body) {
+    for (auto const &child : node->children) {
+      if (child->node_type == SETQ)
+        pending.insert(child->children[0]->head->value);
+    }
+  }
+
+  for (int i = 1; i < node->children.size(); i++) {
+    auto const &child = node->children[i];
+    if (child->node_type != SETQ || !is_simple(child->children[1]) ||
+        mentions(child->children[1], pending))
+      break;
+
+    pending.erase(child->children[0]->head->value);
+  }
+
+  for (auto const &name : pending) {
+    bind(name, TYPE_NULL);
+  }
+
+  for (int i = 1; i < node->children.size(); i++) {
+    visit(node->children[i]);
+  }
+}
+
+unsigned TypeInference::visit_call(shared_ptr<FuncCallNode> const &node) {
+  auto const &head = node->children[0];
+
+  vector<unsigned> args;
+  for (int i = 1; i < node->children.size(); i++) {
+    args.push_back(visit(node->children[i]));
+  }
+
+  if (head->node_type != LEAF) {
+    visit(head);
+    return TYPE_ANY;
+  }
+
+  auto const &name = head->head->value;
+
+  auto builtin = BUILTIN_TYPES.find(name);
+  if (builtin != BUILTIN_TYPES.end())
+    return builtin->second;
+
+  // a call by name binds the parameters of every function of that name.
+  // escaped functions got unknown parameters already
+  auto defs = functions.find(name);
+  if (defs != functions.end() && escaped.find(name) == escaped.end()) {
+    for (auto const &funcdef : defs->second) {
+      auto const &params = funcdef->getParams()->children;
+
+      for (int i = 0; i < params.size(); i++) {
+        bind(params[i]->head->value, i < args.size() ? args[i] : TYPE_ANY);
+      }
+    }
+  }
+
+  return TYPE_ANY;
+}
+
+unsigned TypeInference::visit(shared_ptr<ASTNode> const &node) {
+  unsigned type = TYPE_ANY;
+
+  switch (node->node_type) {
+  case LEAF:
+    switch (node->head->type) {
+    case INT:
+      type = TYPE_INT;
+      break;
+    case REAL:
+      type = TYPE_REAL;
+      break;
+    case BOOL:
+      type = TYPE_BOOL;
+      break;
+    case NUL:
+      type = TYPE_NULL;
+      break;
+    case IDENTIFIER: {
+      // a name that is never bound evaluates to itself
+      auto variable = variables.find(node->head->value);
+      type = variable != variables.end() ? variable->second : TYPE_ATOM;
+      break;
+    }
+    default:
+      type = TYPE_ATOM;
+    }
+    break;
+
+  case LIST:
+  case PARALLEL:
+    for (auto const &child : node->children) {
+      visit(child);
+    }
+    type = TYPE_LIST;
+    break;
+
+  case QUOTE_LIST:
+    type = TYPE_LIST;
+    break;
+
+  case FUNCCALL:
+    type = visit_call(static_pointer_cast<FuncCallNode>(node));
+    break;
+
+  case FUNCDEF: {
+    auto funcdef = static_pointer_cast<FuncDefNode>(node);
+    bind(funcdef->getName()->value, TYPE_FUNCTION);
+
+    if (escaped.find(funcdef->getName()->value) != escaped.end())
+      bind_params(funcdef->getParams(), TYPE_ANY);
+
+    if (funcdef->getBody()->node_type == PROG)
+      visit_prog(funcdef->getBody(), true);
+    else
+      visit(funcdef->getBody());
+
+    type = TYPE_FUNCTION;
+    break;
+  }
+
+  case LAMBDA:
+    bind_params(node->children[0], TYPE_ANY);
+
+    if (node->children[1]->node_type == PROG)
+      visit_prog(node->children[1], true);
+    else
+      visit(node->children[1]);
+
+    type = TYPE_FUNCTION;
+    break;
+
+  case PROG:
+    visit_prog(node, false);
+    break;
+
+  case SETQ:
+    bind(node->children[0]->head->value, visit(node->children[1]));
+    break;
+
+  case COND:
+    visit(node->children[0]);
+    type = visit(node->children[1]);
+
+    // without a false branch the node itself is the value
+    if (node->children.size() == 3)
+      type |= visit(node->children[2]);
+    else
+      type = TYPE_ANY;
+    break;
+
+  default:
+    for (auto const &child : node->children) {
+      visit(child);
+    }
+  }
+
+  node->inferred = type;
+
+  expressions++;
+  if (node->proven(TYPE_NUMBER) || node->proven(TYPE_BOOL) ||
+      node->proven(TYPE_LIST) || node->proven(TYPE_FUNCTION))
+    known++;
+
+  return type;
+}
+
+void TypeInference::infer(shared_ptr<ASTNode> const &root) {
+  collect(root);
+
+  // code built at runtime can bind anything
+  if (uses_eval)
+    return;
+
+  for (auto const &function : functions) {
+    if (escaped.find(function.first) == escaped.end())
+      continue;
+
+    for (auto const &funcdef : function.second) {
+      bind_params(funcdef->getParams(), TYPE_ANY);
+    }
+  }
+
+  // types only grow, the last pass changed nothing and left the final
+  // annotations
+  do {
+    changed = false;
+    expressions = known = 0;
+    visit(root);
+  } while (changed);
+}
+
+string TypeInference::type_name(unsigned type) {
+  if (type == 0)
+    return "none";
+
+  if (type == TYPE_ANY)
+    return "any";
+
+  const vector<pair<unsigned, string>> names = {
+      {TYPE_NUMBER, "number"}, {TYPE_INT, "int"},   {TYPE_REAL, "real"},
+      {TYPE_BOOL, "bool"},     {TYPE_NULL, "null"}, {TYPE_LIST, "list"},
+      {TYPE_FUNCTION, "function"}, {TYPE_ATOM, "atom"},
+      {TYPE_VECTOR, "vector"}};
+
+  string res;
+  for (auto const &name : names) {
+    if ((type & name.first) != name.first)
+      continue;
+
+    if (!res.empty())
+      res += " | ";
+    res += name.second;
+    type &= ~name.first;
+  }
+
+  return res;
+}
+
+void TypeInference::report(std::ostream &out) const {
+  out << "Inferred types:" << '\n';
+
+  if (uses_eval) {
+    out << "  none, the program uses eval" << '\n';
+    return;
+  }
+
+  for (auto const &variable : variables) {
+    // tmp variables of inlined calls
+    if (variable.first[0] == '_')
+      continue;
+
+    out << "  " << variable.first << ": " << type_name(variable.second)
+        << '\n';
+  }
+
+  out << known << " of " << expressions << " expressions have a known type"
+      << '\n';
+}
@@ -0,0 +1,49 @@
+#ifndef TYPE_INFERENCE_H
+#define TYPE_INFERENCE_H
+
+#include "../parser/ast.h"
+#include <map>
+#include <memory>
+#include <ostream>
+#include <set>
+#include <vector>
+
+using namespace flang;
+using std::map, std::set, std::shared_ptr, std::string, std::vector;
+
+// flow insensitive type inference. scoping is dynamic, so a name is typed
+// by the join of everything bound to it anywhere in the program, and an
+// expression by its operator and the types of its operands. runs after
+// semantic analysis, which already rejects reads of undefined names
+class TypeInference {
+public:
+  TypeInference();
+  ~TypeInference();
+
+  // sets ASTNode::inferred of every evaluated node under root
+  void infer(shared_ptr<ASTNode> const &root);
+
+  // inferred types of the program's names and how many expressions have
+  // a known type
+  void report(std::ostream &out) const;
+
+  static string type_name(unsigned type);
+
+private:
+  map<string, unsigned> variables;
+  map<string, vector<shared_ptr<FuncDefNode>>> functions;
+  set<string> escaped; // names read as values, their calls are not tracked
+  bool uses_eval = false;
+  bool changed = false;
+  size_t expressions = 0;
+  size_t known = 0;
+
+  void collect(shared_ptr<ASTNode> const &node);
+  void bind(string const &name, unsigned type);
+  unsigned visit(shared_ptr<ASTNode> const &node);
+  unsigned visit_call(shared_ptr<FuncCallNode> const &node);
+  void visit_prog(shared_ptr<ASTNode> const &node, bool is_body);
+  void bind_params(shared_ptr<ASTNode> const &params, unsigned type);
+};
+
+#endif
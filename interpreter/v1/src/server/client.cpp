@@ -0,0 +1,79 @@
+#include "protocol.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+// sends the files given, or stdin without any, to a server started with
+// --serve as the requests of one session. prints what each printed and its
+// value, exits with 1 if one of them failed
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " SOCKET [FILE]..." << '\n';
+    return 2;
+  }
+
+  std::vector<std::string> sources;
+  if (argc == 2) {
+    std::stringstream buffer;
+    buffer << std::cin.rdbuf();
+    sources.push_back(buffer.str());
+  }
+
+  for (int i = 2; i < argc; ++i) {
+    std::ifstream file(argv[i]);
+    if (!file) {
+      std::cerr << "Cannot open " << argv[i] << '\n';
+      return 2;
+    }
+
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    sources.push_back(buffer.str());
+  }
+
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (std::strlen(argv[1]) >= sizeof(address.sun_path)) {
+    std::cerr << "Socket path too long: " << argv[1] << '\n';
+    return 2;
+  }
+  std::strcpy(address.sun_path, argv[1]);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&address),
+                        sizeof(address)) < 0) {
+    std::cerr << "Cannot connect to " << argv[1] << ": "
+              << std::strerror(errno) << '\n';
+    return 2;
+  }
+
+  int res = 0;
+  for (auto const &source : sources) {
+    std::string status, output, value;
+    if (!protocol::write_message(fd, source) ||
+        !protocol::read_message(fd, status) ||
+        !protocol::read_message(fd, output) ||
+        !protocol::read_message(fd, value)) {
+      std::cerr << "Connection closed" << '\n';
+      close(fd);
+      return 2;
+    }
+
+    std::cout << output;
+    if (!value.empty())
+      std::cout << value << '\n';
+
+    if (status != "ok")
+      res = 1;
+  }
+
+  close(fd);
+  return res;
+}
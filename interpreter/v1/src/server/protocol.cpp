@@ -0,0 +1,65 @@
+#include "protocol.h"
+#include <cerrno>
+#include <cstdint>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static bool read_all(int fd, char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = read(fd, data, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+
+    data += n;
+    size -= n;
+  }
+
+  return true;
+}
+
+// the peer may be gone, that must not raise SIGPIPE
+static bool write_all(int fd, char const *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+
+    data += n;
+    size -= n;
+  }
+
+  return true;
+}
+
+bool protocol::read_message(int fd, std::string &message) {
+  unsigned char header[4];
+  if (!read_all(fd, reinterpret_cast<char *>(header), sizeof(header)))
+    return false;
+
+  uint32_t size = uint32_t(header[0]) << 24 | uint32_t(header[1]) << 16 |
+                  uint32_t(header[2]) << 8 | uint32_t(header[3]);
+  if (size > MAX_MESSAGE)
+    return false;
+
+  message.resize(size);
+  return read_all(fd, message.data(), size);
+}
+
+bool protocol::write_message(int fd, std::string const &message) {
+  if (message.size() > MAX_MESSAGE)
+    return false;
+
+  uint32_t size = message.size();
+  unsigned char header[4] = {
+      static_cast<unsigned char>(size >> 24),
+      static_cast<unsigned char>(size >> 16),
+      static_cast<unsigned char>(size >> 8), static_cast<unsigned char>(size)};
+
+  return write_all(fd, reinterpret_cast<char const *>(header),
+                   sizeof(header)) &&
+         write_all(fd, message.data(), message.size());
+}
@@ -0,0 +1,21 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cstddef>
+#include <string>
+
+// a message on the socket is its length as 4 bytes, big endian, followed by
+// that many bytes. a request is a message with the source to evaluate, its
+// response three messages: the status, "ok" or "error", what the evaluation
+// printed, and the printed value of its last expression
+namespace protocol {
+
+const size_t MAX_MESSAGE = size_t(64) << 20;
+
+// false at the end of the stream, on an error or a message above the maximum
+bool read_message(int fd, std::string &message);
+bool write_message(int fd, std::string const &message);
+
+} // namespace protocol
+
+#endif
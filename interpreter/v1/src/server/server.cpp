@@ -0,0 +1,90 @@
+#include "server.h"
+#include "../utils/output.h"
+#include "protocol.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+Server::Server(flang::Engine const &engine) : engine(engine) {}
+
+int Server::serve(std::string const &path) {
+  CapturedOutput::install();
+
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    std::cerr << "Socket path too long: " << path << '\n';
+    return 1;
+  }
+  std::strcpy(address.sun_path, path.c_str());
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    std::cerr << "Cannot create socket: " << std::strerror(errno) << '\n';
+    return 1;
+  }
+
+  // a socket left behind by a server before
+  unlink(path.c_str());
+
+  if (bind(listener, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) < 0 ||
+      listen(listener, SOMAXCONN) < 0) {
+    std::cerr << "Cannot listen on " << path << ": " << std::strerror(errno)
+              << '\n';
+    close(listener);
+    return 1;
+  }
+
+  std::cout << "Listening on " << path << '\n' << std::flush;
+
+  while (true) {
+    int fd = accept(listener, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+
+      std::cerr << "Cannot accept: " << std::strerror(errno) << '\n';
+      break;
+    }
+
+    std::thread(&Server::session, this, fd).detach();
+  }
+
+  close(listener);
+  unlink(path.c_str());
+  return 1;
+}
+
+void Server::session(int fd) {
+  auto session = engine.fork();
+
+  // requests share their bindings, no request sees the whole program
+  session->set_type_inference(false);
+
+  std::string source;
+  while (protocol::read_message(fd, source)) {
+    std::string status = "ok", value;
+    CapturedOutput output;
+    session->capture(&output);
+
+    try {
+      value = session->to_string(session->eval(source));
+    } catch (std::exception &e) {
+      status = "error";
+      output.out += e.what();
+      output.out += '\n';
+    }
+
+    if (!protocol::write_message(fd, status) ||
+        !protocol::write_message(fd, output.out + output.err) ||
+        !protocol::write_message(fd, value))
+      break;
+  }
+
+  close(fd);
+}
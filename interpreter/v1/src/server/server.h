@@ -0,0 +1,25 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "../engine/engine.h"
+#include <string>
+
+// evaluates source sent over a unix socket, see protocol.h. every
+// connection is a session with an engine of its own, forked from the one
+// given with the modules loaded before. the requests of a session share
+// their bindings like the cells of the repl
+class Server {
+public:
+  Server(flang::Engine const &engine);
+
+  // serves every connection on path on a thread of its own. returns only if
+  // the socket cannot be set up or accepting fails
+  int serve(std::string const &path);
+
+private:
+  flang::Engine const &engine;
+
+  void session(int fd);
+};
+
+#endif
@@ -0,0 +1,220 @@
+#include "dict.h"
+#include <atomic>
+
+namespace {
+
+const unsigned BITS = 5;
+const unsigned HASH_BITS = 64;
+
+std::atomic<uint64_t> edits{0};
+
+void combine(size_t &hash, size_t value) {
+  hash ^= value + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+}
+
+// leaves by their text, like equal compares them, and quoted lists like
+// the ones built at runtime
+size_t hash_key(shared_ptr<ASTNode> const &key) {
+  if (key->node_type == LEAF)
+    return std::hash<string>()(key->head->value);
+
+  size_t hash = key->children.size();
+  for (auto const &child : key->children) {
+    combine(hash, hash_key(child));
+  }
+  return hash;
+}
+
+bool equal_keys(shared_ptr<ASTNode> const &a, shared_ptr<ASTNode> const &b) {
+  if (a == b)
+    return true;
+
+  if ((a->node_type == LEAF) != (b->node_type == LEAF))
+    return false;
+  if (a->node_type == LEAF)
+    return a->head->value == b->head->value;
+
+  if (a->children.size() != b->children.size())
+    return false;
+
+  for (size_t i = 0; i < a->children.size(); i++) {
+    if (!equal_keys(a->children[i], b->children[i]))
+      return false;
+  }
+  return true;
+}
+
+// node itself if edit owns it, else a copy owned by edit
+shared_ptr<HamtNode> editable(shared_ptr<HamtNode> const &node, uint64_t edit) {
+  if (edit != 0 && node->edit == edit)
+    return node;
+
+  auto res = make_shared<HamtNode>(*node);
+  res->edit = edit;
+  return res;
+}
+
+shared_ptr<ASTNode> find(HamtNode const *node, unsigned shift, size_t hash,
+                         shared_ptr<ASTNode> const &key) {
+  while (shift < HASH_BITS) {
+    uint32_t bit = 1u << ((hash >> shift) & 31);
+    if ((node->bitmap & bit) == 0)
+      return nullptr;
+
+    auto const &slot =
+        node->slots[__builtin_popcount(node->bitmap & (bit - 1))];
+    if (slot.node == nullptr)
+      return slot.hash == hash && equal_keys(slot.key, key) ? slot.value
+                                                            : nullptr;
+
+    node = slot.node.get();
+    shift += BITS;
+  }
+
+  for (auto const &slot : node->slots) {
+    if (equal_keys(slot.key, key))
+      return slot.value;
+  }
+  return nullptr;
+}
+
+// node with key set to value. the nodes edit owns are changed in place,
+// the others on the path are copied
+shared_ptr<HamtNode> assoc(shared_ptr<HamtNode> const &node, unsigned shift,
+                           size_t hash, shared_ptr<ASTNode> const &key,
+                           shared_ptr<ASTNode> const &value, uint64_t edit,
+                           bool &added) {
+  if (shift >= HASH_BITS) {
+    for (size_t i = 0; i < node->slots.size(); i++) {
+      if (!equal_keys(node->slots[i].key, key))
+        continue;
+
+      auto res = editable(node, edit);
+      res->slots[i].value = value;
+      return res;
+    }
+
+    auto res = editable(node, edit);
+    res->slots.push_back({nullptr, hash, key, value});
+    added = true;
+    return res;
+  }
+
+  uint32_t bit = 1u << ((hash >> shift) & 31);
+  size_t index = __builtin_popcount(node->bitmap & (bit - 1));
+
+  if ((node->bitmap & bit) == 0) {
+    auto res = editable(node, edit);
+    res->slots.insert(res->slots.begin() + index, {nullptr, hash, key, value});
+    res->bitmap |= bit;
+    added = true;
+    return res;
+  }
+
+  auto const &slot = node->slots[index];
+
+  if (slot.node != nullptr) {
+    auto child = assoc(slot.node, shift + BITS, hash, key, value, edit, added);
+    if (child == slot.node)
+      return node;
+
+    auto res = editable(node, edit);
+    res->slots[index].node = child;
+    return res;
+  }
+
+  if (slot.hash == hash && equal_keys(slot.key, key)) {
+    auto res = editable(node, edit);
+    res->slots[index].value = value;
+    return res;
+  }
+
+  // the entry there and the new one go one level down
+  bool moved = false;
+  auto child = make_shared<HamtNode>();
+  child->edit = edit;
+  child = assoc(child, shift + BITS, slot.hash, slot.key, slot.value, edit,
+                moved);
+  child = assoc(child, shift + BITS, hash, key, value, edit, added);
+
+  auto res = editable(node, edit);
+  res->slots[index] = {child, 0, nullptr, nullptr};
+  return res;
+}
+
+void for_each_entry(
+    HamtNode const &node,
+    std::function<void(shared_ptr<ASTNode> const &,
+                       shared_ptr<ASTNode> const &)> const &f) {
+  for (auto const &slot : node.slots) {
+    if (slot.node != nullptr)
+      for_each_entry(*slot.node, f);
+    else
+      f(slot.key, slot.value);
+  }
+}
+
+} // namespace
+
+bool is_key(shared_ptr<ASTNode> const &node) {
+  if (node->node_type == LEAF)
+    return true;
+  if (node->node_type != LIST && node->node_type != QUOTE_LIST)
+    return false;
+
+  for (auto const &child : node->children) {
+    if (!is_key(child))
+      return false;
+  }
+  return true;
+}
+
+DictNode::DictNode(Span span)
+    : ASTNode(DICT, make_shared<Token>(LITERAL, "<dict>", span)),
+      root(make_shared<HamtNode>()) {}
+
+size_t DictNode::size() const { return count; }
+
+shared_ptr<ASTNode> DictNode::get(shared_ptr<ASTNode> const &key) const {
+  return find(root.get(), 0, hash_key(key), key);
+}
+
+shared_ptr<DictNode> DictNode::put(shared_ptr<ASTNode> const &key,
+                                   shared_ptr<ASTNode> const &value) {
+  // the nodes are shared from now on
+  if (edit != 0)
+    edit = 0;
+
+  bool added = false;
+  auto res = make_shared<DictNode>(head->span);
+  res->root = assoc(root, 0, hash_key(key), key, value, 0, added);
+  res->count = count + added;
+  return res;
+}
+
+void DictNode::put_in_place(shared_ptr<ASTNode> const &key,
+                            shared_ptr<ASTNode> const &value) {
+  if (edit == 0)
+    edit = ++edits;
+
+  bool added = false;
+  root = assoc(root, 0, hash_key(key), key, value, edit, added);
+  count += added;
+}
+
+void DictNode::for_each(
+    std::function<void(shared_ptr<ASTNode> const &,
+                       shared_ptr<ASTNode> const &)> const &f) const {
+  for_each_entry(*root, f);
+}
+
+shared_ptr<ASTNode> DictNode::copy() {
+  if (edit != 0)
+    edit = 0;
+
+  auto node = make_shared<DictNode>(head->span);
+  node->root = root;
+  node->count = count;
+  node->inferred = inferred;
+  return node;
+}
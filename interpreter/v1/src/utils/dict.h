@@ -0,0 +1,66 @@
+#ifndef DICT_H
+#define DICT_H
+
+#include "../parser/ast.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+using namespace flang;
+
+// a node of the hash array mapped trie of a dict. every level takes five
+// more bits of the hash, bitmap tells which of the 32 slots are used and
+// each holds an entry or a node one level down. past the last bit a node
+// holds entries of equal hashes only, in slots without a bitmap
+struct HamtNode {
+  struct Slot {
+    shared_ptr<HamtNode> node; // nullptr for an entry
+    size_t hash = 0;
+    shared_ptr<ASTNode> key;
+    shared_ptr<ASTNode> value;
+  };
+
+  uint32_t bitmap = 0;
+  vector<Slot> slots;
+  uint64_t edit = 0; // of the dict that may change it in place, 0 for none
+};
+
+// a dict made by the dict builtins, only ever a value. keys are leaves and
+// lists of keys, hashed and compared by value. put makes a dict that shares
+// all nodes but the ones on the path to its key with this one,
+// put_in_place changes this one and copies only the nodes it shares
+class DictNode : public ASTNode {
+public:
+  explicit DictNode(Span span);
+
+  size_t size() const;
+
+  // the value of key, nullptr without one
+  shared_ptr<ASTNode> get(shared_ptr<ASTNode> const &key) const;
+
+  shared_ptr<DictNode> put(shared_ptr<ASTNode> const &key,
+                           shared_ptr<ASTNode> const &value);
+  void put_in_place(shared_ptr<ASTNode> const &key,
+                    shared_ptr<ASTNode> const &value);
+
+  // the entries in the order of their hashes
+  void for_each(std::function<void(shared_ptr<ASTNode> const &,
+                                   shared_ptr<ASTNode> const &)> const &f)
+      const;
+
+  shared_ptr<ASTNode> copy() override;
+
+private:
+  shared_ptr<HamtNode> root;
+  size_t count = 0;
+
+  // the nodes made by put_in_place carry it until they are shared, then the
+  // dict gets a new one
+  uint64_t edit = 0;
+};
+
+// whether a value can be a key of a dict
+bool is_key(shared_ptr<ASTNode> const &node);
+
+#endif
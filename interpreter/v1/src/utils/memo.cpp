@@ -0,0 +1,125 @@
+#include "memo.h"
+#include <functional>
+
+MemoCache::MemoCache(size_t capacity) : capacity(capacity) {}
+
+MemoCache::~MemoCache() {}
+
+size_t MemoCache::size() const { return entries.size(); }
+
+static void combine(size_t &hash, size_t value) {
+  hash ^= value + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+}
+
+// hashes leaves and lists of them, a function value has no structure that
+// would make two calls with it equal. nodes counts down the nodes hashed
+static bool hash_value(shared_ptr<ASTNode> const &node, size_t &hash,
+                       size_t &nodes) {
+  if (nodes == 0)
+    return false;
+  nodes--;
+
+  combine(hash, node->node_type);
+
+  switch (node->node_type) {
+  case LEAF:
+    combine(hash, node->head->type);
+    combine(hash, std::hash<string>()(node->head->value));
+    return true;
+
+  case LIST:
+  case QUOTE_LIST:
+    combine(hash, node->children.size());
+    for (auto const &child : node->children) {
+      if (!hash_value(child, hash, nodes))
+        return false;
+    }
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+static bool equal_values(shared_ptr<ASTNode> const &a,
+                         shared_ptr<ASTNode> const &b) {
+  if (a == b)
+    return true;
+
+  if (a->node_type != b->node_type ||
+      a->children.size() != b->children.size())
+    return false;
+
+  if (a->node_type == LEAF)
+    return a->head->type == b->head->type && a->head->value == b->head->value;
+
+  for (size_t i = 0; i < a->children.size(); i++) {
+    if (!equal_values(a->children[i], b->children[i]))
+      return false;
+  }
+
+  return true;
+}
+
+bool MemoCache::key(shared_ptr<ASTNode> const &function,
+                    vector<shared_ptr<ASTNode>> const &args,
+                    size_t &hash) const {
+  size_t nodes = MAX_KEY_NODES;
+
+  hash = std::hash<ASTNode *>()(function.get());
+  for (auto const &arg : args) {
+    if (!hash_value(arg, hash, nodes))
+      return false;
+  }
+
+  return true;
+}
+
+shared_ptr<ASTNode> MemoCache::find(shared_ptr<ASTNode> const &function,
+                                    vector<shared_ptr<ASTNode>> const &args) {
+  size_t hash;
+  if (!key(function, args, hash))
+    return nullptr;
+
+  auto range = index.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    auto entry = it->second;
+    if (entry->function != function || entry->args.size() != args.size())
+      continue;
+
+    bool same = true;
+    for (size_t i = 0; i < args.size() && same; i++) {
+      same = equal_values(entry->args[i], args[i]);
+    }
+
+    if (same) {
+      entries.splice(entries.begin(), entries, entry);
+      return entry->result;
+    }
+  }
+
+  return nullptr;
+}
+
+void MemoCache::insert(shared_ptr<ASTNode> const &function,
+                       vector<shared_ptr<ASTNode>> const &args,
+                       shared_ptr<ASTNode> const &result) {
+  size_t hash;
+  if (capacity == 0 || !key(function, args, hash))
+    return;
+
+  if (entries.size() == capacity) {
+    auto const &last = entries.back();
+    auto range = index.equal_range(last.hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second == std::prev(entries.end())) {
+        index.erase(it);
+        break;
+      }
+    }
+    entries.pop_back();
+  }
+
+  entries.push_front(Entry{hash, function, args, result});
+  index.emplace(hash, entries.begin());
+}
@@ -0,0 +1,54 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include "../parser/ast.h"
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+using namespace flang;
+
+// results of calls of pure functions, keyed by the closure called and the
+// structure of the argument values. keeps at most capacity entries and
+// drops the least recently used one first. an entry holds its closure, so a
+// closure made later never reuses the address of a cached one
+class MemoCache {
+public:
+  static constexpr size_t CAPACITY = 1 << 16;
+
+  // arguments with more nodes are not hashed, the call is not cached
+  static constexpr size_t MAX_KEY_NODES = 256;
+
+  MemoCache(size_t capacity = CAPACITY);
+  ~MemoCache();
+
+  // the cached result of the call or nullptr
+  shared_ptr<ASTNode> find(shared_ptr<ASTNode> const &function,
+                           vector<shared_ptr<ASTNode>> const &args);
+
+  // nothing is kept for arguments that are not plain values
+  void insert(shared_ptr<ASTNode> const &function,
+              vector<shared_ptr<ASTNode>> const &args,
+              shared_ptr<ASTNode> const &result);
+
+  size_t size() const;
+
+private:
+  struct Entry {
+    size_t hash;
+    shared_ptr<ASTNode> function;
+    vector<shared_ptr<ASTNode>> args;
+    shared_ptr<ASTNode> result;
+  };
+
+  size_t capacity;
+  std::list<Entry> entries; // most recently used first
+  std::unordered_multimap<size_t, std::list<Entry>::iterator> index;
+
+  bool key(shared_ptr<ASTNode> const &function,
+           vector<shared_ptr<ASTNode>> const &args, size_t &hash) const;
+};
+
+#endif
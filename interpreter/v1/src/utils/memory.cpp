@@ -0,0 +1,70 @@
+#include "memory.h"
+#include "../semantic/semantic_analyzer.h"
+#include <cstdlib>
+#include <new>
+
+thread_local MemoryAccount *MemoryAccount::current = nullptr;
+
+void MemoryAccount::release(size_t size) {
+  // the account is malloc'ed so freeing it does not recurse into delete
+  if (used.fetch_sub(size, std::memory_order_acq_rel) == size) {
+    this->~MemoryAccount();
+    std::free(this);
+  }
+}
+
+void MemoryAccount::leave() {
+  if (trackers.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    release(BIAS);
+}
+
+MemoryTracker::MemoryTracker(size_t limit) : limit(limit) {
+  void *storage = std::malloc(sizeof(MemoryAccount));
+
+  if (storage == nullptr)
+    throw std::bad_alloc();
+
+  account = new (storage) MemoryAccount();
+}
+
+MemoryTracker::~MemoryTracker() { account->leave(); }
+
+size_t MemoryTracker::live() const {
+  return account->used.load(std::memory_order_relaxed) - MemoryAccount::BIAS;
+}
+
+size_t MemoryTracker::peak() const {
+  return account->peak.load(std::memory_order_relaxed);
+}
+
+size_t MemoryTracker::get_limit() const { return limit; }
+
+void MemoryTracker::set_limit(size_t limit) { this->limit = limit; }
+
+void MemoryTracker::share(MemoryTracker const &other) {
+  other.account->trackers.fetch_add(1, std::memory_order_relaxed);
+  account->leave();
+  account = other.account;
+  limit = other.limit;
+}
+
+void MemoryTracker::exceeded(Span span) const {
+  size_t used = live();
+
+  // the error message itself must not be charged to the exhausted account
+  MemoryAccount *saved = MemoryAccount::current;
+  MemoryAccount::current = nullptr;
+  RuntimeError error(span, "memory limit of " + to_string(limit) +
+                               " bytes exceeded (" + to_string(used) +
+                               " bytes live)");
+  MemoryAccount::current = saved;
+
+  throw error;
+}
+
+MemoryScope::MemoryScope(MemoryTracker &tracker)
+    : previous(MemoryAccount::current) {
+  MemoryAccount::current = tracker.account;
+}
+
+MemoryScope::~MemoryScope() { MemoryAccount::current = previous; }
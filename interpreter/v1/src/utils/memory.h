@@ -0,0 +1,90 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include "../parser/ast.h"
+#include <atomic>
+#include <cstddef>
+
+using namespace flang;
+
+// byte counter charged by the global operator new while an owning tracker is
+// active. the trackers hold a large bias on top of the live bytes together,
+// so the account stays alive until both the last tracker and the last block
+// it paid for are gone.
+//
+// that operator new is in utils/memory_hooks.cpp, which flang_repl links in
+// and libflang leaves out, because it replaces the allocation functions of the
+// whole program. a program embedding libflang links obj/memory_hooks.o too if
+// it wants memory limits and peaks, without it every account stays at 0
+struct MemoryAccount {
+  static constexpr size_t BIAS = size_t(1) << 62;
+
+  // charged on this thread, null outside a MemoryScope
+  static thread_local MemoryAccount *current;
+
+  std::atomic<size_t> used;
+  std::atomic<size_t> peak;
+  std::atomic<unsigned> trackers;
+
+  MemoryAccount() : used(BIAS), peak(0), trackers(1) {}
+
+  void allocate(size_t size) {
+    size_t now = used.fetch_add(size, std::memory_order_relaxed) + size - BIAS;
+
+    // threads sharing the account may race to raise the peak
+    size_t seen = peak.load(std::memory_order_relaxed);
+    while (now > seen &&
+           !peak.compare_exchange_weak(seen, now, std::memory_order_relaxed)) {
+    }
+  }
+
+  void release(size_t size);
+  void leave(); // by a tracker
+};
+
+class MemoryTracker {
+public:
+  MemoryTracker(size_t limit = 0);
+  ~MemoryTracker();
+
+  MemoryTracker(MemoryTracker const &) = delete;
+  MemoryTracker &operator=(MemoryTracker const &) = delete;
+
+  size_t live() const;
+  size_t peak() const;
+
+  size_t get_limit() const;
+  void set_limit(size_t limit); // 0 means no limit
+
+  // charges to the account of other from now on, with its limit, so the
+  // limit and the peak cover the allocations under both trackers. for the
+  // interpreters of workers
+  void share(MemoryTracker const &other);
+
+  // throws RuntimeError if live bytes are above the limit
+  void check(Span span) const {
+    if (limit != 0 &&
+        account->used.load(std::memory_order_relaxed) > limit + account->BIAS)
+      exceeded(span);
+  }
+
+private:
+  friend class MemoryScope;
+
+  MemoryAccount *account;
+  size_t limit;
+
+  [[noreturn]] void exceeded(Span span) const;
+};
+
+// charges allocations of the current thread to the tracker while alive
+class MemoryScope {
+public:
+  MemoryScope(MemoryTracker &tracker);
+  ~MemoryScope();
+
+private:
+  MemoryAccount *previous;
+};
+
+#endif
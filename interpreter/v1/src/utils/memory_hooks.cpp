@@ -0,0 +1,88 @@
+#include "memory.h"
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// not part of libflang, see MemoryAccount
+
+namespace {
+
+// every block from operator new starts with the account it was charged to
+// and its size, so it is credited back to the same account on delete
+struct BlockHeader {
+  MemoryAccount *account;
+  size_t size;
+};
+
+constexpr size_t HEADER_SIZE = alignof(std::max_align_t) > sizeof(BlockHeader)
+                                   ? alignof(std::max_align_t)
+                                   : sizeof(BlockHeader);
+
+void *tracked_alloc(size_t size) noexcept {
+  if (size > SIZE_MAX - HEADER_SIZE)
+    return nullptr;
+
+  size_t total = size + HEADER_SIZE;
+  void *block = std::malloc(total);
+
+  if (block == nullptr)
+    return nullptr;
+
+  MemoryAccount *account = MemoryAccount::current;
+  *static_cast<BlockHeader *>(block) = BlockHeader{account, total};
+
+  if (account != nullptr)
+    account->allocate(total);
+
+  return static_cast<char *>(block) + HEADER_SIZE;
+}
+
+void tracked_free(void *ptr) noexcept {
+  if (ptr == nullptr)
+    return;
+
+  void *block = static_cast<char *>(ptr) - HEADER_SIZE;
+  BlockHeader header = *static_cast<BlockHeader *>(block);
+
+  if (header.account != nullptr)
+    header.account->release(header.size);
+
+  std::free(block);
+}
+
+void *tracked_new(size_t size) {
+  void *ptr = tracked_alloc(size);
+
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+
+  return ptr;
+}
+
+} // namespace
+
+// global allocation functions, the aligned overloads keep the default ones
+
+void *operator new(size_t size) { return tracked_new(size); }
+void *operator new[](size_t size) { return tracked_new(size); }
+
+void *operator new(size_t size, std::nothrow_t const &) noexcept {
+  return tracked_alloc(size);
+}
+
+void *operator new[](size_t size, std::nothrow_t const &) noexcept {
+  return tracked_alloc(size);
+}
+
+void operator delete(void *ptr) noexcept { tracked_free(ptr); }
+void operator delete[](void *ptr) noexcept { tracked_free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { tracked_free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { tracked_free(ptr); }
+
+void operator delete(void *ptr, std::nothrow_t const &) noexcept {
+  tracked_free(ptr);
+}
+
+void operator delete[](void *ptr, std::nothrow_t const &) noexcept {
+  tracked_free(ptr);
+}
@@ -0,0 +1,101 @@
+#include "output.h"
+#include <climits>
+#include <cwchar>
+#include <iostream>
+#include <mutex>
+#include <streambuf>
+
+namespace {
+
+thread_local CapturedOutput *current_output = nullptr;
+
+// the workers of a pool and the tasks of a scheduler share the capture of
+// the thread that started them
+std::mutex capture_lock;
+
+void append(std::string &text, char const *s, std::streamsize n) {
+  text.append(s, n);
+}
+
+void append(std::string &text, wchar_t const *s, std::streamsize n) {
+  std::mbstate_t state{};
+  char buffer[MB_LEN_MAX];
+
+  for (std::streamsize i = 0; i < n; i++) {
+    size_t length = std::wcrtomb(buffer, s[i], &state);
+
+    if (length == static_cast<size_t>(-1)) {
+      text += '?';
+      state = std::mbstate_t{};
+    } else
+      text.append(buffer, length);
+  }
+}
+
+// unbuffered, so every write comes here and goes to the capture of the
+// thread writing it, or to the buffer the stream had before
+template <typename Char> class Redirect : public std::basic_streambuf<Char> {
+public:
+  using traits_type = std::char_traits<Char>;
+  using int_type = typename traits_type::int_type;
+
+  Redirect(std::basic_streambuf<Char> *target,
+           std::string CapturedOutput::*text)
+      : target(target), text(text) {}
+
+protected:
+  int_type overflow(int_type c) override {
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+      return traits_type::not_eof(c);
+
+    Char ch = traits_type::to_char_type(c);
+    return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+  }
+
+  std::streamsize xsputn(Char const *s, std::streamsize n) override {
+    if (current_output == nullptr)
+      return target->sputn(s, n);
+
+    std::lock_guard<std::mutex> guard(capture_lock);
+    append(current_output->*text, s, n);
+    return n;
+  }
+
+  int sync() override {
+    return current_output == nullptr ? target->pubsync() : 0;
+  }
+
+private:
+  std::basic_streambuf<Char> *target;
+  std::string CapturedOutput::*text;
+};
+
+} // namespace
+
+void CapturedOutput::print() const {
+  std::cout << out << std::flush;
+  std::cerr << err << std::flush;
+}
+
+void CapturedOutput::install() {
+  static bool installed = false;
+  if (installed)
+    return;
+  installed = true;
+
+  static Redirect<char> out(std::cout.rdbuf(), &CapturedOutput::out);
+  static Redirect<wchar_t> wout(std::wcout.rdbuf(), &CapturedOutput::out);
+  static Redirect<char> err(std::cerr.rdbuf(), &CapturedOutput::err);
+
+  std::cout.rdbuf(&out);
+  std::wcout.rdbuf(&wout);
+  std::cerr.rdbuf(&err);
+}
+
+CapturedOutput *CapturedOutput::current() { return current_output; }
+
+OutputScope::OutputScope(CapturedOutput &output) : previous(current_output) {
+  current_output = &output;
+}
+
+OutputScope::~OutputScope() { current_output = previous; }
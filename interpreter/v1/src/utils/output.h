@@ -0,0 +1,39 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <string>
+
+// text a thread wrote to the standard streams while an OutputScope on it was
+// alive. wide output is kept as multibyte text of the current locale
+class CapturedOutput {
+public:
+  std::string out; // cout and wcout
+  std::string err; // cerr
+
+  // writes the text to cout and cerr
+  void print() const;
+
+  // puts buffers in front of cout, wcout and cerr that send the text of a
+  // thread to its capture, and everything else on as before. call once while
+  // a single thread is running, before the first OutputScope
+  static void install();
+
+  // the capture of the current thread, nullptr without one
+  static CapturedOutput *current();
+};
+
+// captures what the current thread writes while alive. threads may write
+// to the same capture at once
+class OutputScope {
+public:
+  OutputScope(CapturedOutput &output);
+  ~OutputScope();
+
+  OutputScope(OutputScope const &) = delete;
+  OutputScope &operator=(OutputScope const &) = delete;
+
+private:
+  CapturedOutput *previous;
+};
+
+#endif
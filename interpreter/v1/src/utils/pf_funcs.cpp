@@ -1,4 +1,6 @@
 #include "pf_funcs.h"
+#include <charconv>
+#include <climits>
 
 shared_ptr<ASTNode> pf_plus(vector<shared_ptr<ASTNode>> &args) {
   double result = 0;
@@ -162,6 +164,39 @@ void print_func(shared_ptr<ASTNode> const &node) {
     for (auto &arg : node->children)
       print_func(arg);
     wcout << ") ";
+  } else if (node->node_type == ASTNodeType::VECTOR) {
+    auto vec = static_pointer_cast<VectorNode>(node);
+    wcout << "#( ";
+    for (size_t i = 0; i < vec->size(); i++)
+      wcout << vec->text(i).c_str() << ' ';
+    wcout << ") ";
+  } else if (node->node_type == ASTNodeType::STREAM) {
+    // the items computed so far, printing forces none
+    wcout << "'( ";
+    auto rest = node;
+    while (rest->node_type == ASTNodeType::STREAM) {
+      auto cell = static_pointer_cast<StreamNode>(rest);
+      print_func(cell->first);
+
+      std::lock_guard<std::mutex> guard(cell->lock);
+      rest = cell->rest;
+      if (rest == nullptr) {
+        wcout << "... ) ";
+        return;
+      }
+    }
+
+    for (auto &arg : rest->children)
+      print_func(arg);
+    wcout << ") ";
+  } else if (node->node_type == ASTNodeType::DICT) {
+    wcout << "#{ ";
+    static_pointer_cast<DictNode>(node)->for_each(
+        [](shared_ptr<ASTNode> const &key, shared_ptr<ASTNode> const &value) {
+          print_func(key);
+          print_func(value);
+        });
+    wcout << "} ";
   } else
     throw RuntimeError(node->head->span,
                        "println: invalid argument type " + node->head->value);
@@ -208,6 +243,45 @@ shared_ptr<ASTNode> pf_equal(vector<shared_ptr<ASTNode>> &args) {
         ASTNodeType::LEAF,
         make_shared<Token>(TokenType::BOOL, "true", token1.span));
 
+  // equal when the numbers print the same, like leaves
+  case ASTNodeType::VECTOR: {
+    auto vec1 = static_pointer_cast<VectorNode>(args[0]);
+    auto vec2 = static_pointer_cast<VectorNode>(args[1]);
+    bool equal = vec1->size() == vec2->size();
+
+    for (size_t i = 0; equal && i < vec1->size(); i++) {
+      equal = vec1->text(i) == vec2->text(i);
+    }
+
+    return make_shared<ASTNode>(
+        ASTNodeType::LEAF,
+        make_shared<Token>(TokenType::BOOL, equal ? "true" : "false",
+                           token1.span));
+  }
+
+  // equal when they have the same keys with equal values
+  case ASTNodeType::DICT: {
+    auto dict1 = static_pointer_cast<DictNode>(args[0]);
+    auto dict2 = static_pointer_cast<DictNode>(args[1]);
+    bool equal = dict1->size() == dict2->size();
+
+    if (equal)
+      dict1->for_each([&](shared_ptr<ASTNode> const &key,
+                          shared_ptr<ASTNode> const &value) {
+        if (!equal)
+          return;
+
+        auto other = dict2->get(key);
+        vector<shared_ptr<ASTNode>> arg = {value, other};
+        equal = other != nullptr && pf_equal(arg)->head->value == "true";
+      });
+
+    return make_shared<ASTNode>(
+        ASTNodeType::LEAF,
+        make_shared<Token>(TokenType::BOOL, equal ? "true" : "false",
+                           token1.span));
+  }
+
   default:
     throw RuntimeError(args[0]->head->span,
                        "equal: invalid argument type " + args[0]->head->value);
@@ -530,7 +604,9 @@ shared_ptr<ASTNode> pf_head(vector<shared_ptr<ASTNode>> &args) {
       throw RuntimeError(args[0]->head->span, "head: empty list");
 
     return args[0]->children[0];
-  } else
+  } else if (args[0]->node_type == ASTNodeType::STREAM)
+    return static_pointer_cast<StreamNode>(args[0])->first;
+  else
     throw RuntimeError(args[0]->head->span,
                        "head: invalid argument type " + args[0]->head->value);
 }
@@ -544,7 +620,19 @@ shared_ptr<ASTNode> pf_tail(vector<shared_ptr<ASTNode>> &args) {
     vector<shared_ptr<ASTNode>> res = args[0]->children;
     res.erase(res.begin());
 
-    return make_shared<ListNode>(res);
+    return make_list(res);
+  } else if (args[0]->node_type == ASTNodeType::STREAM &&
+             static_pointer_cast<StreamNode>(args[0])->kind ==
+                 StreamNode::RANGE) {
+    return range_rest(*static_pointer_cast<StreamNode>(args[0]));
+  } else if (args[0]->node_type == ASTNodeType::STREAM) {
+    // the rest may call functions of the program, the interpreter
+    // evaluates the call returned like the result of eval
+    auto name = make_shared<Token>(TokenType::IDENTIFIER, "_streamrest",
+                                   args[0]->head->span);
+    return make_shared<FuncCallNode>(
+        name, vector<shared_ptr<ASTNode>>{
+                  make_shared<ASTNode>(ASTNodeType::LEAF, name), args[0]});
   } else
     throw RuntimeError(args[0]->head->span,
                        "tail: invalid argument type " + args[0]->head->value);
@@ -556,7 +644,7 @@ shared_ptr<ASTNode> pf_cons(vector<shared_ptr<ASTNode>> &args) {
     vector<shared_ptr<ASTNode>> res = {args[0]};
     res.insert(res.end(), args[1]->children.begin(), args[1]->children.end());
 
-    return make_shared<ListNode>(res);
+    return make_list(res);
   } else
     throw RuntimeError(args[1]->head->span,
                        "cons: invalid argument type " + args[0]->head->value);
@@ -573,7 +661,852 @@ shared_ptr<ASTNode> pf_isempty(vector<shared_ptr<ASTNode>> &args) {
       return make_shared<ASTNode>(
           ASTNodeType::LEAF,
           make_shared<Token>(TokenType::BOOL, "false", args[0]->head->span));
-  } else
+  } else if (args[0]->node_type == ASTNodeType::STREAM)
+    // a stream has a first item, its end is an empty list
+    return make_shared<ASTNode>(
+        ASTNodeType::LEAF,
+        make_shared<Token>(TokenType::BOOL, "false", args[0]->head->span));
+  else
     throw RuntimeError(args[0]->head->span, "isempty: invalid argument type " +
                                                 args[0]->head->value);
 }
+
+shared_ptr<ASTNode> pf_reverse(vector<shared_ptr<ASTNode>> &args) {
+  if (args[0]->node_type == ASTNodeType::LIST ||
+      args[0]->node_type == ASTNodeType::QUOTE_LIST) {
+    vector<shared_ptr<ASTNode>> res(args[0]->children.rbegin(),
+                                    args[0]->children.rend());
+
+    return make_list(res);
+  } else
+    throw RuntimeError(args[0]->head->span, "reverse: invalid argument type " +
+                                                args[0]->head->value);
+}
+
+shared_ptr<ASTNode> pf_length(vector<shared_ptr<ASTNode>> &args) {
+  if (args[0]->node_type == ASTNodeType::LIST ||
+      args[0]->node_type == ASTNodeType::QUOTE_LIST)
+    return make_shared<ASTNode>(
+        ASTNodeType::LEAF,
+        make_shared<Token>(TokenType::INT,
+                           to_string(args[0]->children.size()),
+                           args[0]->head->span));
+  else if (args[0]->node_type == ASTNodeType::VECTOR)
+    return make_shared<ASTNode>(
+        ASTNodeType::LEAF,
+        make_shared<Token>(
+            TokenType::INT,
+            to_string(static_pointer_cast<VectorNode>(args[0])->size()),
+            args[0]->head->span));
+  else if (args[0]->node_type == ASTNodeType::DICT)
+    return make_shared<ASTNode>(
+        ASTNodeType::LEAF,
+        make_shared<Token>(
+            TokenType::INT,
+            to_string(static_pointer_cast<DictNode>(args[0])->size()),
+            args[0]->head->span));
+  else
+    throw RuntimeError(args[0]->head->span, "length: invalid argument type " +
+                                                args[0]->head->value);
+}
+
+shared_ptr<ASTNode> pf_append(vector<shared_ptr<ASTNode>> &args) {
+  size_t size = 0;
+
+  for (auto const &arg : args) {
+    if (arg->node_type != ASTNodeType::LIST &&
+        arg->node_type != ASTNodeType::QUOTE_LIST)
+      throw RuntimeError(arg->head->span,
+                         "append: invalid argument type " + arg->head->value);
+
+    size += arg->children.size();
+  }
+
+  vector<shared_ptr<ASTNode>> res;
+  res.reserve(size);
+
+  for (auto const &arg : args) {
+    res.insert(res.end(), arg->children.begin(), arg->children.end());
+  }
+
+  return make_list(res);
+}
+
+// marks a function to have its results cached by the interpreter, only pure
+// functions can be, see semantic/effect_analysis.cpp
+shared_ptr<ASTNode> pf_memo(vector<shared_ptr<ASTNode>> &args) {
+  if (args[0]->node_type != ASTNodeType::FUNCDEF)
+    throw RuntimeError(args[0]->head->span,
+                       "memo: invalid argument type " + args[0]->head->value);
+
+  auto funcdef = static_pointer_cast<FuncDefNode>(args[0]);
+  if (funcdef->effect != PURE)
+    throw RuntimeError(args[0]->head->span,
+                       "memo: " + funcdef->getName()->value + " is not pure");
+
+  funcdef->memoized = true;
+  return funcdef;
+}
+
+// the int variants skip the double round trip of the generic builtins. an
+// argument qualifies if it is an INT token that fits an int, for those the
+// generic result is exact and has the same text
+
+static bool small_int(shared_ptr<ASTNode> const &arg, long long &value) {
+  if (arg->node_type != ASTNodeType::LEAF || arg->head->type != TokenType::INT)
+    return false;
+
+  auto const &text = arg->head->value;
+  auto res = from_chars(text.data(), text.data() + text.size(), value);
+
+  return res.ec == errc() && res.ptr == text.data() + text.size() &&
+         value >= INT_MIN && value <= INT_MAX;
+}
+
+static bool int_args(vector<shared_ptr<ASTNode>> &args, long long &a,
+                     long long &b) {
+  return args.size() == 2 && small_int(args[0], a) && small_int(args[1], b);
+}
+
+static shared_ptr<ASTNode> int_result(long long value, Span span) {
+  if (value < INT_MIN || value > INT_MAX)
+    return nullptr;
+
+  return make_shared<ASTNode>(
+      ASTNodeType::LEAF,
+      make_shared<Token>(TokenType::INT, to_string(value), span));
+}
+
+static shared_ptr<ASTNode> bool_result(bool value, Span span) {
+  return make_shared<ASTNode>(
+      ASTNodeType::LEAF,
+      make_shared<Token>(TokenType::BOOL, to_string(value), span));
+}
+
+shared_ptr<ASTNode> pf_plus_int(vector<shared_ptr<ASTNode>> &args) {
+  long long a, b;
+  if (!int_args(args, a, b))
+    return nullptr;
+
+  return int_result(a + b, args[0]->head->span);
+}
+
+shared_ptr<ASTNode> pf_minus_int(vector<shared_ptr<ASTNode>> &args) {
+  long long a, b;
+  if (!int_args(args, a, b))
+    return nullptr;
+
+  return int_result(a - b, args[0]->head->span);
+}
+
+shared_ptr<ASTNode> pf_times_int(vector<shared_ptr<ASTNode>> &args) {
+  long long a, b;
+  if (!int_args(args, a, b))
+    return nullptr;
+
+  return int_result(a * b, args[0]->head->span);
+}
+
+shared_ptr<ASTNode> pf_less_int(vector<shared_ptr<ASTNode>> &args) {
+  long long a, b;
+  if (!int_args(args, a, b))
+    return nullptr;
+
+  return bool_result(a < b, args[0]->head->span);
+}
+
+shared_ptr<ASTNode> pf_lesseq_int(vector<shared_ptr<ASTNode>> &args) {
+  long long a, b;
+  if (!int_args(args, a, b))
+    return nullptr;
+
+  return bool_result(a <= b, args[0]->head->span);
+}
+
+shared_ptr<ASTNode> pf_greater_int(vector<shared_ptr<ASTNode>> &args) {
+  long long a, b;
+  if (!int_args(args, a, b))
+    return nullptr;
+
+  return bool_result(a > b, args[0]->head->span);
+}
+
+shared_ptr<ASTNode> pf_greatereq_int(vector<shared_ptr<ASTNode>> &args) {
+  long long a, b;
+  if (!int_args(args, a, b))
+    return nullptr;
+
+  return bool_result(a >= b, args[0]->head->span);
+}
+
+// variants for arguments the type inference proved to be numbers. they skip
+// the type dispatch and parse without stod, a value that does not parse
+// falls back to the generic builtin, which reports the error
+
+static bool number(shared_ptr<ASTNode> const &arg, double &value) {
+  auto const &text = arg->head->value;
+  auto res = from_chars(text.data(), text.data() + text.size(), value);
+
+  return res.ec == errc() && res.ptr == text.data() + text.size();
+}
+
+static shared_ptr<ASTNode> number_result(double result, Span span) {
+  double intpart;
+
+  if (modf(result, &intpart) == 0.0)
+    return make_shared<ASTNode>(
+        ASTNodeType::LEAF,
+        make_shared<Token>(TokenType::INT, to_string((int)result), span));
+
+  return make_shared<ASTNode>(
+      ASTNodeType::LEAF,
+      make_shared<Token>(TokenType::REAL, to_string(result), span));
+}
+
+shared_ptr<ASTNode> pf_plus_number(vector<shared_ptr<ASTNode>> &args) {
+  double result = 0, value;
+  for (auto &arg : args) {
+    if (!number(arg, value))
+      return pf_plus(args);
+    result += value;
+  }
+
+  return number_result(result, args[0]->head->span);
+}
+
+shared_ptr<ASTNode> pf_minus_number(vector<shared_ptr<ASTNode>> &args) {
+  double result, value;
+  if (!number(args[0], result))
+    return pf_minus(args);
+
+  for (int i = 1; i < args.size(); i++) {
+    if (!number(args[i], value))
+      return pf_minus(args);
+    result -= value;
+  }
+
+  return number_result(result, args[0]->head->span);
+}
+
+shared_ptr<ASTNode> pf_times_number(vector<shared_ptr<ASTNode>> &args) {
+  double result = 1, value;
+  for (auto &arg : args) {
+    if (!number(arg, value))
+      return pf_times(args);
+    result *= value;
+  }
+
+  return number_result(result, args[0]->head->span);
+}
+
+shared_ptr<ASTNode> pf_divide_number(vector<shared_ptr<ASTNode>> &args) {
+  double result, value;
+  if (!number(args[0], result))
+    return pf_divide(args);
+
+  for (int i = 1; i < args.size(); i++) {
+    if (!number(args[i], value))
+      return pf_divide(args);
+    result /= value;
+  }
+
+  return number_result(result, args[0]->head->span);
+}
+
+shared_ptr<ASTNode> pf_less_number(vector<shared_ptr<ASTNode>> &args) {
+  double a, b;
+  if (!number(args[0], a) || !number(args[1], b))
+    return pf_less(args);
+
+  return bool_result(a < b, args[0]->head->span);
+}
+
+shared_ptr<ASTNode> pf_lesseq_number(vector<shared_ptr<ASTNode>> &args) {
+  double a, b;
+  if (!number(args[0], a) || !number(args[1], b))
+    return pf_lesseq(args);
+
+  return bool_result(a <= b, args[0]->head->span);
+}
+
+shared_ptr<ASTNode> pf_greater_number(vector<shared_ptr<ASTNode>> &args) {
+  double a, b;
+  if (!number(args[0], a) || !number(args[1], b))
+    return pf_greater(args);
+
+  return bool_result(a > b, args[0]->head->span);
+}
+
+shared_ptr<ASTNode> pf_greatereq_number(vector<shared_ptr<ASTNode>> &args) {
+  double a, b;
+  if (!number(args[0], a) || !number(args[1], b))
+    return pf_greatereq(args);
+
+  return bool_result(a >= b, args[0]->head->span);
+}
+
+// the vec builtins work on packed vectors of numbers, see VectorNode. a
+// vector holds ints while all its numbers are ints, reals otherwise, and
+// the kernels in utils/simd.cpp do the work
+
+static void vec_arity(vector<shared_ptr<ASTNode>> &args, size_t expected,
+                      string const &name) {
+  if (args.size() != expected)
+    throw WrongNumberOfArgumentsError(
+        args.empty() ? Span({0, 0}) : args[0]->head->span, name, expected,
+        args.size());
+}
+
+static shared_ptr<VectorNode> vector_arg(shared_ptr<ASTNode> const &arg,
+                                         string const &name) {
+  if (arg->node_type != ASTNodeType::VECTOR)
+    throw RuntimeError(arg->head->span,
+                       name + ": invalid argument type " + arg->head->value);
+
+  return static_pointer_cast<VectorNode>(arg);
+}
+
+// a number leaf as an int if it is one that fits, else as a real
+static bool vector_number(shared_ptr<ASTNode> const &arg, bool &is_real,
+                          int64_t &int_value, double &real_value) {
+  if (arg->node_type != ASTNodeType::LEAF ||
+      (arg->head->type != TokenType::INT && arg->head->type != TokenType::REAL))
+    return false;
+
+  auto const &text = arg->head->value;
+  auto end = text.data() + text.size();
+
+  if (arg->head->type == TokenType::INT) {
+    auto res = from_chars(text.data(), end, int_value);
+    if (res.ec == errc() && res.ptr == end) {
+      is_real = false;
+      real_value = (double)int_value;
+      return true;
+    }
+  }
+
+  is_real = true;
+  real_value = stod(text);
+  return true;
+}
+
+// the numbers of a vector as reals, ints are converted into converted
+static double const *vector_reals(VectorNode const &vec,
+                                  vector<double> &converted) {
+  if (vec.is_real)
+    return vec.reals.data();
+
+  converted.assign(vec.ints.begin(), vec.ints.end());
+  return converted.data();
+}
+
+static shared_ptr<ASTNode> vector_element(VectorNode const &vec, size_t i,
+                                          Span span) {
+  auto type = TokenType::INT;
+
+  double intpart;
+  if (vec.is_real && (modf(vec.reals[i], &intpart) != 0.0 ||
+                      vec.reals[i] < INT_MIN || vec.reals[i] > INT_MAX))
+    type = TokenType::REAL;
+
+  return make_shared<ASTNode>(ASTNodeType::LEAF,
+                              make_shared<Token>(type, vec.text(i), span));
+}
+
+static shared_ptr<ASTNode> int64_result(int64_t value, Span span) {
+  VectorNode vec(span, vector<int64_t>{value});
+  return vector_element(vec, 0, span);
+}
+
+static shared_ptr<ASTNode> real_result(double value, Span span) {
+  VectorNode vec(span, vector<double>{value});
+  return vector_element(vec, 0, span);
+}
+
+shared_ptr<ASTNode> pf_vec(vector<shared_ptr<ASTNode>> &args) {
+  vec_arity(args, 1, "vec");
+
+  auto const &list = args[0];
+  if (list->node_type != ASTNodeType::LIST &&
+      list->node_type != ASTNodeType::QUOTE_LIST)
+    throw RuntimeError(list->head->span,
+                       "vec: invalid argument type " + list->head->value);
+
+  vector<int64_t> ints;
+  vector<double> reals;
+  bool any_real = false;
+
+  ints.reserve(list->children.size());
+  reals.reserve(list->children.size());
+
+  for (auto const &child : list->children) {
+    bool is_real;
+    int64_t int_value;
+    double real_value;
+
+    if (!vector_number(child, is_real, int_value, real_value))
+      throw RuntimeError(child->head->span,
+                         "vec: invalid argument type " + child->head->value);
+
+    any_real |= is_real;
+    ints.push_back(int_value);
+    reals.push_back(real_value);
+  }
+
+  // a list value has no position of its own
+  Span span = list->children.empty() ? list->head->span
+                                     : list->children[0]->head->span;
+
+  if (any_real)
+    return make_shared<VectorNode>(span, std::move(reals));
+
+  return make_shared<VectorNode>(span, std::move(ints));
+}
+
+// (vecrange start stop [step]) counts from start up to, not including, stop
+shared_ptr<ASTNode> pf_vecrange(vector<shared_ptr<ASTNode>> &args) {
+  if (args.size() != 2)
+    vec_arity(args, 3, "vecrange");
+
+  bool is_real[3] = {false, false, false};
+  int64_t ints[3] = {0, 0, 1};
+  double reals[3] = {0, 0, 1};
+
+  for (size_t i = 0; i < args.size(); i++) {
+    if (!vector_number(args[i], is_real[i], ints[i], reals[i]))
+      throw RuntimeError(args[i]->head->span,
+                         "vecrange: invalid argument type " +
+                             args[i]->head->value);
+  }
+
+  Span span = args[0]->head->span;
+
+  if (reals[2] == 0)
+    throw RuntimeError(args[2]->head->span, "vecrange: step is zero");
+
+  if (is_real[0] || is_real[1] || is_real[2]) {
+    double count = ceil((reals[1] - reals[0]) / reals[2]);
+
+    vector<double> res;
+    for (size_t i = 0; i < count; i++) {
+      res.push_back(reals[0] + i * reals[2]);
+    }
+    return make_shared<VectorNode>(span, std::move(res));
+  }
+
+  // counted unsigned, so a range up to the largest int does not overflow
+  uint64_t start = ints[0], step = ints[2], count = 0;
+  if (ints[2] > 0 && ints[0] < ints[1])
+    count = ((uint64_t)ints[1] - start - 1) / step + 1;
+  else if (ints[2] < 0 && ints[0] > ints[1])
+    count = (start - (uint64_t)ints[1] - 1) / -step + 1;
+
+  vector<int64_t> res(count);
+  for (uint64_t i = 0; i < count; i++) {
+    res[i] = (int64_t)(start + i * step);
+  }
+  return make_shared<VectorNode>(span, std::move(res));
+}
+
+// (range start stop [step]) counts like vecrange, lazily: the stream holds
+// the next int and how many follow it, and tail makes the cell after it
+shared_ptr<ASTNode> pf_range(vector<shared_ptr<ASTNode>> &args) {
+  if (args.size() != 2)
+    vec_arity(args, 3, "range");
+
+  int64_t ints[3] = {0, 0, 1};
+
+  for (size_t i = 0; i < args.size(); i++) {
+    bool is_real;
+    double real;
+    if (!vector_number(args[i], is_real, ints[i], real) || is_real)
+      throw RuntimeError(args[i]->head->span, "range: invalid argument type " +
+                                                  args[i]->head->value);
+  }
+
+  Span span = args[0]->head->span;
+
+  if (ints[2] == 0)
+    throw RuntimeError(args[2]->head->span, "range: step is zero");
+
+  uint64_t start = ints[0], step = ints[2], count = 0;
+  if (ints[2] > 0 && ints[0] < ints[1])
+    count = ((uint64_t)ints[1] - start - 1) / step + 1;
+  else if (ints[2] < 0 && ints[0] > ints[1])
+    count = (start - (uint64_t)ints[1] - 1) / -step + 1;
+
+  if (count == 0)
+    return make_list({});
+
+  auto res = make_shared<StreamNode>(
+      span, StreamNode::RANGE,
+      make_shared<ASTNode>(ASTNodeType::LEAF,
+                           make_shared<Token>(TokenType::INT,
+                                              to_string(ints[0]), span)),
+      nullptr, nullptr, count - 1);
+  res->step = ints[2];
+  return res;
+}
+
+shared_ptr<ASTNode> range_rest(StreamNode const &cell) {
+  if (cell.count == 0)
+    return make_list({});
+
+  auto const &text = cell.first->head->value;
+  int64_t value = 0;
+  from_chars(text.data(), text.data() + text.size(), value);
+
+  Span span = cell.head->span;
+  auto res = make_shared<StreamNode>(
+      span, StreamNode::RANGE,
+      make_shared<ASTNode>(ASTNodeType::LEAF,
+                           make_shared<Token>(TokenType::INT,
+                                              to_string(value + cell.step),
+                                              span)),
+      nullptr, nullptr, cell.count - 1);
+  res->step = cell.step;
+  return res;
+}
+
+shared_ptr<ASTNode> pf_veclist(vector<shared_ptr<ASTNode>> &args) {
+  vec_arity(args, 1, "veclist");
+  auto vec = vector_arg(args[0], "veclist");
+
+  vector<shared_ptr<ASTNode>> res;
+  res.reserve(vec->size());
+
+  for (size_t i = 0; i < vec->size(); i++) {
+    res.push_back(vector_element(*vec, i, vec->head->span));
+  }
+
+  return make_list(res);
+}
+
+shared_ptr<ASTNode> pf_vecget(vector<shared_ptr<ASTNode>> &args) {
+  vec_arity(args, 2, "vecget");
+  auto vec = vector_arg(args[0], "vecget");
+
+  bool is_real;
+  int64_t index;
+  double real_index;
+
+  if (!vector_number(args[1], is_real, index, real_index) || is_real)
+    throw RuntimeError(args[1]->head->span,
+                       "vecget: invalid argument type " + args[1]->head->value);
+
+  if (index < 0 || (size_t)index >= vec->size())
+    throw RuntimeError(args[1]->head->span,
+                       "vecget: index " + args[1]->head->value +
+                           " out of range");
+
+  return vector_element(*vec, index, args[1]->head->span);
+}
+
+// an argument of an elementwise builtin, a vector or a number applied to
+// every element
+struct VectorOperand {
+  shared_ptr<VectorNode> vec;
+  bool is_real;
+  int64_t int_value;
+  double real_value;
+};
+
+static VectorOperand vector_operand(shared_ptr<ASTNode> const &arg,
+                                    string const &name) {
+  VectorOperand res;
+
+  if (arg->node_type == ASTNodeType::VECTOR) {
+    res.vec = static_pointer_cast<VectorNode>(arg);
+    res.is_real = res.vec->is_real;
+  } else if (!vector_number(arg, res.is_real, res.int_value, res.real_value))
+    throw RuntimeError(arg->head->span,
+                       name + ": invalid argument type " + arg->head->value);
+
+  return res;
+}
+
+// checks the operands, both vectors have to be of the same length and at
+// least one has to be a vector. returns that length
+static size_t vector_operands(vector<shared_ptr<ASTNode>> &args,
+                              string const &name, VectorOperand &a,
+                              VectorOperand &b) {
+  vec_arity(args, 2, name);
+
+  a = vector_operand(args[0], name);
+  b = vector_operand(args[1], name);
+
+  if (!a.vec && !b.vec)
+    throw RuntimeError(args[0]->head->span,
+                       name + ": invalid argument type " +
+                           args[0]->head->value);
+
+  if (a.vec && b.vec && a.vec->size() != b.vec->size())
+    throw RuntimeError(args[1]->head->span,
+                       name + ": vectors of different lengths " +
+                           to_string(a.vec->size()) + " and " +
+                           to_string(b.vec->size()));
+
+  return a.vec ? a.vec->size() : b.vec->size();
+}
+
+static double const *operand_reals(VectorOperand const &operand,
+                                   vector<double> &converted) {
+  if (operand.vec)
+    return vector_reals(*operand.vec, converted);
+
+  return &operand.real_value;
+}
+
+static int64_t const *operand_ints(VectorOperand const &operand) {
+  return operand.vec ? operand.vec->ints.data() : &operand.int_value;
+}
+
+static shared_ptr<ASTNode> vector_arith(vector<shared_ptr<ASTNode>> &args,
+                                        simd::Arith op, string const &name) {
+  VectorOperand a, b;
+  size_t size = vector_operands(args, name, a, b);
+  Span span = args[0]->head->span;
+
+  // the kernels take the number second. plus and times commute, for minus
+  // and divide it is spread over a vector first
+  if (!a.vec && (op == simd::ADD || op == simd::MUL))
+    swap(a, b);
+
+  if (op == simd::DIV || a.is_real || b.is_real) {
+    vector<double> converted_a, converted_b;
+    auto x = operand_reals(a, converted_a), y = operand_reals(b, converted_b);
+    if (!a.vec) {
+      converted_a.assign(size, *x);
+      x = converted_a.data();
+    }
+
+    vector<double> res(size);
+    simd::arith(op, x, y, !b.vec, res.data(), size);
+    return make_shared<VectorNode>(span, std::move(res));
+  }
+
+  vector<int64_t> spread;
+  auto x = operand_ints(a), y = operand_ints(b);
+  if (!a.vec) {
+    spread.assign(size, *x);
+    x = spread.data();
+  }
+
+  vector<int64_t> res(size);
+  simd::arith(op, x, y, !b.vec, res.data(), size);
+  return make_shared<VectorNode>(span, std::move(res));
+}
+
+static shared_ptr<ASTNode> vector_compare(vector<shared_ptr<ASTNode>> &args,
+                                          simd::Compare op,
+                                          string const &name) {
+  VectorOperand a, b;
+  size_t size = vector_operands(args, name, a, b);
+  Span span = args[0]->head->span;
+
+  // with the number first the comparison is turned around
+  if (!a.vec) {
+    swap(a, b);
+
+    if (op == simd::LESS)
+      op = simd::GREATER;
+    else if (op == simd::LESSEQ)
+      op = simd::GREATEREQ;
+    else if (op == simd::GREATER)
+      op = simd::LESS;
+    else if (op == simd::GREATEREQ)
+      op = simd::LESSEQ;
+  }
+
+  vector<int64_t> res(size);
+
+  if (a.is_real || b.is_real) {
+    vector<double> converted_a, converted_b;
+    simd::compare(op, operand_reals(a, converted_a),
+                  operand_reals(b, converted_b), !b.vec, res.data(), size);
+  } else
+    simd::compare(op, operand_ints(a), operand_ints(b), !b.vec, res.data(),
+                  size);
+
+  return make_shared<VectorNode>(span, std::move(res));
+}
+
+shared_ptr<ASTNode> pf_vecplus(vector<shared_ptr<ASTNode>> &args) {
+  return vector_arith(args, simd::ADD, "vecplus");
+}
+
+shared_ptr<ASTNode> pf_vecminus(vector<shared_ptr<ASTNode>> &args) {
+  return vector_arith(args, simd::SUB, "vecminus");
+}
+
+shared_ptr<ASTNode> pf_vectimes(vector<shared_ptr<ASTNode>> &args) {
+  return vector_arith(args, simd::MUL, "vectimes");
+}
+
+shared_ptr<ASTNode> pf_vecdivide(vector<shared_ptr<ASTNode>> &args) {
+  return vector_arith(args, simd::DIV, "vecdivide");
+}
+
+shared_ptr<ASTNode> pf_vecless(vector<shared_ptr<ASTNode>> &args) {
+  return vector_compare(args, simd::LESS, "vecless");
+}
+
+shared_ptr<ASTNode> pf_veclesseq(vector<shared_ptr<ASTNode>> &args) {
+  return vector_compare(args, simd::LESSEQ, "veclesseq");
+}
+
+shared_ptr<ASTNode> pf_vecgreater(vector<shared_ptr<ASTNode>> &args) {
+  return vector_compare(args, simd::GREATER, "vecgreater");
+}
+
+shared_ptr<ASTNode> pf_vecgreatereq(vector<shared_ptr<ASTNode>> &args) {
+  return vector_compare(args, simd::GREATEREQ, "vecgreatereq");
+}
+
+shared_ptr<ASTNode> pf_vecequal(vector<shared_ptr<ASTNode>> &args) {
+  return vector_compare(args, simd::EQUAL, "vecequal");
+}
+
+shared_ptr<ASTNode> pf_vecsum(vector<shared_ptr<ASTNode>> &args) {
+  vec_arity(args, 1, "vecsum");
+  auto vec = vector_arg(args[0], "vecsum");
+  Span span = vec->head->span;
+
+  if (vec->is_real)
+    return real_result(simd::sum(vec->reals.data(), vec->size()), span);
+
+  return int64_result(simd::sum(vec->ints.data(), vec->size()), span);
+}
+
+shared_ptr<ASTNode> pf_vecdot(vector<shared_ptr<ASTNode>> &args) {
+  vec_arity(args, 2, "vecdot");
+  auto a = vector_arg(args[0], "vecdot");
+  auto b = vector_arg(args[1], "vecdot");
+  Span span = a->head->span;
+
+  if (a->size() != b->size())
+    throw RuntimeError(b->head->span, "vecdot: vectors of different lengths " +
+                                          to_string(a->size()) + " and " +
+                                          to_string(b->size()));
+
+  if (a->is_real || b->is_real) {
+    vector<double> converted_a, converted_b;
+    return real_result(simd::dot(vector_reals(*a, converted_a),
+                                 vector_reals(*b, converted_b), a->size()),
+                       span);
+  }
+
+  return int64_result(simd::dot(a->ints.data(), b->ints.data(), a->size()),
+                      span);
+}
+
+static shared_ptr<ASTNode> vector_extreme(vector<shared_ptr<ASTNode>> &args,
+                                          bool is_max, string const &name) {
+  vec_arity(args, 1, name);
+  auto vec = vector_arg(args[0], name);
+  Span span = vec->head->span;
+
+  if (vec->size() == 0)
+    throw RuntimeError(span, name + ": empty vector");
+
+  if (vec->is_real)
+    return real_result(is_max ? simd::max(vec->reals.data(), vec->size())
+                              : simd::min(vec->reals.data(), vec->size()),
+                       span);
+
+  return int64_result(is_max ? simd::max(vec->ints.data(), vec->size())
+                             : simd::min(vec->ints.data(), vec->size()),
+                      span);
+}
+
+shared_ptr<ASTNode> pf_vecmin(vector<shared_ptr<ASTNode>> &args) {
+  return vector_extreme(args, false, "vecmin");
+}
+
+shared_ptr<ASTNode> pf_vecmax(vector<shared_ptr<ASTNode>> &args) {
+  return vector_extreme(args, true, "vecmax");
+}
+
+shared_ptr<ASTNode> pf_vecscan(vector<shared_ptr<ASTNode>> &args) {
+  vec_arity(args, 1, "vecscan");
+  auto vec = vector_arg(args[0], "vecscan");
+  Span span = vec->head->span;
+
+  if (vec->is_real) {
+    vector<double> res(vec->size());
+    simd::scan(vec->reals.data(), res.data(), vec->size());
+    return make_shared<VectorNode>(span, std::move(res));
+  }
+
+  vector<int64_t> res(vec->size());
+  simd::scan(vec->ints.data(), res.data(), vec->size());
+  return make_shared<VectorNode>(span, std::move(res));
+}
+
+static shared_ptr<DictNode> dict_arg(shared_ptr<ASTNode> const &arg,
+                                     string const &name) {
+  if (arg->node_type != ASTNodeType::DICT)
+    throw RuntimeError(arg->head->span,
+                       name + ": invalid argument type " + arg->head->value);
+  return static_pointer_cast<DictNode>(arg);
+}
+
+static void key_arg(shared_ptr<ASTNode> const &arg, string const &name) {
+  if (!is_key(arg))
+    throw RuntimeError(arg->head->span,
+                       name + ": invalid argument type " + arg->head->value);
+}
+
+// (dict key value ...) with a later key replacing an earlier equal one
+shared_ptr<ASTNode> pf_dict(vector<shared_ptr<ASTNode>> &args) {
+  if (args.size() % 2 != 0)
+    throw RuntimeError(args.back()->head->span,
+                       "dict: no value for key " + args.back()->head->value);
+
+  auto res = make_shared<DictNode>(args.empty() ? Span({0, 0})
+                                                : args[0]->head->span);
+  for (size_t i = 0; i < args.size(); i += 2) {
+    key_arg(args[i], "dict");
+    res->put_in_place(args[i], args[i + 1]);
+  }
+  return res;
+}
+
+// (get dict key [default]), null or default without the key
+shared_ptr<ASTNode> pf_get(vector<shared_ptr<ASTNode>> &args) {
+  if (args.size() != 2)
+    vec_arity(args, 3, "get");
+
+  auto dict = dict_arg(args[0], "get");
+  key_arg(args[1], "get");
+
+  auto res = dict->get(args[1]);
+  if (res != nullptr)
+    return res;
+  if (args.size() == 3)
+    return args[2];
+
+  return make_shared<ASTNode>(
+      ASTNodeType::LEAF,
+      make_shared<Token>(TokenType::NUL, "null", args[1]->head->span));
+}
+
+// (put dict key value) is a new dict, dict stays as it is
+shared_ptr<ASTNode> pf_put(vector<shared_ptr<ASTNode>> &args) {
+  vec_arity(args, 3, "put");
+  auto dict = dict_arg(args[0], "put");
+  key_arg(args[1], "put");
+
+  return dict->put(args[1], args[2]);
+}
+
+// (putinplace dict key value) changes dict and returns it. the dicts put
+// made from it before keep their entries
+shared_ptr<ASTNode> pf_putinplace(vector<shared_ptr<ASTNode>> &args) {
+  vec_arity(args, 3, "putinplace");
+  auto dict = dict_arg(args[0], "putinplace");
+  key_arg(args[1], "putinplace");
+
+  dict->put_in_place(args[1], args[2]);
+  return dict;
+}
@@ -3,6 +3,9 @@
 
 #include "../parser/ast.h"
 #include "../semantic/semantic_analyzer.h"
+#include "dict.h"
+#include "region.h"
+#include "simd.h"
 #include <algorithm>
 #include <cmath>
 #include <iostream>
@@ -35,8 +38,60 @@ shared_ptr<ASTNode> pf_head(vector<shared_ptr<ASTNode>> &args);
 shared_ptr<ASTNode> pf_tail(vector<shared_ptr<ASTNode>> &args);
 shared_ptr<ASTNode> pf_cons(vector<shared_ptr<ASTNode>> &args);
 shared_ptr<ASTNode> pf_isempty(vector<shared_ptr<ASTNode>> &args);
-shared_ptr<ASTNode> pf_foldl(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_reverse(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_length(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_append(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_memo(vector<shared_ptr<ASTNode>> &args);
 shared_ptr<ASTNode> pf_println(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_range(vector<shared_ptr<ASTNode>> &args);
+
+// the cell after a RANGE cell of a stream, or an empty list at its end
+shared_ptr<ASTNode> range_rest(StreamNode const &cell);
+
+// hash maps keyed by value, see DictNode
+shared_ptr<ASTNode> pf_dict(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_get(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_put(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_putinplace(vector<shared_ptr<ASTNode>> &args);
+
+// packed vectors of numbers, see VectorNode
+shared_ptr<ASTNode> pf_vec(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_vecrange(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_veclist(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_vecget(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_vecplus(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_vecminus(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_vectimes(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_vecdivide(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_vecless(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_veclesseq(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_vecgreater(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_vecgreatereq(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_vecequal(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_vecsum(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_vecdot(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_vecmin(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_vecmax(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_vecscan(vector<shared_ptr<ASTNode>> &args);
+
+// quickened variants for two int arguments, nullptr on anything else
+shared_ptr<ASTNode> pf_plus_int(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_minus_int(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_times_int(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_less_int(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_lesseq_int(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_greater_int(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_greatereq_int(vector<shared_ptr<ASTNode>> &args);
+
+// variants for arguments proven to be numbers, see semantic/type_inference.h
+shared_ptr<ASTNode> pf_plus_number(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_minus_number(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_times_number(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_divide_number(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_less_number(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_lesseq_number(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_greater_number(vector<shared_ptr<ASTNode>> &args);
+shared_ptr<ASTNode> pf_greatereq_number(vector<shared_ptr<ASTNode>> &args);
 
 void print_func(shared_ptr<ASTNode> const &node);
 void print_string(shared_ptr<ASTNode> const &node);
@@ -0,0 +1,99 @@
+#include "region.h"
+#include <new>
+
+namespace {
+
+// every block starts with the chunk it was bumped from, nullptr for blocks
+// taken from the heap
+constexpr size_t HEADER_SIZE = alignof(std::max_align_t);
+
+thread_local Region *current_region = nullptr;
+thread_local bool place_lists = false;
+
+} // namespace
+
+struct Region::Chunk {
+  std::atomic<size_t> live; // blocks, plus one while it is the current chunk
+  size_t used;
+  alignas(std::max_align_t) char data[CHUNK_SIZE];
+};
+
+Region::Region() : current(new Chunk) {
+  current->live.store(1, std::memory_order_relaxed);
+  current->used = 0;
+}
+
+Region::~Region() { unref(current); }
+
+void *Region::allocate(size_t size) {
+  size_t total = (size + 2 * HEADER_SIZE - 1) & ~(HEADER_SIZE - 1);
+  Region *region = current_region;
+
+  if (region != nullptr && total <= CHUNK_SIZE)
+    return region->bump(total);
+
+  char *block = static_cast<char *>(::operator new(size + HEADER_SIZE));
+  *reinterpret_cast<Chunk **>(block) = nullptr;
+
+  return block + HEADER_SIZE;
+}
+
+void *Region::bump(size_t total) {
+  // only the region itself holds the chunk, every block in it is dead
+  if (current->live.load(std::memory_order_acquire) == 1)
+    current->used = 0;
+
+  if (current->used + total > CHUNK_SIZE) {
+    Chunk *next = new Chunk;
+    next->live.store(1, std::memory_order_relaxed);
+    next->used = 0;
+
+    unref(current);
+    current = next;
+  }
+
+  char *block = current->data + current->used;
+  *reinterpret_cast<Chunk **>(block) = current;
+
+  current->used += total;
+  current->live.fetch_add(1, std::memory_order_relaxed);
+
+  return block + HEADER_SIZE;
+}
+
+void Region::release(void *ptr) noexcept {
+  if (ptr == nullptr)
+    return;
+
+  char *block = static_cast<char *>(ptr) - HEADER_SIZE;
+  Chunk *chunk = *reinterpret_cast<Chunk **>(block);
+
+  if (chunk == nullptr) {
+    ::operator delete(block);
+    return;
+  }
+
+  unref(chunk);
+}
+
+void Region::unref(Chunk *chunk) noexcept {
+  if (chunk->live.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    delete chunk;
+}
+
+RegionScope::RegionScope(Region &region) : previous(current_region) {
+  current_region = &region;
+}
+
+RegionScope::~RegionScope() { current_region = previous; }
+
+ScopedLists::ScopedLists() : previous(place_lists) { place_lists = true; }
+
+ScopedLists::~ScopedLists() { place_lists = previous; }
+
+shared_ptr<ASTNode> make_list(vector<shared_ptr<ASTNode>> const &children) {
+  if (place_lists && current_region != nullptr)
+    return allocate_shared<ListNode>(RegionAllocator<ListNode>(), children);
+
+  return make_shared<ListNode>(children);
+}
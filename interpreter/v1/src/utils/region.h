@@ -0,0 +1,83 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include "../parser/ast.h"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+using namespace flang;
+
+// bump allocator for call frames and for lists that do not escape the call
+// they are built in. every block points back to its chunk, and a chunk is
+// released once its last block is freed, so a value that outlives its call
+// after all stays valid and only keeps its chunk alive
+class Region {
+public:
+  static constexpr size_t CHUNK_SIZE = 4096;
+
+  Region();
+  ~Region();
+
+  Region(Region const &) = delete;
+  Region &operator=(Region const &) = delete;
+
+  // from the region of the current thread, or from the heap without one
+  static void *allocate(size_t size);
+  static void release(void *ptr) noexcept;
+
+private:
+  struct Chunk;
+
+  Chunk *current;
+
+  void *bump(size_t size);
+  static void unref(Chunk *chunk) noexcept;
+};
+
+// makes region the current region of this thread while alive
+class RegionScope {
+public:
+  RegionScope(Region &region);
+  ~RegionScope();
+
+private:
+  Region *previous;
+};
+
+// lists built by make_list while alive are placed in the current region,
+// used for allocation sites the escape analysis marked as scoped
+class ScopedLists {
+public:
+  ScopedLists();
+  ~ScopedLists();
+
+private:
+  bool previous;
+};
+
+template <typename T> struct RegionAllocator {
+  typedef T value_type;
+
+  RegionAllocator() = default;
+  template <typename U> RegionAllocator(RegionAllocator<U> const &) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(Region::allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T *ptr, size_t) noexcept { Region::release(ptr); }
+
+  template <typename U> bool operator==(RegionAllocator<U> const &) const {
+    return true;
+  }
+
+  template <typename U> bool operator!=(RegionAllocator<U> const &) const {
+    return false;
+  }
+};
+
+// a new list node, in the current region inside ScopedLists
+shared_ptr<ASTNode> make_list(vector<shared_ptr<ASTNode>> const &children);
+
+#endif
@@ -0,0 +1,734 @@
+#include "simd.h"
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace simd {
+
+static Level detect() {
+#ifdef SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return AVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return SSE2;
+#endif
+  return SCALAR;
+}
+
+static Level cap = AVX2;
+
+Level level() {
+  static const Level detected = detect();
+  return std::min(detected, cap);
+}
+
+void limit(Level max) { cap = max; }
+
+// scalar loops, the fallback and the tails of the vector loops. ints are
+// added and multiplied unsigned to wrap around
+
+static double apply(Arith op, double a, double b) {
+  switch (op) {
+  case ADD:
+    return a + b;
+  case SUB:
+    return a - b;
+  case MUL:
+    return a * b;
+  default:
+    return a / b;
+  }
+}
+
+static int64_t apply(Arith op, int64_t a, int64_t b) {
+  switch (op) {
+  case ADD:
+    return (int64_t)((uint64_t)a + (uint64_t)b);
+  case SUB:
+    return (int64_t)((uint64_t)a - (uint64_t)b);
+  default:
+    return (int64_t)((uint64_t)a * (uint64_t)b);
+  }
+}
+
+template <typename T> static bool holds(Compare op, T a, T b) {
+  switch (op) {
+  case LESS:
+    return a < b;
+  case LESSEQ:
+    return a <= b;
+  case GREATER:
+    return a > b;
+  case GREATEREQ:
+    return a >= b;
+  default:
+    return a == b;
+  }
+}
+
+template <typename T>
+static void arith_from(size_t i, Arith op, T const *a, T const *b,
+                       bool b_scalar, T *out, size_t n) {
+  for (; i < n; i++) {
+    out[i] = apply(op, a[i], b_scalar ? b[0] : b[i]);
+  }
+}
+
+template <typename T>
+static void compare_from(size_t i, Compare op, T const *a, T const *b,
+                         bool b_scalar, int64_t *out, size_t n) {
+  for (; i < n; i++) {
+    out[i] = holds(op, a[i], b_scalar ? b[0] : b[i]);
+  }
+}
+
+// four partial sums over the elements i % 4, added pairwise, then the tail.
+// the vector loops keep the same four sums in their lanes
+static double sum4(double const *s, double const *a, size_t i, size_t n) {
+  double res = (s[0] + s[1]) + (s[2] + s[3]);
+  for (; i < n; i++) {
+    res += a[i];
+  }
+  return res;
+}
+
+static double dot4(double const *s, double const *a, double const *b,
+                   size_t i, size_t n) {
+  double res = (s[0] + s[1]) + (s[2] + s[3]);
+  for (; i < n; i++) {
+    res += a[i] * b[i];
+  }
+  return res;
+}
+
+#ifdef SIMD_X86
+
+// each returns how many elements it did, whole blocks only
+
+template <Arith op>
+TARGET("avx2")
+static size_t arith_avx2(double const *a, double const *b, bool b_scalar,
+                         double *out, size_t n) {
+  __m256d y = b_scalar ? _mm256_set1_pd(b[0]) : _mm256_setzero_pd();
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m256d x = _mm256_loadu_pd(a + i);
+    if (!b_scalar)
+      y = _mm256_loadu_pd(b + i);
+
+    __m256d r;
+    if (op == ADD)
+      r = _mm256_add_pd(x, y);
+    else if (op == SUB)
+      r = _mm256_sub_pd(x, y);
+    else if (op == MUL)
+      r = _mm256_mul_pd(x, y);
+    else
+      r = _mm256_div_pd(x, y);
+
+    _mm256_storeu_pd(out + i, r);
+  }
+
+  return i;
+}
+
+template <Arith op>
+TARGET("sse2")
+static size_t arith_sse2(double const *a, double const *b, bool b_scalar,
+                         double *out, size_t n) {
+  __m128d y = b_scalar ? _mm_set1_pd(b[0]) : _mm_setzero_pd();
+  size_t i = 0;
+
+  for (; i + 2 <= n; i += 2) {
+    __m128d x = _mm_loadu_pd(a + i);
+    if (!b_scalar)
+      y = _mm_loadu_pd(b + i);
+
+    __m128d r;
+    if (op == ADD)
+      r = _mm_add_pd(x, y);
+    else if (op == SUB)
+      r = _mm_sub_pd(x, y);
+    else if (op == MUL)
+      r = _mm_mul_pd(x, y);
+    else
+      r = _mm_div_pd(x, y);
+
+    _mm_storeu_pd(out + i, r);
+  }
+
+  return i;
+}
+
+// there is no 64 bit multiply before AVX-512, MUL stays scalar
+template <Arith op>
+TARGET("avx2")
+static size_t arith_avx2(int64_t const *a, int64_t const *b, bool b_scalar,
+                         int64_t *out, size_t n) {
+  __m256i y = b_scalar ? _mm256_set1_epi64x(b[0]) : _mm256_setzero_si256();
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m256i x = _mm256_loadu_si256((__m256i const *)(a + i));
+    if (!b_scalar)
+      y = _mm256_loadu_si256((__m256i const *)(b + i));
+
+    __m256i r = op == ADD ? _mm256_add_epi64(x, y) : _mm256_sub_epi64(x, y);
+    _mm256_storeu_si256((__m256i *)(out + i), r);
+  }
+
+  return i;
+}
+
+template <Arith op>
+TARGET("sse2")
+static size_t arith_sse2(int64_t const *a, int64_t const *b, bool b_scalar,
+                         int64_t *out, size_t n) {
+  __m128i y = b_scalar ? _mm_set1_epi64x(b[0]) : _mm_setzero_si128();
+  size_t i = 0;
+
+  for (; i + 2 <= n; i += 2) {
+    __m128i x = _mm_loadu_si128((__m128i const *)(a + i));
+    if (!b_scalar)
+      y = _mm_loadu_si128((__m128i const *)(b + i));
+
+    __m128i r = op == ADD ? _mm_add_epi64(x, y) : _mm_sub_epi64(x, y);
+    _mm_storeu_si128((__m128i *)(out + i), r);
+  }
+
+  return i;
+}
+
+// comparison masks are all ones, the and leaves 1
+template <int predicate>
+TARGET("avx2")
+static size_t compare_avx2(double const *a, double const *b, bool b_scalar,
+                           int64_t *out, size_t n) {
+  __m256d y = b_scalar ? _mm256_set1_pd(b[0]) : _mm256_setzero_pd();
+  __m256i one = _mm256_set1_epi64x(1);
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m256d x = _mm256_loadu_pd(a + i);
+    if (!b_scalar)
+      y = _mm256_loadu_pd(b + i);
+
+    __m256i mask = _mm256_castpd_si256(_mm256_cmp_pd(x, y, predicate));
+    _mm256_storeu_si256((__m256i *)(out + i), _mm256_and_si256(mask, one));
+  }
+
+  return i;
+}
+
+TARGET("sse2")
+static size_t compare_sse2(Compare op, double const *a, double const *b,
+                           bool b_scalar, int64_t *out, size_t n) {
+  __m128d y = b_scalar ? _mm_set1_pd(b[0]) : _mm_setzero_pd();
+  __m128i one = _mm_set1_epi64x(1);
+  size_t i = 0;
+
+  for (; i + 2 <= n; i += 2) {
+    __m128d x = _mm_loadu_pd(a + i);
+    if (!b_scalar)
+      y = _mm_loadu_pd(b + i);
+
+    __m128d mask;
+    switch (op) {
+    case LESS:
+      mask = _mm_cmplt_pd(x, y);
+      break;
+    case LESSEQ:
+      mask = _mm_cmple_pd(x, y);
+      break;
+    case GREATER:
+      mask = _mm_cmpgt_pd(x, y);
+      break;
+    case GREATEREQ:
+      mask = _mm_cmpge_pd(x, y);
+      break;
+    default:
+      mask = _mm_cmpeq_pd(x, y);
+    }
+
+    _mm_storeu_si128((__m128i *)(out + i),
+                     _mm_and_si128(_mm_castpd_si128(mask), one));
+  }
+
+  return i;
+}
+
+// 64 bit compares need SSE4.2, the SSE2 level does them in the scalar loop
+TARGET("avx2")
+static size_t compare_avx2(Compare op, int64_t const *a, int64_t const *b,
+                           bool b_scalar, int64_t *out, size_t n) {
+  __m256i y = b_scalar ? _mm256_set1_epi64x(b[0]) : _mm256_setzero_si256();
+  __m256i one = _mm256_set1_epi64x(1);
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m256i x = _mm256_loadu_si256((__m256i const *)(a + i));
+    if (!b_scalar)
+      y = _mm256_loadu_si256((__m256i const *)(b + i));
+
+    __m256i r;
+    switch (op) {
+    case LESS:
+      r = _mm256_and_si256(_mm256_cmpgt_epi64(y, x), one);
+      break;
+    case LESSEQ:
+      r = _mm256_andnot_si256(_mm256_cmpgt_epi64(x, y), one);
+      break;
+    case GREATER:
+      r = _mm256_and_si256(_mm256_cmpgt_epi64(x, y), one);
+      break;
+    case GREATEREQ:
+      r = _mm256_andnot_si256(_mm256_cmpgt_epi64(y, x), one);
+      break;
+    default:
+      r = _mm256_and_si256(_mm256_cmpeq_epi64(x, y), one);
+    }
+
+    _mm256_storeu_si256((__m256i *)(out + i), r);
+  }
+
+  return i;
+}
+
+TARGET("avx2")
+static double sum_avx2(double const *a, size_t n) {
+  __m256d acc = _mm256_setzero_pd();
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    acc = _mm256_add_pd(acc, _mm256_loadu_pd(a + i));
+  }
+
+  double s[4];
+  _mm256_storeu_pd(s, acc);
+  return sum4(s, a, i, n);
+}
+
+TARGET("sse2")
+static double sum_sse2(double const *a, size_t n) {
+  __m128d low = _mm_setzero_pd(), high = _mm_setzero_pd();
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    low = _mm_add_pd(low, _mm_loadu_pd(a + i));
+    high = _mm_add_pd(high, _mm_loadu_pd(a + i + 2));
+  }
+
+  double s[4];
+  _mm_storeu_pd(s, low);
+  _mm_storeu_pd(s + 2, high);
+  return sum4(s, a, i, n);
+}
+
+TARGET("avx2")
+static double dot_avx2(double const *a, double const *b, size_t n) {
+  __m256d acc = _mm256_setzero_pd();
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    acc = _mm256_add_pd(
+        acc, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+  }
+
+  double s[4];
+  _mm256_storeu_pd(s, acc);
+  return dot4(s, a, b, i, n);
+}
+
+TARGET("sse2")
+static double dot_sse2(double const *a, double const *b, size_t n) {
+  __m128d low = _mm_setzero_pd(), high = _mm_setzero_pd();
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    low = _mm_add_pd(low,
+                     _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    high = _mm_add_pd(
+        high, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+  }
+
+  double s[4];
+  _mm_storeu_pd(s, low);
+  _mm_storeu_pd(s + 2, high);
+  return dot4(s, a, b, i, n);
+}
+
+TARGET("avx2")
+static int64_t sum_avx2(int64_t const *a, size_t n) {
+  __m256i acc = _mm256_setzero_si256();
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    acc = _mm256_add_epi64(acc, _mm256_loadu_si256((__m256i const *)(a + i)));
+  }
+
+  uint64_t s[4];
+  _mm256_storeu_si256((__m256i *)s, acc);
+
+  uint64_t res = s[0] + s[1] + s[2] + s[3];
+  for (; i < n; i++) {
+    res += (uint64_t)a[i];
+  }
+  return (int64_t)res;
+}
+
+TARGET("sse2")
+static int64_t sum_sse2(int64_t const *a, size_t n) {
+  __m128i acc = _mm_setzero_si128();
+  size_t i = 0;
+
+  for (; i + 2 <= n; i += 2) {
+    acc = _mm_add_epi64(acc, _mm_loadu_si128((__m128i const *)(a + i)));
+  }
+
+  uint64_t s[2];
+  _mm_storeu_si128((__m128i *)s, acc);
+
+  uint64_t res = s[0] + s[1];
+  for (; i < n; i++) {
+    res += (uint64_t)a[i];
+  }
+  return (int64_t)res;
+}
+
+// the lanes start from the first element, so lanes and tail only ever
+// compare values of the vector
+template <bool is_max>
+TARGET("avx2")
+static double extreme_avx2(double const *a, size_t n) {
+  __m256d acc = _mm256_set1_pd(a[0]);
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m256d x = _mm256_loadu_pd(a + i);
+    acc = is_max ? _mm256_max_pd(x, acc) : _mm256_min_pd(x, acc);
+  }
+
+  double s[4];
+  _mm256_storeu_pd(s, acc);
+
+  double res = s[0];
+  for (int j = 1; j < 4; j++) {
+    res = is_max ? std::max(res, s[j]) : std::min(res, s[j]);
+  }
+  for (; i < n; i++) {
+    res = is_max ? std::max(res, a[i]) : std::min(res, a[i]);
+  }
+  return res;
+}
+
+template <bool is_max>
+TARGET("sse2")
+static double extreme_sse2(double const *a, size_t n) {
+  __m128d acc = _mm_set1_pd(a[0]);
+  size_t i = 0;
+
+  for (; i + 2 <= n; i += 2) {
+    __m128d x = _mm_loadu_pd(a + i);
+    acc = is_max ? _mm_max_pd(x, acc) : _mm_min_pd(x, acc);
+  }
+
+  double s[2];
+  _mm_storeu_pd(s, acc);
+
+  double res = is_max ? std::max(s[0], s[1]) : std::min(s[0], s[1]);
+  for (; i < n; i++) {
+    res = is_max ? std::max(res, a[i]) : std::min(res, a[i]);
+  }
+  return res;
+}
+
+template <bool is_max>
+TARGET("avx2")
+static int64_t extreme_avx2(int64_t const *a, size_t n) {
+  __m256i acc = _mm256_set1_epi64x(a[0]);
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m256i x = _mm256_loadu_si256((__m256i const *)(a + i));
+    __m256i take = is_max ? _mm256_cmpgt_epi64(x, acc)
+                          : _mm256_cmpgt_epi64(acc, x);
+    acc = _mm256_blendv_epi8(acc, x, take);
+  }
+
+  int64_t s[4];
+  _mm256_storeu_si256((__m256i *)s, acc);
+
+  int64_t res = s[0];
+  for (int j = 1; j < 4; j++) {
+    res = is_max ? std::max(res, s[j]) : std::min(res, s[j]);
+  }
+  for (; i < n; i++) {
+    res = is_max ? std::max(res, a[i]) : std::min(res, a[i]);
+  }
+  return res;
+}
+
+// prefix sums of four lanes in two shifted adds, then the carry of the
+// blocks before
+TARGET("avx2")
+static size_t scan_avx2(int64_t const *a, int64_t *out, size_t n) {
+  __m256i zero = _mm256_setzero_si256();
+  __m256i carry = zero;
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m256i x = _mm256_loadu_si256((__m256i const *)(a + i));
+
+    __m256i shifted = _mm256_permute4x64_epi64(x, _MM_SHUFFLE(2, 1, 0, 0));
+    x = _mm256_add_epi64(x, _mm256_blend_epi32(shifted, zero, 0x03));
+
+    shifted = _mm256_permute4x64_epi64(x, _MM_SHUFFLE(1, 0, 0, 0));
+    x = _mm256_add_epi64(x, _mm256_blend_epi32(shifted, zero, 0x0f));
+
+    x = _mm256_add_epi64(x, carry);
+    _mm256_storeu_si256((__m256i *)(out + i), x);
+    carry = _mm256_permute4x64_epi64(x, _MM_SHUFFLE(3, 3, 3, 3));
+  }
+
+  return i;
+}
+
+#endif
+
+void arith(Arith op, double const *a, double const *b, bool b_scalar,
+           double *out, size_t n) {
+  size_t i = 0;
+
+#ifdef SIMD_X86
+  if (level() == AVX2) {
+    switch (op) {
+    case ADD:
+      i = arith_avx2<ADD>(a, b, b_scalar, out, n);
+      break;
+    case SUB:
+      i = arith_avx2<SUB>(a, b, b_scalar, out, n);
+      break;
+    case MUL:
+      i = arith_avx2<MUL>(a, b, b_scalar, out, n);
+      break;
+    case DIV:
+      i = arith_avx2<DIV>(a, b, b_scalar, out, n);
+      break;
+    }
+  } else if (level() == SSE2) {
+    switch (op) {
+    case ADD:
+      i = arith_sse2<ADD>(a, b, b_scalar, out, n);
+      break;
+    case SUB:
+      i = arith_sse2<SUB>(a, b, b_scalar, out, n);
+      break;
+    case MUL:
+      i = arith_sse2<MUL>(a, b, b_scalar, out, n);
+      break;
+    case DIV:
+      i = arith_sse2<DIV>(a, b, b_scalar, out, n);
+      break;
+    }
+  }
+#endif
+
+  arith_from(i, op, a, b, b_scalar, out, n);
+}
+
+void arith(Arith op, int64_t const *a, int64_t const *b, bool b_scalar,
+           int64_t *out, size_t n) {
+  size_t i = 0;
+
+#ifdef SIMD_X86
+  if (level() == AVX2 && op == ADD)
+    i = arith_avx2<ADD>(a, b, b_scalar, out, n);
+  else if (level() == AVX2 && op == SUB)
+    i = arith_avx2<SUB>(a, b, b_scalar, out, n);
+  else if (level() == SSE2 && op == ADD)
+    i = arith_sse2<ADD>(a, b, b_scalar, out, n);
+  else if (level() == SSE2 && op == SUB)
+    i = arith_sse2<SUB>(a, b, b_scalar, out, n);
+#endif
+
+  arith_from(i, op, a, b, b_scalar, out, n);
+}
+
+void compare(Compare op, double const *a, double const *b, bool b_scalar,
+             int64_t *out, size_t n) {
+  size_t i = 0;
+
+#ifdef SIMD_X86
+  if (level() == AVX2) {
+    switch (op) {
+    case LESS:
+      i = compare_avx2<_CMP_LT_OQ>(a, b, b_scalar, out, n);
+      break;
+    case LESSEQ:
+      i = compare_avx2<_CMP_LE_OQ>(a, b, b_scalar, out, n);
+      break;
+    case GREATER:
+      i = compare_avx2<_CMP_GT_OQ>(a, b, b_scalar, out, n);
+      break;
+    case GREATEREQ:
+      i = compare_avx2<_CMP_GE_OQ>(a, b, b_scalar, out, n);
+      break;
+    case EQUAL:
+      i = compare_avx2<_CMP_EQ_OQ>(a, b, b_scalar, out, n);
+      break;
+    }
+  } else if (level() == SSE2)
+    i = compare_sse2(op, a, b, b_scalar, out, n);
+#endif
+
+  compare_from(i, op, a, b, b_scalar, out, n);
+}
+
+void compare(Compare op, int64_t const *a, int64_t const *b, bool b_scalar,
+             int64_t *out, size_t n) {
+  size_t i = 0;
+
+#ifdef SIMD_X86
+  if (level() == AVX2)
+    i = compare_avx2(op, a, b, b_scalar, out, n);
+#endif
+
+  compare_from(i, op, a, b, b_scalar, out, n);
+}
+
+double sum(double const *a, size_t n) {
+#ifdef SIMD_X86
+  if (level() == AVX2)
+    return sum_avx2(a, n);
+  if (level() == SSE2)
+    return sum_sse2(a, n);
+#endif
+
+  double s[4] = {0, 0, 0, 0};
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    for (int j = 0; j < 4; j++) {
+      s[j] += a[i + j];
+    }
+  }
+
+  return sum4(s, a, i, n);
+}
+
+int64_t sum(int64_t const *a, size_t n) {
+#ifdef SIMD_X86
+  if (level() == AVX2)
+    return sum_avx2(a, n);
+  if (level() == SSE2)
+    return sum_sse2(a, n);
+#endif
+
+  uint64_t res = 0;
+  for (size_t i = 0; i < n; i++) {
+    res += (uint64_t)a[i];
+  }
+  return (int64_t)res;
+}
+
+double dot(double const *a, double const *b, size_t n) {
+#ifdef SIMD_X86
+  if (level() == AVX2)
+    return dot_avx2(a, b, n);
+  if (level() == SSE2)
+    return dot_sse2(a, b, n);
+#endif
+
+  double s[4] = {0, 0, 0, 0};
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    for (int j = 0; j < 4; j++) {
+      s[j] += a[i + j] * b[i + j];
+    }
+  }
+
+  return dot4(s, a, b, i, n);
+}
+
+// no 64 bit multiply to vectorize
+int64_t dot(int64_t const *a, int64_t const *b, size_t n) {
+  uint64_t res = 0;
+  for (size_t i = 0; i < n; i++) {
+    res += (uint64_t)a[i] * (uint64_t)b[i];
+  }
+  return (int64_t)res;
+}
+
+double min(double const *a, size_t n) {
+#ifdef SIMD_X86
+  if (level() == AVX2)
+    return extreme_avx2<false>(a, n);
+  if (level() == SSE2)
+    return extreme_sse2<false>(a, n);
+#endif
+
+  return *std::min_element(a, a + n);
+}
+
+double max(double const *a, size_t n) {
+#ifdef SIMD_X86
+  if (level() == AVX2)
+    return extreme_avx2<true>(a, n);
+  if (level() == SSE2)
+    return extreme_sse2<true>(a, n);
+#endif
+
+  return *std::max_element(a, a + n);
+}
+
+int64_t min(int64_t const *a, size_t n) {
+#ifdef SIMD_X86
+  if (level() == AVX2)
+    return extreme_avx2<false>(a, n);
+#endif
+
+  return *std::min_element(a, a + n);
+}
+
+int64_t max(int64_t const *a, size_t n) {
+#ifdef SIMD_X86
+  if (level() == AVX2)
+    return extreme_avx2<true>(a, n);
+#endif
+
+  return *std::max_element(a, a + n);
+}
+
+// each sum depends on the one before, in any other order reals would round
+// differently, so they are added one by one on every level
+void scan(double const *a, double *out, size_t n) {
+  double res = 0;
+  for (size_t i = 0; i < n; i++) {
+    res += a[i];
+    out[i] = res;
+  }
+}
+
+void scan(int64_t const *a, int64_t *out, size_t n) {
+  size_t i = 0;
+
+#ifdef SIMD_X86
+  if (level() == AVX2)
+    i = scan_avx2(a, out, n);
+#endif
+
+  uint64_t res = i > 0 ? (uint64_t)out[i - 1] : 0;
+  for (; i < n; i++) {
+    res += (uint64_t)a[i];
+    out[i] = (int64_t)res;
+  }
+}
+
+} // namespace simd
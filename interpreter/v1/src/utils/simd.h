@@ -0,0 +1,50 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+// kernels over packed numbers for the vec builtins. they run with AVX2 or
+// SSE2 when the cpu has them, picked at the first call, and with plain
+// loops otherwise. sums and dots of reals add in the same order on every
+// level, so a program prints the same on any machine
+namespace simd {
+
+enum Level { SCALAR, SSE2, AVX2 };
+enum Arith { ADD, SUB, MUL, DIV };
+enum Compare { LESS, LESSEQ, GREATER, GREATEREQ, EQUAL };
+
+Level level();
+void limit(Level max); // never use more than max, for --simd
+
+// out[i] = a[i] op b[i], or a[i] op b[0] if b_scalar. ints wrap around,
+// DIV is for reals only
+void arith(Arith op, double const *a, double const *b, bool b_scalar,
+           double *out, size_t n);
+void arith(Arith op, int64_t const *a, int64_t const *b, bool b_scalar,
+           int64_t *out, size_t n);
+
+// out[i] = 1 if a[i] op b[i] holds, else 0
+void compare(Compare op, double const *a, double const *b, bool b_scalar,
+             int64_t *out, size_t n);
+void compare(Compare op, int64_t const *a, int64_t const *b, bool b_scalar,
+             int64_t *out, size_t n);
+
+double sum(double const *a, size_t n);
+int64_t sum(int64_t const *a, size_t n);
+double dot(double const *a, double const *b, size_t n);
+int64_t dot(int64_t const *a, int64_t const *b, size_t n);
+
+// n has to be at least 1
+double min(double const *a, size_t n);
+int64_t min(int64_t const *a, size_t n);
+double max(double const *a, size_t n);
+int64_t max(int64_t const *a, size_t n);
+
+// inclusive prefix sums
+void scan(double const *a, double *out, size_t n);
+void scan(int64_t const *a, int64_t *out, size_t n);
+
+} // namespace simd
+
+#endif
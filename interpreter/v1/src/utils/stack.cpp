@@ -0,0 +1,32 @@
+#include "stack.h"
+#include <cstdint>
+#include <pthread.h>
+#include <unistd.h>
+
+thread_local char const *Stack::limit = nullptr;
+
+char const *Stack::thread_limit() {
+  void *lowest = nullptr;
+  size_t size = 0;
+  pthread_attr_t attr;
+
+  if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+    pthread_attr_getstack(&attr, &lowest, &size);
+    pthread_attr_destroy(&attr);
+  }
+
+  // without the bounds nothing is below the end
+  if (lowest == nullptr || size <= MARGIN)
+    limit = reinterpret_cast<char const *>(uintptr_t(1));
+  else
+    limit = static_cast<char const *>(lowest) + MARGIN;
+
+  return limit;
+}
+
+StackScope::StackScope(void *stack) : previous(Stack::limit) {
+  Stack::limit = static_cast<char const *>(stack) + sysconf(_SC_PAGESIZE) +
+                 Stack::MARGIN;
+}
+
+StackScope::~StackScope() { Stack::limit = previous; }
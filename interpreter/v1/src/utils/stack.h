@@ -0,0 +1,42 @@
+#ifndef STACK_H
+#define STACK_H
+
+#include <cstddef>
+
+// how far the stack the calling thread runs on may still grow, so a deep
+// recursion ends in an error instead of running into the guard page
+class Stack {
+public:
+  // room left for the frames of a builtin once a check fails
+  static constexpr size_t MARGIN = size_t(256) << 10;
+
+  // true once less than MARGIN bytes are left on the stack of the thread,
+  // or of the task it runs
+  static bool exhausted() {
+    return static_cast<char const *>(__builtin_frame_address(0)) < end();
+  }
+
+  // the address below which the check fails
+  static char const *end() {
+    return limit != nullptr ? limit : thread_limit();
+  }
+
+private:
+  friend class StackScope;
+
+  static thread_local char const *limit; // null until the first check
+  static char const *thread_limit();
+};
+
+// makes the stack of a task, starting with its guard page, the stack of this
+// thread while alive
+class StackScope {
+public:
+  StackScope(void *stack);
+  ~StackScope();
+
+private:
+  char const *previous;
+};
+
+#endif
@@ -0,0 +1,112 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned workers) {
+  if (workers == 0)
+    workers = 1;
+
+  for (unsigned i = 0; i < workers; i++) {
+    queues.push_back(std::make_unique<Queue>());
+  }
+
+  for (unsigned i = 1; i < workers; i++) {
+    threads.emplace_back(&ThreadPool::loop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+unsigned ThreadPool::size() const { return queues.size(); }
+
+void ThreadPool::run(size_t count,
+                     function<void(unsigned, size_t)> const &task) {
+  if (count == 0)
+    return;
+
+  for (size_t worker = 0; worker < queues.size(); worker++) {
+    size_t begin = count * worker / queues.size();
+    size_t end = count * (worker + 1) / queues.size();
+
+    std::lock_guard<std::mutex> guard(queues[worker]->lock);
+    for (size_t i = begin; i < end; i++) {
+      queues[worker]->tasks.push_back(i);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    this->task = &task;
+    busy = threads.size();
+    generation++;
+  }
+  wake.notify_all();
+
+  drain(0);
+
+  std::unique_lock<std::mutex> guard(lock);
+  done.wait(guard, [this] { return busy == 0; });
+  this->task = nullptr;
+}
+
+void ThreadPool::loop(unsigned worker) {
+  size_t seen = 0;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      wake.wait(guard, [&] { return stopping || generation != seen; });
+
+      if (stopping)
+        return;
+      seen = generation;
+    }
+
+    drain(worker);
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (--busy == 0)
+      done.notify_all();
+  }
+}
+
+void ThreadPool::drain(unsigned worker) {
+  size_t index;
+  while (next(worker, index)) {
+    (*task)(worker, index);
+  }
+}
+
+bool ThreadPool::next(unsigned worker, size_t &index) {
+  {
+    auto &own = *queues[worker];
+    std::lock_guard<std::mutex> guard(own.lock);
+
+    if (!own.tasks.empty()) {
+      index = own.tasks.front();
+      own.tasks.pop_front();
+      return true;
+    }
+  }
+
+  for (size_t i = 1; i < queues.size(); i++) {
+    auto &other = *queues[(worker + i) % queues.size()];
+    std::lock_guard<std::mutex> guard(other.lock);
+
+    if (!other.tasks.empty()) {
+      index = other.tasks.back();
+      other.tasks.pop_back();
+      return true;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,54 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::function, std::size_t, std::unique_ptr, std::vector;
+
+// a fixed set of threads for parallel loops. every worker gets an equal run
+// of the tasks of a loop in its own queue and takes them from the front,
+// one that runs out steals from the back of the others
+class ThreadPool {
+public:
+  ThreadPool(unsigned workers);
+  ~ThreadPool();
+
+  ThreadPool(ThreadPool const &) = delete;
+  ThreadPool &operator=(ThreadPool const &) = delete;
+
+  unsigned size() const;
+
+  // calls task(worker, i) for every i below count and returns once all are
+  // done. worker is below size(), the calling thread works as worker 0. a
+  // task must not throw and must not run a loop on the same pool
+  void run(size_t count, function<void(unsigned, size_t)> const &task);
+
+private:
+  struct Queue {
+    std::mutex lock;
+    std::deque<size_t> tasks;
+  };
+
+  vector<std::thread> threads;
+  vector<unique_ptr<Queue>> queues;
+
+  std::mutex lock;
+  std::condition_variable wake, done;
+  function<void(unsigned, size_t)> const *task = nullptr;
+  size_t generation = 0; // of the loop running, bumped by run
+  unsigned busy = 0;     // threads still working on it
+  bool stopping = false;
+
+  void loop(unsigned worker);
+  void drain(unsigned worker);
+  bool next(unsigned worker, size_t &index);
+};
+
+#endif